@@ -1,24 +1,72 @@
 #pragma once
+#include <stdbool.h>
 #include <vulkan/vulkan.h>
 
+struct MemoryPool;
+
+/*
+	Device memory is allocated in large blocks & suballocated with TLSF.
+	Each memory type has two pools: linear (buffers) & optimal (images),
+	so resources of different kinds never share a bufferImageGranularity page.
+*/
+struct Allocator {
+	VkPhysicalDevice physical_device;
+	VkDevice device;
+	VkPhysicalDeviceMemoryProperties memory_properties;
+	VkDeviceSize buffer_image_granularity;
+	struct MemoryPool** pools; //Per memory type & kind, created on first use
+	unsigned block_count; //Live vkAllocateMemory allocations
+};
+
 struct Allocation {
 	VkDeviceMemory memory;
 	unsigned count;
-	VkDeviceSize* offsets;
+	VkDeviceSize* offsets; //Resource offsets in memory
+	void* mapped; //Host address of memory (NULL if not host-visible)
+	//Suballocation
+	unsigned pool;
+	unsigned range;
+};
+
+//Persistently mapped buffer divided into one region per frame
+struct FrameRing {
+	unsigned frame_count;
+	VkDeviceSize frame_size; //Stride between frame regions
+	void* mapped; //Host address of frame 0
+	//Buffer read by the device
+	VkBuffer buffer;
+	struct Allocation alloc;
+	//Host-visible copy of buffer (VK_NULL_HANDLE if buffer is host-visible)
+	VkBuffer staging_buffer;
+	struct Allocation staging_alloc;
 };
 
+static inline VkDeviceSize align_size(const VkDeviceSize size, const VkDeviceSize alignment) {
+	const VkDeviceSize rem = size % alignment;
+	return rem ? size + alignment - rem : size;
+}
+
+VkResult create_allocator(const VkPhysicalDevice, const VkDevice, struct Allocator* const);
+void destroy_allocator(struct Allocator* const);
+
+bool find_memory_type(
+	const struct Allocator* const,
+	const uint32_t,
+	const VkMemoryPropertyFlags,
+	uint32_t* const
+);
+
 VkResult create_allocation(
-	const VkPhysicalDevice,
-	const VkDevice,
-	const VkMemoryPropertyFlags uint32_t,
+	struct Allocator* const,
+	const VkMemoryPropertyFlags,
 	const unsigned,
 	const VkMemoryRequirements* const,
+	const bool* const,
 	struct Allocation* const
 );
 
 VkResult create_buffers(
-	const VkPhysicalDevice,
-	const VkDevice,
+	struct Allocator* const,
 	const unsigned,
 	const VkBufferCreateInfo* const,
 	const VkMemoryPropertyFlags,
@@ -27,8 +75,7 @@ VkResult create_buffers(
 );
 
 VkResult create_images(
-	const VkPhysicalDevice,
-	const VkDevice,
+	struct Allocator* const,
 	const unsigned,
 	const VkImageCreateInfo* const,
 	const VkMemoryPropertyFlags,
@@ -36,4 +83,18 @@ VkResult create_images(
 	struct Allocation* const
 );
 
-void free_allocation(VkDevice, struct Allocation);
+void free_allocation(struct Allocator* const, struct Allocation);
+
+VkResult create_frame_ring(
+	struct Allocator* const,
+	const unsigned,
+	const VkDeviceSize,
+	const VkBufferUsageFlags,
+	struct FrameRing* const
+);
+
+void destroy_frame_ring(struct Allocator* const, struct FrameRing);
+
+static inline void* frame_ring_data(const struct FrameRing* const ring, const unsigned frame) {
+	return ring->mapped + frame * ring->frame_size;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <cglm/mat4.h>
+#include <cglm/vec3.h>
+#include <cglm/vec4.h>
+
+#define BVH_LEAF_SIZE 8 //Maximum items per leaf
+
+//Items tested at once by cull_bvh
+#if defined(__AVX__)
+#define BVH_WIDTH 8
+#else
+#define BVH_WIDTH 4 //SSE, NEON
+#endif
+
+//Axis-aligned bounding box
+struct Box {
+	vec3 start, end;
+};
+
+struct BVHNode {
+	struct Box box;
+	unsigned first, count; //Slots of the items in the subtree
+	unsigned child; //First of two adjacent children (0 for leaves)
+};
+
+/*
+	Bounding volume hierarchy over boxes of items.
+	Built once by median splits, then refit to new boxes without changing its topology.
+	Children follow their parents, & each subtree's items occupy contiguous slots.
+	Item centers & extents are kept per slot in structure of arrays layout for batched tests.
+*/
+struct BVH {
+	unsigned node_count;
+	struct BVHNode* nodes;
+	unsigned item_count;
+	unsigned* items; //Item in each slot
+	float* centers[3]; //x, y, z (padded to a multiple of BVH_WIDTH)
+	float* extents[3];
+};
+
+void transform_box(const struct Box, mat4, struct Box* const);
+void create_bvh(const unsigned, const unsigned* const, const struct Box* const, struct BVH* const);
+void destroy_bvh(struct BVH* const);
+void refit_bvh(struct BVH* const, const struct Box* const);
+unsigned split_bvh(const struct BVH* const, const unsigned, unsigned* const);
+unsigned cull_bvh_subtree(const struct BVH* const, const unsigned, const vec4* const, unsigned* const);
+unsigned cull_bvh(const struct BVH* const, const vec4* const, unsigned* const);
@@ -1,5 +1,6 @@
 #pragma once
 #include <cglm/vec3.h>
+#include <cglm/vec4.h>
 
 enum Projection {ORTHOGRAPHIC, PERSPECTIVE};
 
@@ -14,4 +15,5 @@ struct Camera create_camera();
 void camera_transform(struct Camera, mat4);
 void camera_view(struct Camera, mat4); //View matrix
 void camera_projection(struct Camera, mat4); //Projection matrix
+void camera_frustum(struct Camera, vec4*); //Frustum planes
 void camera_look(struct Camera*, vec3);
@@ -0,0 +1,74 @@
+#pragma once
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <SDL2/SDL.h>
+
+//Runs job i for each i in the submitted range
+typedef void (*JobFunction)(void*, unsigned);
+
+/*
+	Counts unfinished jobs.
+	When it reaches zero, its continuation (if any) is submitted.
+	Zero initialize, & set the continuation before submitting jobs with the counter.
+*/
+struct JobCounter {
+	atomic_uint count;
+	//Continuation
+	JobFunction then;
+	void* then_data;
+	unsigned then_count;
+	struct JobCounter* then_counter; //Signaled by the continuation (may be NULL)
+};
+
+//Range of indices of one function call each
+struct Job {
+	JobFunction function;
+	void* data;
+	unsigned begin, end;
+	unsigned grain; //Ranges larger than this are split when run
+	struct JobCounter* counter;
+};
+
+//Per worker statistics
+struct JobStats {
+	uint64_t job_count; //Function calls
+	uint64_t steal_count; //Ranges taken from other workers
+	double job_time, max_job_time; //Seconds, if timing is enabled
+};
+
+struct Worker;
+
+/*
+	Work stealing scheduler.
+	Each worker owns a deque of jobs: it pushes & pops at one end, idle workers steal from the other.
+	Ranges split in halves as they run, so idle workers always find work to steal.
+	The creating thread is worker 0 & works whenever it waits on a counter.
+	Jobs submitted from other threads run immediately on the submitting thread.
+*/
+struct JobSystem {
+	unsigned thread_count;
+	struct Worker* workers;
+	//Sleeping workers
+	SDL_mutex* mutex;
+	SDL_cond* wake_cond;
+	atomic_uint queued; //Jobs in all deques
+	atomic_uint sleeping;
+	atomic_bool quit;
+	bool timing; //Time each function call in the statistics
+};
+
+bool create_job_system(const unsigned, struct JobSystem* const);
+void destroy_job_system(struct JobSystem* const);
+void jobs_submit(struct JobSystem* const, const unsigned, const JobFunction, void* const, struct JobCounter* const);
+void jobs_counter_then(
+	struct JobCounter* const,
+	const unsigned,
+	const JobFunction,
+	void* const,
+	struct JobCounter* const
+);
+void jobs_wait(struct JobSystem* const, struct JobCounter* const);
+void jobs_parallel_for(struct JobSystem* const, const unsigned, const JobFunction, void* const);
+void jobs_get_stats(const struct JobSystem* const, struct JobStats* const);
+void jobs_reset_stats(struct JobSystem* const);
@@ -0,0 +1,21 @@
+#pragma once
+
+#define LOD_MAX_COUNT 4 //Simplified levels per primitive
+#define LOD_REDUCTION 0.5f //Target index count of each level, relative to the previous
+#define LOD_MIN_REDUCTION 0.85f //Levels keeping more of the previous level's indices end the chain
+#define LOD_MAX_ERROR 0.05f //Of a primitive's last level, relative to its bounding box diagonal
+
+struct Vertex;
+
+/*
+	Simplified level of detail of a primitive, referencing its vertices.
+	Its error conservatively estimates how far its surface moved off the full-resolution surface (mesh space),
+	summing collapses' displacements rather than averaging them like quadrics, so selection may treat it as a bound.
+*/
+struct Lod {
+	unsigned first_index, index_count;
+	float error;
+};
+
+unsigned simplify(const unsigned, const struct Vertex* const, const unsigned, const unsigned* const, const unsigned, const float, unsigned* const, float* const);
+unsigned build_lods(const unsigned, const struct Vertex* const, const unsigned, const unsigned* const, struct Lod** const, unsigned** const);
@@ -0,0 +1,21 @@
+#pragma once
+#include <cglm/vec3.h>
+
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+struct Vertex;
+
+/*
+	Cluster of a primitive's triangles, culled as a whole.
+	Its triangles are a range of the primitive's indices, referencing at most MESHLET_MAX_VERTICES vertices.
+*/
+struct Meshlet {
+	unsigned first_index, index_count;
+	vec3 center; //Bounding sphere
+	float radius;
+	vec3 cone_axis; //Average normal
+	float cone_cutoff; //Sine of the normal cone's half angle (1 if its triangles never all face away)
+};
+
+unsigned build_meshlets(const unsigned, const struct Vertex* const, const unsigned, const unsigned* const, struct Meshlet** const);
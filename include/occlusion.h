@@ -0,0 +1,42 @@
+#pragma once
+#include "bvh.h"
+#include <cglm/mat4.h>
+#include <cglm/vec3.h>
+#include <stdbool.h>
+
+#define OCCLUSION_TILE_SIZE 8 //Pixels per side of a tile
+
+//Pixels rasterized at once
+#if defined(__AVX__)
+#define OCCLUSION_WIDTH 8
+#else
+#define OCCLUSION_WIDTH 4 //SSE, NEON
+#endif
+
+//Geometry of a mesh drawn into occlusion buffers
+struct Occluder {
+	unsigned vertex_count;
+	vec3* positions;
+	unsigned index_count; //0 if the mesh isn't used as an occluder
+	unsigned* indices;
+};
+
+/*
+	Low resolution depth buffer of occluders, rasterized on the CPU.
+	Each pixel keeps the nearest of the triangles covering its center, each at its farthest vertex,
+	& each tile the farthest depth of its pixels, so most tests stop at the tiles.
+*/
+struct OcclusionBuffer {
+	unsigned width, height; //Multiples of OCCLUSION_TILE_SIZE
+	float* depths; //Rows of pixels (normalized device coordinates)
+	float* tile_depths; //Rows of tiles
+	unsigned triangle_count; //Rasterized since the last clear
+};
+
+void create_occlusion_buffer(const unsigned, const unsigned, struct OcclusionBuffer* const);
+void destroy_occlusion_buffer(struct OcclusionBuffer* const);
+void clear_occlusion_buffer(struct OcclusionBuffer* const);
+void rasterize_occluder(struct OcclusionBuffer* const, mat4, const struct Occluder* const);
+void update_occlusion_tiles(struct OcclusionBuffer* const);
+void project_box(const struct Box, mat4, struct Box* const);
+bool test_occlusion(const struct OcclusionBuffer* const, const struct Box);
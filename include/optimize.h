@@ -0,0 +1,26 @@
+#pragma once
+
+#define VERTEX_CACHE_SIZE 16 //FIFO entries simulated & optimized for
+#define OVERDRAW_THRESHOLD 1.05f //ACMR overdraw ordering may cost, relative to the vertex cache order
+
+struct Vertex;
+
+//Post-transform vertex cache simulation (FIFO of VERTEX_CACHE_SIZE)
+struct CacheStats {
+	unsigned triangle_count;
+	unsigned vertex_count;
+	unsigned miss_count; //Vertices transformed
+};
+
+//Vertex cache statistics of primitives before & after optimization (both of their unique vertices)
+struct OptimizationStats {
+	struct CacheStats before, after;
+};
+
+void analyze_vertex_cache(const unsigned, const unsigned* const, const unsigned, struct CacheStats* const);
+float cache_acmr(const struct CacheStats);
+float cache_atvr(const struct CacheStats);
+unsigned deduplicate_vertices(const unsigned, struct Vertex* const, const unsigned, unsigned* const, unsigned* const);
+void optimize_vertex_cache(const unsigned, unsigned* const, const unsigned);
+void optimize_overdraw(const unsigned, unsigned* const, const struct Vertex* const, const unsigned, const float);
+unsigned optimize_vertex_fetch(const unsigned, struct Vertex* const, const unsigned, unsigned* const, unsigned* const);
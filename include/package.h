@@ -0,0 +1,67 @@
+#pragma once
+#include "scene.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+	Cooked scene package, written by lightrail-cook & mapped by load_package.
+	Layout:
+		PackageHeader
+		Tables (meshes, primitives, nodes, children, materials, textures)
+		Geometry (vertices, indices, meshlets, detail levels & grid positions of each primitive), page aligned
+		Texture pixels (BGRA32), page aligned
+	Offsets are from the start of the package.
+	Vertices, meshlets, detail levels & materials are stored as their in-memory structs,
+	so packages are only valid for builds with the same layout (see PACKAGE_VERSION).
+*/
+
+#define PACKAGE_MAGIC "LRPKG"
+#define PACKAGE_EXTENSION ".lrpkg"
+static const uint32_t PACKAGE_VERSION = 9;
+static const uint64_t PACKAGE_PAGE_SIZE = 4096;
+static const uint64_t PACKAGE_BLOB_ALIGNMENT = 16;
+
+struct PackageHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t vertex_size, meshlet_size, lod_size, material_size; //Of the structs stored as they are
+	uint32_t mesh_count, primitive_count, node_count, child_count, material_count, texture_count;
+	uint64_t size; //Of the whole package
+	//Table offsets
+	uint64_t meshes, primitives, nodes, children, materials, textures;
+};
+
+struct PackageMesh {
+	uint32_t primitive_count, first_primitive;
+	float box_start[3], box_end[3]; //Bounding box
+	float quantization_offset[3], quantization_scale[3]; //Position grid of compact vertices
+};
+
+struct PackagePrimitive {
+	uint32_t vertex_count, index_count;
+	uint64_t vertices, indices;
+	uint32_t material;
+	float box_start[3], box_end[3]; //Bounding box
+	uint32_t meshlet_count;
+	uint64_t meshlets;
+	uint32_t lod_count, lod_index_count;
+	uint64_t lods, lod_indices;
+	uint64_t grid_positions; //0 if none
+};
+
+//Nodes are stored flattened (see scene_flatten)
+struct PackageNode {
+	uint32_t child_count, first_child; //Into the children table
+	uint32_t mesh;
+	uint8_t has_mesh, dynamic;
+	float translation[3], rotation[4], scaling[3]; //Local transformation
+};
+
+struct PackageTexture {
+	uint32_t width, height, pitch;
+	uint64_t pixels;
+};
+
+bool save_package(const char* const, const struct Scene* const);
+bool load_package(const char* const, struct Scene* const);
+bool load_scene_file(const char* const, struct JobSystem* const, struct OptimizationStats* const, struct Scene* const);
@@ -0,0 +1,15 @@
+#pragma once
+#include "scene.h"
+#include <stdint.h>
+
+//Vertex in the compact layout (16 bytes)
+struct CompactVertex {
+	uint16_t position[3]; //On its mesh's quantization grid
+	uint16_t padding;
+	int16_t normal[2]; //Octahedral encoding (normalized)
+	uint16_t tex[2]; //Half floats
+};
+
+uint16_t half_float(const float);
+void encode_octahedral(const vec3, int16_t* const);
+void quantize_vertices(const unsigned, const struct Vertex* const, const uint16_t* const, const vec3, const vec3, struct CompactVertex* const);
@@ -1,34 +1,81 @@
 #pragma once
 #include "alloc.h"
+#include "bvh.h"
 #include "camera.h"
+#include "jobs.h"
+#include "occlusion.h"
+#include "quantize.h"
 #include "scene.h"
+#include "upload.h"
 #include <stdbool.h>
 #include <SDL2/SDL.h>
 #include <vulkan/vulkan.h>
 
 static const char* const PIPELINE_CACHE_FILENAME = "pipeline-cache.bin";
+static const unsigned DEFAULT_FRAME_COUNT = 2; //Frames in flight
+static const float DEFAULT_LOD_THRESHOLD = 1; //Pixels
+
+enum Culling {
+	CULLING_NONE, //Draw every node with a mesh
+	CULLING_CPU, //Cull the node BVH, & compact draw commands into the frame's region
+	CULLING_GPU, //Cull & compact draw commands in a compute pass
+	CULLING_OCCLUSION, //GPU culling, & two-phase occlusion culling against a depth pyramid
+	CULLING_SOFTWARE, //CPU culling, & occlusion culling against occluders rasterized on the CPU
+	CULLING_MESHLET //Cull each node's meshlets in a compute pass (frustum, normal cone & size)
+};
+
+//Statistics of a completed frame
+struct RenderStats {
+	unsigned draw_count; //Draws submitted
+	unsigned command_count; //Indirect draw commands submitted (an instanced command covers several draws)
+	unsigned frustum_culled_count, occlusion_culled_count; //Draws skipped
+	unsigned cluster_culled_count; //Meshlets skipped by their normal cones or size
+	unsigned culled_triangle_count; //Triangles of skipped draws (at full detail)
+	unsigned triangle_count; //Triangles of submitted draws (at their detail levels)
+	double gpu_time; //Seconds from the start of the frame to the end of drawing (0 if unsupported)
+};
+
+//Results of a job culling nodes or writing their draws, within its range of the outputs
+struct NodeJob {
+	unsigned first, count; //Range written (nodes, occluder candidates or draws)
+	unsigned draw_count; //Of the job's nodes
+	unsigned triangle_count, full_triangle_count; //Of the draws at their detail levels & at full detail
+};
 
 struct Renderer {
 	SDL_Window* window;
 	VkInstance instance;
 	VkSurfaceKHR surface;
 	VkPhysicalDevice physical_device;
-	uint32_t graphics_queue_family, present_queue_family;
+	uint32_t graphics_queue_family, present_queue_family, transfer_queue_family;
 	VkDevice device;
 	VkQueue graphics_queue, present_queue;
+	struct Allocator allocator;
+	struct Uploader uploader;
 	VkCommandPool command_pool;
-	VkCommandBuffer transfer_command_buffer;
 	//Descriptors
 	VkSampler sampler;
 	VkDescriptorSetLayout descriptor_set_layout;
 	VkPipelineLayout pipeline_layout;
+	//Culling compute pass
+	VkDescriptorSetLayout cull_descriptor_set_layout;
+	VkPipelineLayout cull_pipeline_layout;
+	VkPipeline cull_pipeline;
+	VkPipeline group_pipeline; //Writes the instanced commands of culled draws' groups
+	//Depth pyramid reduction
+	VkDescriptorSetLayout pyramid_descriptor_set_layout;
+	VkPipelineLayout pyramid_pipeline_layout;
+	VkPipeline pyramid_pipeline;
+	VkSampler pyramid_sampler; //Nearest, without filtering
 	//VkSampleCountFlagBits sample_count;
 	VkPipelineCache pipeline_cache;
 
 	//Resolution-dependent
 	VkExtent2D resolution;
 	VkRenderPass render_pass;
+	VkRenderPass load_render_pass; //Continues drawing into the attachments (occlusion culling's late phase)
 	VkPipeline pipeline;
+	VkPipeline compact_pipeline; //For the compact vertex layout
 
 	//Swapchain
 	VkExtent2D surface_extent;
@@ -37,6 +84,10 @@ struct Renderer {
 	VkImage* swapchain_images;
 
 	//Frames
+	/*
+		Up to frame_count frames are in flight at once.
+		A frame's resources are reused only after its fence has signaled.
+	*/
 	unsigned current_frame;
 	unsigned frame_count;
 	//Framebuffers
@@ -54,6 +105,7 @@ struct Renderer {
 	VkCommandBuffer* command_buffers;
 	VkDescriptorPool descriptor_pool;
 	VkDescriptorSet* descriptor_sets;
+	VkDescriptorSet* cull_descriptor_sets;
 	//Synchronization
 	/*
 		Semaphores (per frame):
@@ -62,49 +114,201 @@ struct Renderer {
 	*/
 	VkSemaphore* semaphores;
 	VkFence* fences;
-	//Frame buffers
-	VkBuffer staging_buffer;
-	VkDeviceSize staging_size;
-	struct Allocation staging_alloc;
+	//Depth pyramid
 	/*
-		Frame buffers (per frame):
-		1. Uniform
-		2. Storage
+		Mip chain of the farthest depth of the current frame's early draws (occlusion culling).
+		Level 0 is the largest power of two extent within the resolution.
 	*/
-	VkBuffer* frame_buffers;
-	VkDeviceSize uniform_size, storage_size;
-	struct Allocation frame_buffer_alloc;
-
-	//Host-local dynamic scene data (size = staging_size)
+	VkExtent2D pyramid_extent;
+	unsigned pyramid_level_count;
+	VkImage pyramid;
+	VkImageView pyramid_view; //Every level, sampled
+	VkImageView* pyramid_level_views; //Storage
+	struct Allocation pyramid_alloc;
+	VkDescriptorPool pyramid_descriptor_pool;
+	VkDescriptorSet* pyramid_descriptor_sets; //Per frame & level
+	//Statistics
+	VkQueryPool query_pool; //Start & end timestamps of each frame
+	float timestamp_period; //Nanoseconds per tick (0 without timestamps)
+	VkBuffer stats_buffer; //Per frame region of counters written by culling passes (host-visible)
+	struct Allocation stats_alloc;
+	VkDeviceSize stats_stride;
+	struct RenderStats stats; //Of the last completed frame
+	unsigned submitted_count; //Frames submitted (saturated at the frame count)
+	//Frame data
+	/*
+		Persistently mapped ring with one region per frame.
+		Region contents:
+		1. Camera (uniform)
+		2. Nodes (storage)
+		3. Draw commands of visible nodes (indirect)
+		4. Instances (storage): draw of each instance, the identity for the first draw_count
+		   (then written by CPU culling or the culling pass with instancing)
+	*/
+	struct FrameRing frame_data;
+	VkDeviceSize uniform_offset, uniform_size;
+	VkDeviceSize storage_offset, storage_size;
+	VkDeviceSize draw_offset, draw_size;
+	VkDeviceSize instance_offset, instance_size;
+	//Node uploads
+	/*
+		Static nodes are written to every frame region once, when the scene is loaded.
+		A changed dynamic node stays pending until each frame region holds its new transformation.
+		Pending nodes are kept sorted, so adjacent nodes coalesce into one copy region.
+	*/
+	unsigned dynamic_node_count;
+	unsigned* dynamic_nodes;
+	unsigned pending_node_count;
+	unsigned* pending_nodes;
+	unsigned char* pending_frames; //Per node: frame regions still holding an old transformation
+	unsigned copy_region_count;
+	VkBufferCopy* copy_regions; //Regions of the current frame to transfer (without a host-visible ring)
+	unsigned stale_frame_count; //Frame regions still to be transferred whole (without a host-visible ring)
+	//Culling
+	/*
+		CPU: Nodes with meshes are kept in a BVH over their world bounds, refit after dynamic nodes move.
+		Each frame, the draw commands of nodes intersecting the camera frustum
+		are compacted into the frame's region.
+		GPU: A compute pass tests each draw's bounds, transformed by its node,
+		& appends visible draws to the culled draw buffer, counting them in the count buffer.
+		Occlusion: The early phase draws what was visible last frame,
+		the depth pyramid is built from the result,
+		& the late phase draws the rest that is neither outside the frustum nor behind the pyramid.
+		Each draw's visibility is kept for the next frame.
+		With instancing, visible draws are instead compacted into their groups' instance ranges,
+		& a second pass appends one instanced command per group with instances.
+		Software: After CPU culling, the visible nodes whose bounds cover the most of the screen
+		are rasterized into the occlusion buffer (within a triangle budget),
+		& nodes whose projected bounds are behind it are removed.
+		CPU culling & writing draw commands run as jobs of subtrees or ranges of nodes,
+		each writing into its own range of the outputs, compacted after the join.
+	*/
+	enum Culling culling;
+	struct JobSystem* jobs; //Culls on the calling thread if NULL (the default)
+	vec4 frustum[6];
+	mat4 view_projection;
+	struct Box* mesh_boxes;
+	struct Box* node_boxes; //World bounds of each node
+	struct BVH bvh;
+	bool stale_bvh; //Node bounds changed since the last refit
+	unsigned cull_root_count;
+	unsigned* cull_roots; //BVH subtrees culled by each job
+	struct NodeJob* node_jobs; //Scratch
+	/*
+		Draws: each node with a mesh has one per primitive of the mesh.
+		Draws of each primitive are consecutive, so they can be drawn as instances of one command.
+		An instance indexes the frame's instance list, holding its draw,
+		whose node & material are in the draw data buffer.
+		A draw's own command has the draw as its first instance.
+	*/
+	VkDrawIndexedIndirectCommand* draws; //At full detail
+	unsigned* node_draws; //Draws of each node, consecutive
+	unsigned* node_first_draws; //First in node_draws of each node, then the draw count
+	unsigned* draw_primitives; //Primitive of each draw (of every mesh, consecutive)
+	unsigned* visible_nodes;
+	//Software occlusion culling
+	unsigned mesh_count;
+	struct Occluder* occluders; //Per mesh
+	unsigned* node_meshes;
+	mat4* node_transformations; //Of nodes with meshes
+	struct OcclusionBuffer occlusion_buffer;
+	struct Box* screen_boxes; //Projected bounds of each visible node
+	struct OccluderCandidate* occluder_candidates;
+	/*
+		Culling buffers (GPU):
+		1. Culled draws (early, then late at draw_count, or of meshlets)
+		2. Culled draw counts (early & late)
+		3. Visibility of each draw
+		4. Instance counts of each group (early & late, with instancing)
+	*/
+	VkBuffer cull_buffers[4];
+	struct Allocation cull_alloc;
+	bool reset_visibility; //Before the next culling pass
+	unsigned triangle_count; //Of every draw
+	//Level of detail
+	/*
+		Each primitive has a chain of detail levels, the first at full resolution.
+		Each draw uses the coarsest level of its primitive whose error, scaled by the node
+		& projected at the nearest point of the node's bounds, is within lod_threshold pixels.
+		Levels are selected while culling (on the CPU or in the culling pass), or for every node without culling.
+		Meshlet culling draws full-resolution meshlets.
+	*/
+	float lod_threshold; //0 for full detail
+	unsigned lod_count;
+	struct Lod* lods; //Of every primitive, consecutive (ranges of the index buffer)
+	unsigned* primitive_lods; //First level of each primitive, then the level count
+	vec3 camera_position;
+	float lod_scale; //Pixels per unit of error at unit distance (at any distance if orthographic)
+	bool perspective;
+	//Instancing
+	/*
+		Draws of a primitive at the same detail level are drawn by one instanced command:
+		without culling, from the static buffer at full detail,
+		& with culling on the CPU, grouping visible draws into the frame's instance list after the identity.
+		GPU culling groups them the same way (or by meshlet), each group having a range of its primitive's
+		draw count in the instance list after the identity (a range of lod_instance_count per list).
+		Chosen before a scene is loaded.
+	*/
+	bool instancing;
+	unsigned primitive_count;
+	VkDrawIndexedIndirectCommand* primitive_draws; //Instanced command of the draws of each primitive
+	unsigned instanced_draw_count; //Primitives with draws
+	unsigned lod_instance_count; //Instance ranges of every detail level (GPU culling)
+	unsigned* instance_draws; //Visible draws (scratch)
+	unsigned* instance_lods; //Detail level of each visible draw (scratch)
+	unsigned* lod_instances; //Visible draws at each detail level, then their next instance (scratch)
+	//Vertex formats
+	/*
+		Compact: vertices are quantized to 16 bytes (see CompactVertex),
+		positions on their mesh's grid, dequantized with the node quantization buffer.
+		Indices are 16-bit if every primitive has at most 65536 vertices (draws are relative to a primitive's vertices).
+		Chosen before a scene is loaded.
+	*/
+	bool compact_vertices;
+	VkIndexType index_type;
+	//Static batching
 	/*
-		Contents:
-		1. Camera
-		2. Nodes
+		The primitives of static nodes are transformed into world space & merged by material
+		into batches of spatially close primitives, each drawn by one node at the identity.
+		Dynamic & unbatched nodes with meshes are kept, & batched nodes' transformations are dropped from the frame regions.
+		Batches are usually too large to rasterize as software occluders.
+		Chosen before a scene is loaded.
 	*/
-	void* restrict host_data;
+	bool static_batching;
+	unsigned* scene_nodes; //Scene node of each node (~0u for batches)
 	//Static scene data
 	/*
-		1. Vertices
-		2. Indices
+		1. Vertices (full or compact)
+		2. Indices (of every primitive, then of every simplified level of every primitive)
 		3. Meshes
-		4. Draw calls
+		4. Draw calls (of every primitive of every node with a mesh, then instanced of each primitive with draws)
 		5. Materials (TODO: Move above draw calls)
+		6. Draw bounds (primitive's, mesh space, for GPU culling)
+		7. Meshlets (of every primitive)
+		8. Meshlet draws (draw & meshlet, for every meshlet of every draw)
+		9. Detail levels (of every primitive)
+		10. Node quantization (position grid of each node's mesh, for compact vertices)
+		11. Draw data (node & material of each draw)
+		12. Instance groups (instanced command of each detail level, then of each meshlet, for GPU culling)
 	*/
-	VkBuffer static_buffers[5];
+	VkBuffer static_buffers[12];
 	struct Allocation static_alloc;
 	//Textures
 	unsigned texture_count;
 	VkImage* textures;
 	VkImageView* texture_views;
 	struct Allocation texture_alloc;
-	unsigned draw_count;
+	unsigned draw_count; //Primitives of nodes with meshes
+	unsigned meshlet_count;
+	unsigned meshlet_draw_count;
+	uint64_t upload_value; //Uploader timeline value the scene's resources are ready at
 };
 
 //Renderer methods
-bool create_renderer(SDL_Window*, struct Renderer* const);
+bool create_renderer(SDL_Window*, const unsigned, struct Renderer* const);
 void destroy_renderer(struct Renderer);
 void renderer_draw(struct Renderer* const);
 void renderer_load_scene(struct Renderer* const, struct Scene);
 void renderer_destroy_scene(struct Renderer* const);
 void renderer_update_camera(struct Renderer* const, const struct Camera);
-void renderer_update_nodes(struct Renderer* const, const struct Scene);
+void renderer_update_nodes(struct Renderer* const, struct Scene* const);
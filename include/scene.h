@@ -1,4 +1,9 @@
 #pragma once
+#include "jobs.h"
+#include "lod.h"
+#include "meshlet.h"
+#include "optimize.h"
+#include "transform.h"
 //#include <cglm/vec2.h>
 #include <cglm/vec3.h>
 #include <cglm/vec4.h>
@@ -6,6 +11,9 @@
 #include <cglm/quat.h>
 #include <SDL2/SDL_image.h>
 #include <stdbool.h>
+#include <stdint.h>
+
+#define BATCH_MAX_VERTICES 65536 //Of a static batch (keeps its indices 16-bit & its bounds small enough to cull)
 
 struct Vertex {
 	vec3 pos; //Position
@@ -13,7 +21,6 @@ struct Vertex {
 	//vec3 tangent; //Tangent vector
 	//vec3 bitangent; //Bitangent vector
 	vec2 tex; //Texture coordinates
-	unsigned material;
 };
 
 struct Primitive {
@@ -21,13 +28,21 @@ struct Primitive {
 	struct Vertex* vertices;
 	unsigned index_count;
 	unsigned* indices;
-	//unsigned material;
+	unsigned material;
+	vec3 box_start, box_end; //Bounding box
+	unsigned meshlet_count;
+	struct Meshlet* meshlets; //Covering the indices in order
+	unsigned lod_count;
+	struct Lod* lods; //Simplified levels of decreasing detail
+	unsigned* lod_indices; //Of every level, consecutive
+	uint16_t* grid_positions; //3 per vertex on the mesh's quantization grid, copied from quantized positions (else NULL)
 };
 
 struct Mesh {
 	unsigned primitive_count;
 	struct Primitive* primitives;
-	//float box_start[3], box_end[3]; //Bounding box
+	vec3 box_start, box_end; //Bounding box (of every primitive)
+	vec3 quantization_offset, quantization_scale; //Position grid of compact vertices (offset + scale * [0, 65535])
 };
 
 struct Node {
@@ -36,12 +51,11 @@ struct Node {
 	bool has_mesh;
 	unsigned mesh;
 	//bool enabled;
-	//Local transformations
-	vec3 translation;
-	versor rotation;
-	vec3 scaling;
-	//World transformation
-	bool valid_transform;
+	bool dynamic; //Transformation may change after the scene is loaded into a renderer (animated, or set by scene_set_node_dynamic)
+	//World transformation (local transformations are in Scene.transforms)
+	bool valid_transform; //Cleared by scene_invalidate_node
+	bool dirty; //Changed since the renderer last read it
+	bool unbatched; //Kept out of static batches even if static (dynamic nodes always are)
 	mat4 transformation;
 };
 
@@ -68,6 +82,22 @@ struct Scene {
 	struct Material* materials;
 	unsigned texture_count;
 	SDL_Surface** textures;
+	/*
+		Flattened hierarchy.
+		Nodes are stored in preorder: parents precede children & subtrees are contiguous.
+	*/
+	unsigned* parents; //Parent of each node (NO_PARENT for roots)
+	unsigned* subtree_ends; //Index after each node's last descendant
+	struct Transforms transforms; //Local transformations
+	//Nodes invalidated since the last update
+	unsigned invalid_count;
+	unsigned* invalid_nodes;
+	//Subtrees updated by one job each (scratch for scene_update_transformations)
+	unsigned task_count;
+	unsigned* tasks;
+	//Mapped package holding geometry, hierarchy, materials & pixels (NULL if loaded from glTF)
+	void* package;
+	size_t package_size;
 	/*
 	unsigned light_count;
 	struct Light* lights;
@@ -75,6 +105,11 @@ struct Scene {
 };
 
 //bool load_obj(const char* const, struct Mesh*);
-bool load_scene(const char* const, struct Scene*);
-void scene_update_transformations(struct Scene*);
+bool load_scene(const char* const, struct JobSystem* const, struct OptimizationStats* const, struct Scene*);
+void scene_flatten(struct Scene* const);
+void scene_set_node_dynamic(struct Scene* const, const unsigned);
+bool scene_invalidate_node(struct Scene* const, const unsigned);
+void scene_update_transformations(struct Scene* const, struct JobSystem* const);
 void destroy_scene(struct Scene);
+void scene_batch_static(const struct Scene, struct Scene* const, unsigned** const);
+void scene_destroy_batches(struct Scene, const unsigned);
@@ -0,0 +1,43 @@
+#pragma once
+#include <cglm/mat4.h>
+#include <cglm/quat.h>
+#include <cglm/vec3.h>
+#include <stddef.h>
+
+#define NO_PARENT ~0u
+
+//Nodes composed at once by compose_transforms
+#if defined(__AVX__)
+#define TRANSFORM_WIDTH 8
+#else
+#define TRANSFORM_WIDTH 4 //SSE, NEON
+#endif
+
+//Local transformations in structure of arrays layout
+struct Transforms {
+	unsigned count;
+	float* translation[3]; //x, y, z
+	float* rotation[4]; //Quaternion x, y, z, w
+	float* scaling[3]; //x, y, z
+};
+
+void create_transforms(const unsigned, struct Transforms* const);
+void destroy_transforms(struct Transforms* const);
+void transforms_set(struct Transforms* const, const unsigned, const vec3, const versor, const vec3);
+void transforms_get(const struct Transforms* const, const unsigned, vec3, versor, vec3);
+void compose_transforms(
+	const struct Transforms* const,
+	const unsigned* const,
+	const unsigned,
+	const unsigned,
+	void* const,
+	const size_t
+);
+void compose_transforms_scalar(
+	const struct Transforms* const,
+	const unsigned* const,
+	const unsigned,
+	const unsigned,
+	void* const,
+	const size_t
+);
@@ -0,0 +1,92 @@
+#pragma once
+#include "alloc.h"
+#include <stdbool.h>
+#include <vulkan/vulkan.h>
+
+//Stages that may read uploaded resources
+static const VkPipelineStageFlags2 UPLOAD_DST_STAGES = VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT
+	| VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT
+	| VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT
+	| VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT
+	| VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT; //Culling pass
+
+static const VkDeviceSize DEFAULT_STAGING_SIZE = 64 << 20;
+
+struct Upload {
+	uint64_t value; //Timeline value signaled on completion
+	VkCommandBuffer command_buffer;
+	VkDeviceSize staging_end; //Staging ring position after the submission's data
+};
+
+/*
+	Copies data to device resources on the transfer queue without blocking.
+	Each submission signals the next value of a timeline semaphore,
+	which consumers wait on at UPLOAD_DST_STAGES.
+	If the transfer queue family differs from the consumer's,
+	resources are released on submission & acquired by uploader_acquire.
+	Data passes through one persistently mapped staging ring.
+	Uploads larger than the free space are split into chunks,
+	waiting on the oldest submission whenever the ring is full.
+*/
+struct Uploader {
+	VkDevice device;
+	uint32_t queue_family;
+	uint32_t dst_queue_family; //Queue family using the uploaded resources
+	VkQueue queue;
+	VkExtent3D image_granularity; //Of the queue family's image copies
+	VkCommandPool command_pool;
+	VkCommandBuffer command_buffer; //Being recorded (VK_NULL_HANDLE if none)
+	//Staging ring
+	VkBuffer staging_buffer;
+	struct Allocation staging_alloc;
+	void* staging; //Mapped ring
+	VkDeviceSize staging_size;
+	VkDeviceSize staging_head, staging_tail; //Ever increasing; data in flight lies between them
+	//Timeline
+	VkSemaphore semaphore;
+	uint64_t value; //Signaled by the latest submission
+	//Submissions in flight
+	unsigned upload_count;
+	struct Upload* uploads;
+	//Ownership transfers awaiting acquisition
+	unsigned buffer_barrier_count;
+	VkBufferMemoryBarrier2* buffer_barriers;
+	unsigned image_barrier_count;
+	VkImageMemoryBarrier2* image_barriers;
+};
+
+VkResult create_uploader(
+	struct Allocator* const,
+	const uint32_t,
+	const uint32_t,
+	const VkDeviceSize,
+	struct Uploader* const
+);
+void destroy_uploader(struct Allocator* const, struct Uploader* const);
+uint64_t upload_buffers(
+	struct Uploader* const,
+	const unsigned,
+	const VkBuffer* const,
+	const void* const* const,
+	const VkDeviceSize* const
+);
+uint64_t upload_buffer_parts(
+	struct Uploader* const,
+	const unsigned,
+	const VkBuffer* const,
+	const unsigned* const,
+	const void* const* const,
+	const VkDeviceSize* const
+);
+uint64_t upload_images(
+	struct Uploader* const,
+	const unsigned,
+	const VkImage* const,
+	const VkExtent3D* const,
+	const void* const* const,
+	const VkDeviceSize* const,
+	const VkImageLayout
+);
+void uploader_acquire(struct Uploader* const, const VkCommandBuffer);
+void uploader_collect(struct Uploader* const);
+VkResult uploader_wait(struct Uploader* const, const uint64_t);
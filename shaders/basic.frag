@@ -2,7 +2,7 @@
 
 //Inputs
 layout(location=0) in vec2 in_tex;
-layout(location=1) out uint in_material;
+layout(location=1) flat in uint in_material;
 layout(location=2) in float in_shade;
 
 //Descriptors
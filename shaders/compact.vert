@@ -0,0 +1,67 @@
+#version 460
+
+//Inputs (compact layout)
+layout(location=0) in uvec4 in_position; //On the mesh's grid (w unused)
+layout(location=1) in vec2 in_normal; //Octahedral
+layout(location=2) in vec2 in_tex;
+
+//Node & material of a draw
+struct Draw {
+	uint node;
+	uint material;
+};
+
+//Position grid of a node's mesh
+struct Quantization {
+	vec4 offset;
+	vec4 scale;
+};
+
+//Descriptors
+layout(set=0, binding=0) uniform Uniforms {
+	mat4 view;
+	mat4 projection;
+};
+layout(set=0, binding=1) restrict readonly buffer NodeBuffer {
+	mat4 transformations[];
+};
+layout(set=0, binding=5) restrict readonly buffer QuantizationBuffer {
+	Quantization quantizations[];
+};
+layout(set=0, binding=6) restrict readonly buffer DrawBuffer {
+	Draw draws[];
+};
+layout(set=0, binding=7) restrict readonly buffer InstanceBuffer {
+	uint instances[]; //Draw of each instance
+};
+
+//Outputs
+layout(location=0) out vec2 out_tex;
+layout(location=1) flat out uint out_material;
+layout(location=2) out float out_shade;
+
+//Unit vector from its octahedral encoding
+vec3 decode_octahedral(const vec2 encoded) {
+	vec3 n = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+	const float fold = max(-n.z, 0.0); //Lower half
+	n.x += n.x >= 0.0 ? -fold : fold;
+	n.y += n.y >= 0.0 ? -fold : fold;
+	return normalize(n);
+}
+
+void main() {
+	const Draw draw = draws[instances[gl_InstanceIndex]];
+	const Quantization quantization = quantizations[draw.node];
+	const vec3 position = quantization.offset.xyz + vec3(in_position.xyz) * quantization.scale.xyz;
+	const vec4 pos = vec4(position, 1.0); //Model-space position
+	const vec4 world_pos = transformations[draw.node] * pos; //World-space position
+	const vec4 cam_pos = view * world_pos; //Camera-space position
+	const vec4 clip_pos = projection * cam_pos; //Clip-space position
+	gl_Position = clip_pos;
+	out_tex = in_tex;
+	out_material = draw.material;
+	//Shading
+	const vec4 eye = vec4(0.0, 0.0, 1.0, 0.0);
+	const vec4 n = view * transformations[draw.node] * vec4(decode_octahedral(in_normal), 0.0);
+	out_shade = dot(eye, n) / length(n);
+}
@@ -1,68 +1,429 @@
 #include "alloc.h"
+#include <limits.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
-//Note: Do not put buffers & images in the same allocation
-VkResult create_allocation(
+#define NO_RANGE UINT_MAX
+//Size classes: FL = power of two, SL = linear subdivision of it
+#define SL_BITS 4
+#define SL_COUNT (1 << SL_BITS)
+#define FL_COUNT 64
+#define MIN_RANGE_SIZE 16 //Range sizes & offsets are multiples of this
+#define SMALL_SIZE (MIN_RANGE_SIZE * SL_COUNT) //Sizes below share FL 0
+#define SMALL_LOG 8 //log2(SMALL_SIZE)
+#define MAX_BLOCK_SIZE ((VkDeviceSize) 256 << 20)
+
+struct MemoryBlock {
+	VkDeviceMemory memory; //VK_NULL_HANDLE if slot is unused
+	void* mapped;
+	VkDeviceSize size;
+	bool dedicated; //Holds one large allocation
+	unsigned used_count; //Allocated ranges
+};
+
+struct MemoryRange {
+	VkDeviceSize offset, size;
+	unsigned block;
+	unsigned prev, next; //Neighbours in block
+	unsigned prev_free, next_free; //Free list (next_free also links unused slots)
+	bool free;
+};
+
+struct MemoryPool {
+	uint32_t memory_type;
+	VkDeviceSize block_size;
+	unsigned block_count;
+	struct MemoryBlock* blocks;
+	unsigned empty_block; //Kept to avoid reallocating when usage oscillates
+	unsigned range_capacity;
+	struct MemoryRange* ranges;
+	unsigned unused_range;
+	//Free lists
+	uint64_t fl_bitmap;
+	uint32_t sl_bitmaps[FL_COUNT];
+	unsigned free_heads[FL_COUNT][SL_COUNT];
+};
+
+static void size_class(const VkDeviceSize size, unsigned* const fl, unsigned* const sl) {
+	if (size < SMALL_SIZE) {
+		*fl = 0;
+		*sl = size / MIN_RANGE_SIZE;
+	} else {
+		const unsigned log = 63 - __builtin_clzll(size);
+		*fl = log - SMALL_LOG + 1;
+		*sl = (size >> (log - SL_BITS)) & (SL_COUNT - 1);
+	}
+}
+
+static void insert_free(struct MemoryPool* const pool, const unsigned index) {
+	struct MemoryRange* const range = pool->ranges + index;
+	unsigned fl, sl;
+	size_class(range->size, &fl, &sl);
+	const unsigned head = pool->free_heads[fl][sl];
+	range->free = true;
+	range->prev_free = NO_RANGE;
+	range->next_free = head;
+	if (head != NO_RANGE) pool->ranges[head].prev_free = index;
+	pool->free_heads[fl][sl] = index;
+	pool->fl_bitmap |= (uint64_t) 1 << fl;
+	pool->sl_bitmaps[fl] |= 1u << sl;
+}
+
+static void remove_free(struct MemoryPool* const pool, const unsigned index) {
+	const struct MemoryRange range = pool->ranges[index];
+	if (range.prev_free != NO_RANGE) pool->ranges[range.prev_free].next_free = range.next_free;
+	if (range.next_free != NO_RANGE) pool->ranges[range.next_free].prev_free = range.prev_free;
+	unsigned fl, sl;
+	size_class(range.size, &fl, &sl);
+	if (pool->free_heads[fl][sl] == index) {
+		pool->free_heads[fl][sl] = range.next_free;
+		if (range.next_free == NO_RANGE) {
+			pool->sl_bitmaps[fl] &= ~(1u << sl);
+			if (!pool->sl_bitmaps[fl]) pool->fl_bitmap &= ~((uint64_t) 1 << fl);
+		}
+	}
+}
+
+//Good fit: first free range from the next size class up, so any range found is large enough
+static unsigned find_free(const struct MemoryPool* const pool, VkDeviceSize size) {
+	if (size >= SMALL_SIZE)
+		size += ((VkDeviceSize) 1 << (63 - __builtin_clzll(size) - SL_BITS)) - 1;
+	unsigned fl, sl;
+	size_class(size, &fl, &sl);
+	if (fl >= FL_COUNT) return NO_RANGE;
+	uint32_t sl_map = pool->sl_bitmaps[fl] & (~0u << sl);
+	if (!sl_map) {
+		const uint64_t fl_map = fl + 1 < FL_COUNT ? pool->fl_bitmap & (~(uint64_t) 0 << (fl + 1)) : 0;
+		if (!fl_map) return NO_RANGE;
+		fl = __builtin_ctzll(fl_map);
+		sl_map = pool->sl_bitmaps[fl];
+	}
+	return pool->free_heads[fl][__builtin_ctz(sl_map)];
+}
+
+static unsigned new_range(struct MemoryPool* const pool) {
+	if (pool->unused_range == NO_RANGE) {
+		//Grow range storage
+		const unsigned capacity = pool->range_capacity ? 2 * pool->range_capacity : 64;
+		pool->ranges = realloc(pool->ranges, capacity * sizeof(struct MemoryRange));
+		for (unsigned i = pool->range_capacity; i < capacity; ++i)
+			pool->ranges[i].next_free = i + 1 < capacity ? i + 1 : NO_RANGE;
+		pool->unused_range = pool->range_capacity;
+		pool->range_capacity = capacity;
+	}
+	const unsigned index = pool->unused_range;
+	pool->unused_range = pool->ranges[index].next_free;
+	return index;
+}
+
+static void delete_range(struct MemoryPool* const pool, const unsigned index) {
+	pool->ranges[index].next_free = pool->unused_range;
+	pool->unused_range = index;
+}
+
+//Split a range in two, returning the upper part
+static unsigned split_range(struct MemoryPool* const pool, const unsigned index, const VkDeviceSize size) {
+	const unsigned upper = new_range(pool);
+	struct MemoryRange* const ranges = pool->ranges;
+	ranges[upper] = (struct MemoryRange) {
+		ranges[index].offset + size,
+		ranges[index].size - size,
+		ranges[index].block,
+		index, ranges[index].next,
+		NO_RANGE, NO_RANGE,
+		false
+	};
+	if (ranges[index].next != NO_RANGE) ranges[ranges[index].next].prev = upper;
+	ranges[index].next = upper;
+	ranges[index].size = size;
+	return upper;
+}
+
+static VkResult add_block(
+	struct Allocator* const allocator,
+	struct MemoryPool* const pool,
+	const VkDeviceSize size,
+	const bool dedicated,
+	unsigned* const range) {
+	const VkMemoryAllocateInfo alloc_info = {
+		VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, NULL,
+		size,
+		pool->memory_type
+	};
+	struct MemoryBlock block = {VK_NULL_HANDLE, NULL, size, dedicated, 0};
+	VkResult result = vkAllocateMemory(allocator->device, &alloc_info, NULL, &block.memory);
+	if (result) return result;
+	const VkMemoryPropertyFlags flags
+		= allocator->memory_properties.memoryTypes[pool->memory_type].propertyFlags;
+	if (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+		result = vkMapMemory(allocator->device, block.memory, 0, VK_WHOLE_SIZE, 0, &block.mapped);
+		if (result) {
+			vkFreeMemory(allocator->device, block.memory, NULL);
+			return result;
+		}
+	}
+	++allocator->block_count;
+	//Find an unused slot
+	unsigned index = 0;
+	while (index < pool->block_count && pool->blocks[index].memory) ++index;
+	if (index == pool->block_count)
+		pool->blocks = realloc(pool->blocks, ++pool->block_count * sizeof(struct MemoryBlock));
+	pool->blocks[index] = block;
+	//One free range covering the block
+	*range = new_range(pool);
+	pool->ranges[*range] = (struct MemoryRange) {
+		0, size,
+		index,
+		NO_RANGE, NO_RANGE,
+		NO_RANGE, NO_RANGE,
+		false
+	};
+	insert_free(pool, *range);
+	return VK_SUCCESS;
+}
+
+static void free_block(struct Allocator* const allocator, struct MemoryPool* const pool, const unsigned index) {
+	vkFreeMemory(allocator->device, pool->blocks[index].memory, NULL);
+	pool->blocks[index].memory = VK_NULL_HANDLE;
+	--allocator->block_count;
+}
+
+//Take size bytes at the given alignment out of a free range
+static unsigned claim_range(
+	struct MemoryPool* const pool,
+	unsigned index,
+	const VkDeviceSize size,
+	const VkDeviceSize alignment) {
+	remove_free(pool, index);
+	//Leading padding stays free
+	const VkDeviceSize offset = pool->ranges[index].offset;
+	const VkDeviceSize padding = align_size(offset, alignment) - offset;
+	if (padding) {
+		const unsigned aligned = split_range(pool, index, padding);
+		insert_free(pool, index);
+		index = aligned;
+	}
+	//Trailing space stays free
+	if (pool->ranges[index].size > size)
+		insert_free(pool, split_range(pool, index, size));
+	pool->ranges[index].free = false;
+	const unsigned block = pool->ranges[index].block;
+	if (!pool->blocks[block].used_count++ && pool->empty_block == block)
+		pool->empty_block = NO_RANGE;
+	return index;
+}
+
+static void release_range(struct Allocator* const allocator, struct MemoryPool* const pool, unsigned index) {
+	struct MemoryRange* const ranges = pool->ranges;
+	const unsigned block = ranges[index].block;
+	//Merge with free neighbours
+	const unsigned next = ranges[index].next;
+	if (next != NO_RANGE && ranges[next].free) {
+		remove_free(pool, next);
+		ranges[index].size += ranges[next].size;
+		ranges[index].next = ranges[next].next;
+		if (ranges[next].next != NO_RANGE) ranges[ranges[next].next].prev = index;
+		delete_range(pool, next);
+	}
+	const unsigned prev = ranges[index].prev;
+	if (prev != NO_RANGE && ranges[prev].free) {
+		remove_free(pool, prev);
+		ranges[prev].size += ranges[index].size;
+		ranges[prev].next = ranges[index].next;
+		if (ranges[index].next != NO_RANGE) ranges[ranges[index].next].prev = prev;
+		delete_range(pool, index);
+		index = prev;
+	}
+	//Return empty blocks, keeping at most one
+	if (!--pool->blocks[block].used_count) {
+		if (pool->blocks[block].dedicated || pool->empty_block != NO_RANGE) {
+			delete_range(pool, index);
+			free_block(allocator, pool, block);
+			return;
+		}
+		pool->empty_block = block;
+	}
+	insert_free(pool, index);
+}
+
+static struct MemoryPool* get_pool(struct Allocator* const allocator, const unsigned index) {
+	if (allocator->pools[index]) return allocator->pools[index];
+	struct MemoryPool* const pool = calloc(1, sizeof(struct MemoryPool));
+	pool->memory_type = index / 2;
+	//Blocks are an eighth of small heaps (e.g. 256MiB BAR)
+	const VkMemoryType type = allocator->memory_properties.memoryTypes[pool->memory_type];
+	const VkDeviceSize heap_size = allocator->memory_properties.memoryHeaps[type.heapIndex].size;
+	pool->block_size = heap_size / 8 < MAX_BLOCK_SIZE ? align_size(heap_size / 8, MIN_RANGE_SIZE) : MAX_BLOCK_SIZE;
+	pool->empty_block = NO_RANGE;
+	pool->unused_range = NO_RANGE;
+	for (unsigned i = 0; i < FL_COUNT; ++i)
+		for (unsigned j = 0; j < SL_COUNT; ++j)
+			pool->free_heads[i][j] = NO_RANGE;
+	allocator->pools[index] = pool;
+	return pool;
+}
+
+VkResult create_allocator(
 	const VkPhysicalDevice physical_device,
 	const VkDevice device,
+	struct Allocator* const allocator) {
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physical_device, &properties);
+	*allocator = (struct Allocator) {
+		.physical_device = physical_device,
+		.device = device,
+		.buffer_image_granularity = properties.limits.bufferImageGranularity
+	};
+	vkGetPhysicalDeviceMemoryProperties(physical_device, &allocator->memory_properties);
+	allocator->pools = calloc(2 * allocator->memory_properties.memoryTypeCount, sizeof(struct MemoryPool*));
+	return VK_SUCCESS;
+}
+
+void destroy_allocator(struct Allocator* const allocator) {
+	for (unsigned i = 0; i < 2 * allocator->memory_properties.memoryTypeCount; ++i) {
+		struct MemoryPool* const pool = allocator->pools[i];
+		if (!pool) continue;
+		for (unsigned j = 0; j < pool->block_count; ++j)
+			if (pool->blocks[j].memory) free_block(allocator, pool, j);
+		free(pool->blocks);
+		free(pool->ranges);
+		free(pool);
+	}
+	free(allocator->pools);
+}
+
+//Cost of a memory type's properties beyond those requested
+static unsigned memory_type_cost(const VkMemoryPropertyFlags props, const VkMemoryPropertyFlags flags) {
+	const VkMemoryPropertyFlags extra = flags & ~props;
+	unsigned cost = 0;
+	if (extra & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) cost += 4; //Scarce (BAR) or slower for the device
+	if (extra & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) cost += 2; //Leave it to device resources
+	if (extra & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) cost += 1;
+	if (extra & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) cost += 1;
+	return cost;
+}
+
+//Find the cheapest memory type allowed by type_bits that has every requested property
+bool find_memory_type(
+	const struct Allocator* const allocator,
+	const uint32_t type_bits,
+	const VkMemoryPropertyFlags props,
+	uint32_t* const mem_type) {
+	const VkPhysicalDeviceMemoryProperties mem_props = allocator->memory_properties;
+	const VkMemoryPropertyFlags excluded = (
+		VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT
+		| VK_MEMORY_PROPERTY_PROTECTED_BIT
+		| VK_MEMORY_PROPERTY_DEVICE_COHERENT_BIT_AMD
+	) & ~props;
+	unsigned best_cost = UINT_MAX;
+	VkDeviceSize best_heap_size = 0;
+	for (unsigned i = 0; i < mem_props.memoryTypeCount; ++i) {
+		const VkMemoryType type = mem_props.memoryTypes[i];
+		const bool supported = (type_bits >> i) & 1;
+		const bool has_props = (props & type.propertyFlags) == props;
+		if (!supported || !has_props || type.propertyFlags & excluded) continue;
+		//Ties go to the larger heap
+		const unsigned cost = memory_type_cost(props, type.propertyFlags);
+		const VkDeviceSize heap_size = mem_props.memoryHeaps[type.heapIndex].size;
+		if (cost < best_cost || (cost == best_cost && heap_size > best_heap_size)) {
+			best_cost = cost;
+			best_heap_size = heap_size;
+			*mem_type = i;
+		}
+	}
+	return best_cost != UINT_MAX;
+}
+
+/*
+	Suballocate one range holding every resource.
+	optimal marks optimal-tiling images (NULL if there are none).
+*/
+VkResult create_allocation(
+	struct Allocator* const allocator,
 	const VkMemoryPropertyFlags props,
 	const unsigned count,
 	const VkMemoryRequirements* const reqs,
+	const bool* const optimal,
 	struct Allocation* const alloc) {
 	//Memory requirements
-	VkDeviceSize alloc_size = 0;
-	VkDeviceSize* offsets = malloc(count * sizeof(VkDeviceSize));
 	uint32_t supported_mem_types = 0xFFFFFFFF;
+	for (unsigned i = 0; i < count; ++i)
+		supported_mem_types &= reqs[i].memoryTypeBits;
+
+	//Find valid memory type
+	uint32_t mem_type;
+	if (!find_memory_type(allocator, supported_mem_types, props, &mem_type)) {
+		fprintf(stderr, "NO VALID MEMORY TYPE\n");
+		return VK_ERROR_UNKNOWN;
+	}
+
+	//Offsets (linear & optimal neighbours are kept a granularity page apart)
+	const VkDeviceSize granularity = allocator->buffer_image_granularity;
+	VkDeviceSize* const offsets = malloc(count * sizeof(VkDeviceSize));
+	VkDeviceSize alloc_size = 0, alloc_alignment = MIN_RANGE_SIZE;
+	bool has_linear = false, has_optimal = false;
 	for (unsigned i = 0; i < count; ++i) {
 		//Size & alignment
 		const VkMemoryRequirements req = reqs[i];
-		VkDeviceSize rem = alloc_size % req.alignment;
-		if (rem) alloc_size += req.alignment - rem;
+		const bool is_optimal = optimal && optimal[i];
+		VkDeviceSize alignment = req.alignment;
+		if (i && optimal && is_optimal != optimal[i - 1] && granularity > alignment)
+			alignment = granularity;
+		alloc_size = align_size(alloc_size, alignment);
 		offsets[i] = alloc_size;
 		alloc_size += req.size;
-		//Memory type
-		supported_mem_types &= reqs[i].memoryTypeBits;
+		if (req.alignment > alloc_alignment) alloc_alignment = req.alignment;
+		has_linear |= !is_optimal;
+		has_optimal |= is_optimal;
+	}
+	//Mixed ranges occupy whole pages
+	if (has_linear && has_optimal && granularity > 1) {
+		if (granularity > alloc_alignment) alloc_alignment = granularity;
+		alloc_size = align_size(alloc_size, granularity);
 	}
+	alloc_size = align_size(alloc_size ? alloc_size : 1, MIN_RANGE_SIZE);
 
-	//Find valid memory type
-	unsigned mem_type;
-	bool success = false;
-	VkPhysicalDeviceMemoryProperties mem_props;
-	vkGetPhysicalDeviceMemoryProperties(physical_device, &mem_props);
-	for (unsigned i = 0; i < mem_props.memoryTypeCount; ++i) {
-		VkMemoryType type = mem_props.memoryTypes[i];
-		bool supported = (supported_mem_types >> i) & 1;
-		bool has_props = props & type.propertyFlags;
-		if (supported && has_props) {
-			mem_type = i;
-			success = true;
-			break;
+	//Suballocation
+	const unsigned pool_index = 2 * mem_type + (granularity > 1 && has_optimal);
+	struct MemoryPool* const pool = get_pool(allocator, pool_index);
+	unsigned range;
+	if (alloc_size > pool->block_size / 2) {
+		//Large resources get a block of their own
+		VkResult result = add_block(allocator, pool, alloc_size, true, &range);
+		if (result) {
+			free(offsets);
+			return result;
+		}
+	} else {
+		range = find_free(pool, alloc_size + alloc_alignment - MIN_RANGE_SIZE);
+		if (range == NO_RANGE) {
+			VkResult result = add_block(allocator, pool, pool->block_size, false, &range);
+			if (result) {
+				free(offsets);
+				return result;
+			}
 		}
 	}
-	if (!success) {
-		fprintf(stderr, "NO VALID MEMORY TYPE\n");
-		return VK_ERROR_UNKNOWN;
-	}
-
-	//Allocation
+	range = claim_range(pool, range, alloc_size, alloc_alignment);
+	const VkDeviceSize range_offset = pool->ranges[range].offset;
+	for (unsigned i = 0; i < count; ++i)
+		offsets[i] += range_offset;
+	const struct MemoryBlock block = pool->blocks[pool->ranges[range].block];
 	*alloc = (struct Allocation) {
-		.count = count,
-		.offsets = offsets
-	};
-	VkMemoryAllocateInfo alloc_info = {
-		VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, NULL,
-		alloc_size,
-		mem_type
+		block.memory,
+		count,
+		offsets,
+		block.mapped,
+		pool_index,
+		range
 	};
-	VkResult result = vkAllocateMemory(device, &alloc_info, NULL, &alloc->memory);
-	return result;
+	return VK_SUCCESS;
 }
 
 VkResult create_buffers(
-	const VkPhysicalDevice physical_device,
-	const VkDevice device,
+	struct Allocator* const allocator,
 	const unsigned count,
 	const VkBufferCreateInfo* const create_infos,
 	const VkMemoryPropertyFlags props,
@@ -72,18 +433,19 @@ VkResult create_buffers(
 	//Create buffers
 	VkMemoryRequirements* const reqs = malloc(count * sizeof(VkMemoryRequirements));
 	for (unsigned i = 0; i < count; ++i) {
-		result = vkCreateBuffer(device, create_infos + i, NULL, buffers + i);
+		result = vkCreateBuffer(allocator->device, create_infos + i, NULL, buffers + i);
 		if (result) {
 			free(reqs);
 			return result;
 		}
-		vkGetBufferMemoryRequirements(device, buffers[i], reqs + i);
+		vkGetBufferMemoryRequirements(allocator->device, buffers[i], reqs + i);
 	}
 	//Allocate memory
 	result = create_allocation(
-		physical_device, device,
+		allocator,
 		props,
 		count, reqs,
+		NULL,
 		alloc
 	);
 	free(reqs);
@@ -97,14 +459,13 @@ VkResult create_buffers(
 			alloc->memory,
 			alloc->offsets[i]
 		};
-	result = vkBindBufferMemory2(device, count, bind_infos);
+	result = vkBindBufferMemory2(allocator->device, count, bind_infos);
 	free(bind_infos);
 	return result;
 }
 
 VkResult create_images(
-	const VkPhysicalDevice physical_device,
-	const VkDevice device,
+	struct Allocator* const allocator,
 	const unsigned count,
 	const VkImageCreateInfo* const create_infos,
 	const VkMemoryPropertyFlags props,
@@ -113,22 +474,27 @@ VkResult create_images(
 	VkResult result;
 	//Create images
 	VkMemoryRequirements* const reqs = malloc(count * sizeof(VkMemoryRequirements));
+	bool* const optimal = malloc(count * sizeof(bool));
 	for (unsigned i = 0; i < count; ++i) {
-		result = vkCreateImage(device, create_infos + i, NULL, images + i);
+		result = vkCreateImage(allocator->device, create_infos + i, NULL, images + i);
 		if (result) {
 			free(reqs);
+			free(optimal);
 			return result;
 		}
-		vkGetImageMemoryRequirements(device, images[i], reqs + i);
+		vkGetImageMemoryRequirements(allocator->device, images[i], reqs + i);
+		optimal[i] = create_infos[i].tiling != VK_IMAGE_TILING_LINEAR;
 	}
 	//Allocate memory
 	result = create_allocation(
-		physical_device, device,
+		allocator,
 		props,
 		count, reqs,
+		optimal,
 		alloc
 	);
 	free(reqs);
+	free(optimal);
 	if (result) return result;
 	//Bind images to memory
 	VkBindImageMemoryInfo* const bind_infos = malloc(count * sizeof(VkBindImageMemoryInfo));
@@ -139,12 +505,104 @@ VkResult create_images(
 			alloc->memory,
 			alloc->offsets[i]
 		};
-	result = vkBindImageMemory2(device, count, bind_infos);
+	result = vkBindImageMemory2(allocator->device, count, bind_infos);
 	free(bind_infos);
 	return result;
 }
 
-void free_allocation(VkDevice device, struct Allocation alloc) {
-	vkFreeMemory(device, alloc.memory, NULL);
+void free_allocation(struct Allocator* const allocator, struct Allocation alloc) {
+	release_range(allocator, allocator->pools[alloc.pool], alloc.range);
 	free(alloc.offsets);
 }
+
+//Bind memory aligned for host access through the mapping
+static VkResult bind_ring_buffer(
+	struct Allocator* const allocator,
+	const VkBuffer buffer,
+	const VkMemoryPropertyFlags props,
+	const VkDeviceSize alignment,
+	struct Allocation* const alloc) {
+	VkMemoryRequirements req;
+	vkGetBufferMemoryRequirements(allocator->device, buffer, &req);
+	if (alignment > req.alignment) req.alignment = alignment;
+	const VkResult result = create_allocation(allocator, props, 1, &req, NULL, alloc);
+	if (result) return result;
+	return vkBindBufferMemory(allocator->device, buffer, alloc->memory, alloc->offsets[0]);
+}
+
+VkResult create_frame_ring(
+	struct Allocator* const allocator,
+	const unsigned frame_count,
+	const VkDeviceSize frame_size,
+	const VkBufferUsageFlags usage,
+	struct FrameRing* const ring) {
+	//Frame regions keep the mapping's alignment & are valid descriptor offsets
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(allocator->physical_device, &properties);
+	const VkPhysicalDeviceLimits limits = properties.limits;
+	VkDeviceSize alignment = limits.minMemoryMapAlignment;
+	if (limits.minUniformBufferOffsetAlignment > alignment)
+		alignment = limits.minUniformBufferOffsetAlignment;
+	if (limits.minStorageBufferOffsetAlignment > alignment)
+		alignment = limits.minStorageBufferOffsetAlignment;
+	if (limits.nonCoherentAtomSize > alignment)
+		alignment = limits.nonCoherentAtomSize;
+	*ring = (struct FrameRing) {
+		.frame_count = frame_count,
+		.frame_size = align_size(frame_size, alignment)
+	};
+	//Device buffer
+	VkBufferCreateInfo buffer_info = {
+		VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, NULL, 0,
+		frame_count * ring->frame_size,
+		usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_SHARING_MODE_EXCLUSIVE,
+		0, NULL
+	};
+	VkResult result = vkCreateBuffer(allocator->device, &buffer_info, NULL, &ring->buffer);
+	if (result) return result;
+	VkMemoryRequirements req;
+	vkGetBufferMemoryRequirements(allocator->device, ring->buffer, &req);
+	//Prefer device-local memory the host can write directly (ReBAR/UMA)
+	const VkMemoryPropertyFlags direct_props = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+		| VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+		| VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	uint32_t mem_type;
+	const bool direct = find_memory_type(allocator, req.memoryTypeBits, direct_props, &mem_type);
+	result = bind_ring_buffer(
+		allocator,
+		ring->buffer,
+		direct ? direct_props : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		alignment,
+		&ring->alloc
+	);
+	if (result) return result;
+	if (direct) {
+		ring->mapped = ring->alloc.mapped + ring->alloc.offsets[0];
+		return VK_SUCCESS;
+	}
+	//Fallback: write to a host-visible copy & transfer each frame
+	buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	result = vkCreateBuffer(allocator->device, &buffer_info, NULL, &ring->staging_buffer);
+	if (result) return result;
+	result = bind_ring_buffer(
+		allocator,
+		ring->staging_buffer,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+		| VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		alignment,
+		&ring->staging_alloc
+	);
+	if (result) return result;
+	ring->mapped = ring->staging_alloc.mapped + ring->staging_alloc.offsets[0];
+	return VK_SUCCESS;
+}
+
+void destroy_frame_ring(struct Allocator* const allocator, struct FrameRing ring) {
+	if (ring.staging_buffer) {
+		vkDestroyBuffer(allocator->device, ring.staging_buffer, NULL);
+		free_allocation(allocator, ring.staging_alloc);
+	}
+	vkDestroyBuffer(allocator->device, ring.buffer, NULL);
+	free_allocation(allocator, ring.alloc);
+}
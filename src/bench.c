@@ -0,0 +1,658 @@
+#include "package.h"
+#include "renderer.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <SDL2/SDL.h>
+
+#define NANO 1000000000
+#define WARMUP_FRAMES 16
+
+struct Benchmark {
+	const char* name;
+	const char* usage;
+	int (*run)(int, char**);
+};
+
+static double seconds() {
+	struct timespec now;
+	timespec_get(&now, TIME_UTC);
+	return now.tv_sec + (double) now.tv_nsec / NANO;
+}
+
+static SDL_Window* create_window() {
+	if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+		fprintf(stderr, "Error initializing SDL: %s\n", SDL_GetError());
+		return NULL;
+	}
+	if (!IMG_Init(IMG_INIT_JPG | IMG_INIT_PNG)) {
+		fprintf(stderr, "Error initializing SDL_image\n");
+		return NULL;
+	}
+	SDL_Window* window = SDL_CreateWindow(
+		"Lightrail benchmark",
+		SDL_WINDOWPOS_UNDEFINED,
+		SDL_WINDOWPOS_UNDEFINED,
+		128, 128,
+		SDL_WINDOW_VULKAN|SDL_WINDOW_SHOWN
+	);
+	if (!window) fprintf(stderr, "Error creating window: %s\n", SDL_GetError());
+	return window;
+}
+
+static void destroy_window(SDL_Window* window) {
+	IMG_Quit();
+	SDL_DestroyWindow(window);
+	SDL_Quit();
+}
+
+//Returns the GPU time of the frames completed meanwhile
+static double render_frames(struct Renderer* const renderer, struct Scene scene, unsigned count) {
+	const struct Camera camera = create_camera();
+	SDL_Event event;
+	double gpu_time = 0;
+	for (unsigned i = 0; i < count; ++i) {
+		while (SDL_PollEvent(&event));
+		renderer_update_camera(renderer, camera);
+		renderer_update_nodes(renderer, &scene);
+		renderer_draw(renderer);
+		gpu_time += renderer->stats.gpu_time;
+	}
+	return gpu_time;
+}
+
+//Timing of a renderer variant
+struct Timing {
+	double load_time; //Seconds to load the scene into the renderer
+	double frame_time, gpu_time; //Seconds per frame
+	struct RenderStats stats; //Of the last frame (static camera: the same every frame)
+};
+
+/*
+	Time frames of a scene after warming up, on a renderer with frame_count frames in flight.
+	configure sets the renderer up before the scene is loaded,
+	& inspect reads it before it's destroyed, if they aren't NULL.
+	Returns true if the renderer couldn't be created.
+*/
+static bool time_renderer(
+	SDL_Window* const window,
+	const unsigned frame_count,
+	const struct Scene scene,
+	const unsigned frames,
+	void (*const configure)(struct Renderer* const, void* const),
+	void (*const inspect)(struct Renderer* const, void* const),
+	void* const context,
+	struct Timing* const result) {
+	if (!frames) {
+		fprintf(stderr, "Error: no frames to time!\n");
+		return true;
+	}
+	struct Renderer renderer;
+	if (create_renderer(window, frame_count, &renderer)) return true;
+	if (configure) configure(&renderer, context);
+	const double load_start = seconds();
+	renderer_load_scene(&renderer, scene);
+	result->load_time = seconds() - load_start;
+	render_frames(&renderer, scene, WARMUP_FRAMES);
+	vkDeviceWaitIdle(renderer.device);
+	const double start = seconds();
+	result->gpu_time = render_frames(&renderer, scene, frames) / frames;
+	vkDeviceWaitIdle(renderer.device);
+	result->frame_time = (seconds() - start) / frames;
+	result->stats = renderer.stats;
+	if (inspect) inspect(&renderer, context);
+	destroy_renderer(renderer);
+	return false;
+}
+
+//Frame throughput against the number of frames in flight
+static int bench_frames(int argc, char** argv) {
+	const char* const filename = argc > 0 ? argv[0] : "BarramundiFish.glb";
+	const unsigned frames = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000;
+	const unsigned max_frame_count = argc > 2 ? strtoul(argv[2], NULL, 10) : 3;
+	SDL_Window* const window = create_window();
+	if (!window) return 1;
+	struct Scene scene;
+	if (load_scene_file(filename, NULL, NULL, &scene)) {
+		fprintf(stderr, "Error loading scene %s\n", filename);
+		destroy_window(window);
+		return 1;
+	}
+	printf("frames_in_flight\tms_per_frame\tframes_per_second\n");
+	double baseline = 0;
+	for (unsigned frame_count = 1; frame_count <= max_frame_count; ++frame_count) {
+		struct Timing timing;
+		if (time_renderer(window, frame_count, scene, frames, NULL, NULL, NULL, &timing)) break;
+		const double fps = 1 / timing.frame_time;
+		if (frame_count == 1) baseline = fps;
+		printf("%u\t%.3f\t%.1f (%.2fx)\n", frame_count, 1000 * timing.frame_time, fps, fps / baseline);
+	}
+	destroy_scene(scene);
+	destroy_window(window);
+	return 0;
+}
+
+//Scene load time against the number of texture decoding threads
+static int bench_load(int argc, char** argv) {
+	const char* const filename = argc > 0 ? argv[0] : "BarramundiFish.glb";
+	const unsigned max_thread_count = argc > 1 ? strtoul(argv[1], NULL, 10) : SDL_GetCPUCount();
+	const unsigned repeats = argc > 2 ? strtoul(argv[2], NULL, 10) : 5;
+	if (SDL_Init(0) < 0) {
+		fprintf(stderr, "Error initializing SDL: %s\n", SDL_GetError());
+		return 1;
+	}
+	if (!IMG_Init(IMG_INIT_JPG | IMG_INIT_PNG)) {
+		fprintf(stderr, "Error initializing SDL_image\n");
+		SDL_Quit();
+		return 1;
+	}
+	printf("threads\tms_per_load\n");
+	double baseline = 0;
+	for (unsigned thread_count = 1; thread_count <= max_thread_count; ++thread_count) {
+		struct JobSystem jobs;
+		if (create_job_system(thread_count, &jobs)) break;
+		double best = 0;
+		for (unsigned i = 0; i < repeats; ++i) {
+			struct Scene scene;
+			const double start = seconds();
+			const bool error = load_scene_file(filename, &jobs, NULL, &scene);
+			const double elapsed = seconds() - start;
+			if (error) {
+				fprintf(stderr, "Error loading scene %s\n", filename);
+				destroy_job_system(&jobs);
+				IMG_Quit();
+				SDL_Quit();
+				return 1;
+			}
+			destroy_scene(scene);
+			if (!i || elapsed < best) best = elapsed;
+		}
+		destroy_job_system(&jobs);
+		if (thread_count == 1) baseline = best;
+		printf("%u\t%.3f (%.2fx)\n", thread_count, 1000 * best, baseline / best);
+	}
+	IMG_Quit();
+	SDL_Quit();
+	return 0;
+}
+
+//Uniform random number in [min, max)
+static float random_float(const float min, const float max) {
+	return min + (max - min) * rand() / ((float) RAND_MAX + 1);
+}
+
+//Batched against scalar transformation composition, on a synthetic 8-ary hierarchy
+static int bench_transforms(int argc, char** argv) {
+	const unsigned count = argc > 0 ? strtoul(argv[0], NULL, 10) : 1 << 20;
+	const unsigned repeats = argc > 1 ? strtoul(argv[1], NULL, 10) : 20;
+	struct Transforms transforms;
+	create_transforms(count, &transforms);
+	unsigned* const parents = malloc(count * sizeof(unsigned));
+	srand(1);
+	for (unsigned i = 0; i < count; ++i) {
+		parents[i] = i ? (i - 1) / 8 : NO_PARENT;
+		const vec3 translation = {random_float(-1, 1), random_float(-1, 1), random_float(-1, 1)};
+		versor rotation = {random_float(-1, 1), random_float(-1, 1), random_float(-1, 1), random_float(-1, 1)};
+		glm_quat_normalize(rotation);
+		const vec3 scaling = {random_float(0.5, 2), random_float(0.5, 2), random_float(0.5, 2)};
+		transforms_set(&transforms, i, translation, rotation, scaling);
+	}
+	mat4* const scalar_worlds = malloc(count * sizeof(mat4));
+	mat4* const batch_worlds = malloc(count * sizeof(mat4));
+	//Best of repeats
+	double scalar_time = 0, batch_time = 0;
+	for (unsigned i = 0; i < repeats; ++i) {
+		double start = seconds();
+		compose_transforms_scalar(&transforms, parents, 0, count, scalar_worlds, sizeof(mat4));
+		double elapsed = seconds() - start;
+		if (!i || elapsed < scalar_time) scalar_time = elapsed;
+		start = seconds();
+		compose_transforms(&transforms, parents, 0, count, batch_worlds, sizeof(mat4));
+		elapsed = seconds() - start;
+		if (!i || elapsed < batch_time) batch_time = elapsed;
+	}
+	//Largest relative difference
+	float difference = 0;
+	for (unsigned i = 0; i < count; ++i)
+		for (unsigned c = 0; c < 4; ++c)
+			for (unsigned r = 0; r < 4; ++r) {
+				const float d = fabsf(batch_worlds[i][c][r] - scalar_worlds[i][c][r])
+					/ (1 + fabsf(scalar_worlds[i][c][r]));
+				if (d > difference) difference = d;
+			}
+	printf("kernel\tns_per_node\n");
+	printf("scalar\t%.2f\n", 1e9 * scalar_time / count);
+	printf("batch (%u wide)\t%.2f (%.2fx)\n", TRANSFORM_WIDTH, 1e9 * batch_time / count, scalar_time / batch_time);
+	printf("max relative difference: %g\n", difference);
+	free(batch_worlds);
+	free(scalar_worlds);
+	free(parents);
+	destroy_transforms(&transforms);
+	return 0;
+}
+
+//Synthetic scene of a 4-ary node hierarchy with random local transformations
+static struct Scene create_hierarchy(const unsigned count) {
+	struct Scene scene = {0, NULL, count, malloc(count * sizeof(struct Node)), 0, NULL, 0, NULL};
+	create_transforms(count, &scene.transforms);
+	srand(1);
+	for (unsigned i = 0; i < count; ++i) {
+		const unsigned first_child = 4 * i + 1;
+		const unsigned child_count = first_child >= count ? 0
+			: count - first_child < 4 ? count - first_child : 4;
+		scene.nodes[i] = (struct Node) {child_count, malloc(child_count * sizeof(unsigned)), false, 0, true, true, false};
+		for (unsigned j = 0; j < child_count; ++j)
+			scene.nodes[i].children[j] = first_child + j;
+		const vec3 translation = {random_float(-1, 1), random_float(-1, 1), random_float(-1, 1)};
+		versor rotation = {random_float(-1, 1), random_float(-1, 1), random_float(-1, 1), random_float(-1, 1)};
+		glm_quat_normalize(rotation);
+		const vec3 scaling = {random_float(0.5, 2), random_float(0.5, 2), random_float(0.5, 2)};
+		transforms_set(&scene.transforms, i, translation, rotation, scaling);
+	}
+	scene_flatten(&scene);
+	return scene;
+}
+
+//Whole hierarchy update time against the number of threads
+static int bench_hierarchy(int argc, char** argv) {
+	const unsigned count = argc > 0 ? strtoul(argv[0], NULL, 10) : 1 << 20;
+	const unsigned max_thread_count = argc > 1 ? strtoul(argv[1], NULL, 10) : SDL_GetCPUCount();
+	const unsigned repeats = argc > 2 ? strtoul(argv[2], NULL, 10) : 20;
+	struct Scene scene = create_hierarchy(count);
+	mat4* const reference = malloc(count * sizeof(mat4));
+	printf("threads\tms_per_update\tidentical\n");
+	double baseline = 0;
+	for (unsigned thread_count = 1; thread_count <= max_thread_count; ++thread_count) {
+		struct JobSystem jobs;
+		if (create_job_system(thread_count, &jobs)) break;
+		double best = 0;
+		for (unsigned i = 0; i < repeats; ++i) {
+			scene_invalidate_node(&scene, 0);
+			const double start = seconds();
+			scene_update_transformations(&scene, &jobs);
+			const double elapsed = seconds() - start;
+			if (!i || elapsed < best) best = elapsed;
+		}
+		destroy_job_system(&jobs);
+		//Compare with the single threaded results
+		bool identical = true;
+		for (unsigned i = 0; i < count; ++i) {
+			if (thread_count == 1) glm_mat4_copy(scene.nodes[i].transformation, reference[i]);
+			else if (memcmp(scene.nodes[i].transformation, reference[i], sizeof(mat4))) identical = false;
+		}
+		if (thread_count == 1) baseline = best;
+		printf("%u\t%.3f (%.2fx)\t%s\n", thread_count, 1000 * best, baseline / best, identical ? "yes" : "no");
+	}
+	free(reference);
+	destroy_scene(scene);
+	return 0;
+}
+
+//Scene of count nodes scattered around the default camera, each drawing one of base's meshes
+static struct Scene create_city(const struct Scene base, const unsigned count, const float size) {
+	struct Scene scene = {
+		base.mesh_count, base.meshes,
+		count, malloc(count * sizeof(struct Node)),
+		base.material_count, base.materials,
+		base.texture_count, base.textures
+	};
+	create_transforms(count, &scene.transforms);
+	srand(1);
+	for (unsigned i = 0; i < count; ++i) {
+		const unsigned mesh = base.mesh_count ? i % base.mesh_count : 0;
+		scene.nodes[i] = (struct Node) {0, NULL, base.mesh_count > 0, mesh, false, true, false};
+		const vec3 translation = {random_float(-size, size), random_float(-size, size), random_float(-1, 1)};
+		const versor rotation = {0, 0, 0, 1};
+		const vec3 scaling = {1, 1, 1};
+		transforms_set(&scene.transforms, i, translation, rotation, scaling);
+	}
+	scene_flatten(&scene);
+	return scene;
+}
+
+//Free what create_city allocated (meshes, materials & textures belong to the base scene)
+static void destroy_city(struct Scene scene) {
+	free(scene.nodes);
+	free(scene.parents);
+	free(scene.subtree_ends);
+	destroy_transforms(&scene.transforms);
+	free(scene.invalid_nodes);
+	free(scene.tasks);
+}
+
+//Load a scene file & build a city of its meshes in a new window
+static bool open_city(
+	const char* const filename,
+	const unsigned count,
+	const float size,
+	SDL_Window** const window,
+	struct Scene* const base,
+	struct Scene* const city) {
+	*window = create_window();
+	if (!*window) return true;
+	if (load_scene_file(filename, NULL, NULL, base)) {
+		fprintf(stderr, "Error loading scene %s\n", filename);
+		destroy_window(*window);
+		return true;
+	}
+	*city = create_city(*base, count, size);
+	return false;
+}
+
+static void close_city(SDL_Window* const window, struct Scene base, struct Scene city) {
+	destroy_city(city);
+	destroy_scene(base);
+	destroy_window(window);
+}
+
+struct CullingVariant {
+	enum Culling culling;
+	float lod_threshold;
+	struct JobSystem* jobs; //Of CPU culling
+	unsigned visible_count; //Nodes in the frustum
+};
+
+static void configure_culling(struct Renderer* const renderer, void* const context) {
+	const struct CullingVariant* const variant = context;
+	renderer->culling = variant->culling;
+	renderer->lod_threshold = variant->lod_threshold;
+	renderer->jobs = variant->jobs;
+}
+
+static void count_visible_nodes(struct Renderer* const renderer, void* const context) {
+	struct CullingVariant* const variant = context;
+	variant->visible_count = cull_bvh(&renderer->bvh, (const vec4*) renderer->frustum, renderer->visible_nodes);
+}
+
+//Frame time of each culling method, on many copies of a scene's meshes around the camera
+static int bench_culling(int argc, char** argv) {
+	const char* const filename = argc > 0 ? argv[0] : "BarramundiFish.glb";
+	const unsigned count = argc > 1 ? strtoul(argv[1], NULL, 10) : 1 << 16;
+	const unsigned frames = argc > 2 ? strtoul(argv[2], NULL, 10) : 500;
+	const float size = argc > 3 ? strtof(argv[3], NULL) : 256;
+	const float lod_threshold = argc > 4 ? strtof(argv[4], NULL) : DEFAULT_LOD_THRESHOLD; //0 for full detail
+	const unsigned thread_count = argc > 5 ? strtoul(argv[5], NULL, 10) : 0; //Of CPU culling (0 for every CPU)
+	struct JobSystem jobs;
+	if (create_job_system(thread_count, &jobs)) return 1;
+	SDL_Window* window;
+	struct Scene base, scene;
+	if (open_city(filename, count, size, &window, &base, &scene)) {
+		destroy_job_system(&jobs);
+		return 1;
+	}
+	const char* const names[] = {"none", "cpu", "gpu", "occlusion", "software", "meshlet"};
+	printf("culling\tms_per_frame\tframes_per_second\tgpu_ms\tdraws\tfrustum_culled\toccluded\tcluster_culled\tculled_triangles\ttriangles\n");
+	double baseline = 0, frustum_gpu_time = 0;
+	struct CullingVariant variant = {CULLING_NONE, lod_threshold, &jobs, 0};
+	for (enum Culling culling = CULLING_NONE; culling <= CULLING_MESHLET; ++culling) {
+		variant.culling = culling;
+		struct Timing timing;
+		if (time_renderer(
+			window, DEFAULT_FRAME_COUNT, scene, frames,
+			configure_culling, culling == CULLING_NONE ? count_visible_nodes : NULL, &variant,
+			&timing
+		)) break;
+		const double fps = 1 / timing.frame_time;
+		if (culling == CULLING_NONE) baseline = fps;
+		if (culling == CULLING_GPU) frustum_gpu_time = timing.gpu_time;
+		printf(
+			"%s\t%.3f\t%.1f (%.2fx)\t%.3f",
+			names[culling],
+			1000 * timing.frame_time,
+			fps, fps / baseline,
+			1000 * timing.gpu_time
+		);
+		//GPU time saved by occlusion or meshlet culling over frustum culling alone
+		if (culling == CULLING_OCCLUSION || culling == CULLING_MESHLET) printf(" (%+.3f)", 1000 * (timing.gpu_time - frustum_gpu_time));
+		printf(
+			"\t%u\t%u\t%u\t%u\t%u\t%u\n",
+			timing.stats.draw_count,
+			timing.stats.frustum_culled_count,
+			timing.stats.occlusion_culled_count,
+			timing.stats.cluster_culled_count,
+			timing.stats.culled_triangle_count,
+			timing.stats.triangle_count
+		);
+	}
+	printf("visible nodes: %u of %u\n", variant.visible_count, count);
+	close_city(window, base, scene);
+	destroy_job_system(&jobs);
+	return 0;
+}
+
+//Frame time, frame rate & GPU time, relative to a baseline
+static void print_timing(const struct Timing timing, const struct Timing baseline) {
+	printf(
+		"%.3f\t%.1f (%.2fx)\t%.3f (%+.3f)",
+		1000 * timing.frame_time,
+		1 / timing.frame_time, baseline.frame_time / timing.frame_time,
+		1000 * timing.gpu_time, 1000 * (timing.gpu_time - baseline.gpu_time)
+	);
+}
+
+struct VertexVariant {
+	bool compact;
+	VkIndexType index_type;
+};
+
+static void configure_vertices(struct Renderer* const renderer, void* const context) {
+	renderer->lod_threshold = 0;
+	renderer->compact_vertices = ((const struct VertexVariant*) context)->compact;
+}
+
+static void read_index_type(struct Renderer* const renderer, void* const context) {
+	((struct VertexVariant*) context)->index_type = renderer->index_type;
+}
+
+//Frame time of a city of nodes with the full & compact vertex layouts (GPU culling, full detail)
+static int bench_vertices(int argc, char** argv) {
+	const char* const filename = argc > 0 ? argv[0] : "BarramundiFish.glb";
+	const unsigned count = argc > 1 ? strtoul(argv[1], NULL, 10) : 1 << 16;
+	const unsigned frames = argc > 2 ? strtoul(argv[2], NULL, 10) : 500;
+	const float size = argc > 3 ? strtof(argv[3], NULL) : 256;
+	SDL_Window* window;
+	struct Scene base, scene;
+	if (open_city(filename, count, size, &window, &base, &scene)) return 1;
+	unsigned vertex_count = 0, index_count = 0;
+	for (unsigned i = 0; i < scene.mesh_count; ++i) {
+		for (unsigned j = 0; j < scene.meshes[i].primitive_count; ++j) {
+			vertex_count += scene.meshes[i].primitives[j].vertex_count;
+			index_count += scene.meshes[i].primitives[j].index_count;
+		}
+	}
+	printf("layout\tms_per_frame\tframes_per_second\tgpu_ms\tvertex_bytes\tindex_bytes\n");
+	struct Timing baseline;
+	for (unsigned compact = 0; compact < 2; ++compact) {
+		struct VertexVariant variant = {compact};
+		struct Timing timing;
+		if (time_renderer(window, DEFAULT_FRAME_COUNT, scene, frames, configure_vertices, read_index_type, &variant, &timing)) break;
+		if (!compact) baseline = timing;
+		printf("%s\t", compact ? "compact" : "full");
+		print_timing(timing, baseline);
+		printf(
+			"\t%zu\t%zu\n",
+			vertex_count * (compact ? sizeof(struct CompactVertex) : sizeof(struct Vertex)),
+			index_count * (variant.index_type == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(unsigned))
+		);
+	}
+	close_city(window, base, scene);
+	return 0;
+}
+
+struct InstancingVariant {
+	enum Culling culling;
+	float lod_threshold;
+	bool instancing;
+};
+
+static void configure_instancing(struct Renderer* const renderer, void* const context) {
+	const struct InstancingVariant* const variant = context;
+	renderer->culling = variant->culling;
+	renderer->lod_threshold = variant->lod_threshold;
+	renderer->instancing = variant->instancing;
+}
+
+//Frame time of a city of nodes sharing meshes, with & without instancing (without culling, with CPU & GPU culling)
+static int bench_instancing(int argc, char** argv) {
+	const char* const filename = argc > 0 ? argv[0] : "BarramundiFish.glb";
+	const unsigned count = argc > 1 ? strtoul(argv[1], NULL, 10) : 1 << 16;
+	const unsigned frames = argc > 2 ? strtoul(argv[2], NULL, 10) : 500;
+	const float size = argc > 3 ? strtof(argv[3], NULL) : 256;
+	const float lod_threshold = argc > 4 ? strtof(argv[4], NULL) : DEFAULT_LOD_THRESHOLD; //0 for full detail
+	SDL_Window* window;
+	struct Scene base, scene;
+	if (open_city(filename, count, size, &window, &base, &scene)) return 1;
+	const enum Culling cullings[] = {CULLING_NONE, CULLING_CPU, CULLING_GPU, CULLING_OCCLUSION, CULLING_MESHLET};
+	const char* const names[] = {"none", "cpu", "gpu", "occlusion", "meshlet"};
+	printf("culling\tinstancing\tms_per_frame\tframes_per_second\tgpu_ms\tdraws\tcommands\n");
+	for (unsigned i = 0; i < 5; ++i) {
+		struct Timing baseline;
+		for (unsigned instancing = 0; instancing < 2; ++instancing) {
+			struct InstancingVariant variant = {cullings[i], lod_threshold, instancing};
+			struct Timing timing;
+			if (time_renderer(window, DEFAULT_FRAME_COUNT, scene, frames, configure_instancing, NULL, &variant, &timing)) break;
+			if (!instancing) baseline = timing;
+			printf("%s\t%s\t", names[i], instancing ? "on" : "off");
+			print_timing(timing, baseline);
+			printf("\t%u\t%u\n", timing.stats.draw_count, timing.stats.command_count);
+		}
+	}
+	close_city(window, base, scene);
+	return 0;
+}
+
+static void configure_full_detail(struct Renderer* const renderer, void* const context) {
+	renderer->lod_threshold = 0;
+}
+
+//Vertex cache statistics & frame time of a city of nodes, before & after optimizing the scene's primitives (GPU culling, full detail)
+static int bench_optimize(int argc, char** argv) {
+	const char* const filename = argc > 0 ? argv[0] : "BarramundiFish.glb";
+	const unsigned count = argc > 1 ? strtoul(argv[1], NULL, 10) : 1 << 16;
+	const unsigned frames = argc > 2 ? strtoul(argv[2], NULL, 10) : 500;
+	const float size = argc > 3 ? strtof(argv[3], NULL) : 256;
+	SDL_Window* const window = create_window();
+	if (!window) return 1;
+	struct OptimizationStats stats = {};
+	double load_times[2];
+	struct Timing timings[2];
+	unsigned run_count = 0;
+	for (unsigned optimize = 0; optimize < 2; ++optimize) {
+		struct Scene base;
+		const double load_start = seconds();
+		const bool load_error = load_scene(filename, NULL, optimize ? &stats : NULL, &base);
+		load_times[optimize] = seconds() - load_start;
+		if (load_error) {
+			fprintf(stderr, "Error loading scene %s\n", filename);
+			destroy_window(window);
+			return 1;
+		}
+		struct Scene scene = create_city(base, count, size);
+		const bool renderer_error = time_renderer(
+			window, DEFAULT_FRAME_COUNT, scene, frames,
+			configure_full_detail, NULL, NULL,
+			timings + optimize
+		);
+		destroy_city(scene);
+		destroy_scene(base);
+		if (renderer_error) break;
+		++run_count;
+	}
+	//The original primitives' statistics are of the optimized load, before optimization (against unique vertices)
+	printf("primitives\tload_ms\tacmr\tatvr\tms_per_frame\tframes_per_second\tgpu_ms\n");
+	for (unsigned optimize = 0; optimize < run_count; ++optimize) {
+		const struct CacheStats cache = optimize ? stats.after : stats.before;
+		printf(
+			"%s\t%.3f\t",
+			optimize ? "optimized" : "original",
+			1000 * load_times[optimize]
+		);
+		if (run_count == 2) printf("%.3f\t%.3f\t", cache_acmr(cache), cache_atvr(cache));
+		else printf("-\t-\t");
+		print_timing(timings[optimize], timings[0]);
+		printf("\n");
+	}
+	destroy_window(window);
+	return 0;
+}
+
+struct BatchingVariant {
+	enum Culling culling;
+	float lod_threshold;
+	bool batching;
+	VkDeviceSize node_size; //Of a frame region's nodes
+};
+
+static void configure_batching(struct Renderer* const renderer, void* const context) {
+	const struct BatchingVariant* const variant = context;
+	renderer->culling = variant->culling;
+	renderer->lod_threshold = variant->lod_threshold;
+	renderer->static_batching = variant->batching;
+}
+
+static void read_node_size(struct Renderer* const renderer, void* const context) {
+	((struct BatchingVariant*) context)->node_size = renderer->storage_size;
+}
+
+//Frame time of a city of static nodes, with & without static batching (without culling & with GPU culling)
+static int bench_batching(int argc, char** argv) {
+	const char* const filename = argc > 0 ? argv[0] : "BarramundiFish.glb";
+	const unsigned count = argc > 1 ? strtoul(argv[1], NULL, 10) : 1 << 14;
+	const unsigned frames = argc > 2 ? strtoul(argv[2], NULL, 10) : 500;
+	const float size = argc > 3 ? strtof(argv[3], NULL) : 256;
+	const float lod_threshold = argc > 4 ? strtof(argv[4], NULL) : DEFAULT_LOD_THRESHOLD; //0 for full detail
+	SDL_Window* window;
+	struct Scene base, scene;
+	if (open_city(filename, count, size, &window, &base, &scene)) return 1;
+	const enum Culling cullings[] = {CULLING_NONE, CULLING_GPU};
+	printf("culling\tbatching\tload_ms\tms_per_frame\tframes_per_second\tgpu_ms\tdraws\tnode_bytes\n");
+	for (unsigned i = 0; i < 2; ++i) {
+		struct Timing baseline;
+		for (unsigned batching = 0; batching < 2; ++batching) {
+			struct BatchingVariant variant = {cullings[i], lod_threshold, batching};
+			struct Timing timing;
+			if (time_renderer(window, DEFAULT_FRAME_COUNT, scene, frames, configure_batching, read_node_size, &variant, &timing)) break;
+			if (!batching) baseline = timing;
+			printf(
+				"%s\t%s\t%.3f\t",
+				cullings[i] == CULLING_NONE ? "none" : "gpu",
+				batching ? "on" : "off",
+				1000 * timing.load_time
+			);
+			print_timing(timing, baseline);
+			printf("\t%u\t%llu\n", timing.stats.draw_count, (unsigned long long) variant.node_size);
+		}
+	}
+	close_city(window, base, scene);
+	return 0;
+}
+
+static const struct Benchmark BENCHMARKS[] = {
+	{"frames", "[scene] [frames] [max frames in flight]", bench_frames},
+	{"load", "[scene] [max threads] [repeats]", bench_load},
+	{"transforms", "[nodes] [repeats]", bench_transforms},
+	{"hierarchy", "[nodes] [max threads] [repeats]", bench_hierarchy},
+	{"culling", "[scene] [nodes] [frames] [half extent] [lod threshold] [threads]", bench_culling},
+	{"vertices", "[scene] [nodes] [frames] [half extent]", bench_vertices},
+	{"optimize", "[scene.glb|scene.gltf] [nodes] [frames] [half extent]", bench_optimize},
+	{"instancing", "[scene] [nodes] [frames] [half extent] [lod threshold]", bench_instancing},
+	{"batching", "[scene] [nodes] [frames] [half extent] [lod threshold]", bench_batching},
+};
+
+int main(int argc, char** argv) {
+	const unsigned benchmark_count = sizeof(BENCHMARKS) / sizeof(struct Benchmark);
+	if (argc > 1) {
+		for (unsigned i = 0; i < benchmark_count; ++i)
+			if (!strcmp(argv[1], BENCHMARKS[i].name))
+				return BENCHMARKS[i].run(argc - 2, argv + 2);
+	}
+	fprintf(stderr, "Usage:\n");
+	for (unsigned i = 0; i < benchmark_count; ++i)
+		fprintf(stderr, "\t%s %s %s\n", argv[0], BENCHMARKS[i].name, BENCHMARKS[i].usage);
+	return 1;
+}
@@ -0,0 +1,247 @@
+#include "bvh.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STACK_SIZE 64 //Median splits keep the depth logarithmic
+
+//One float per item of a batch (compiled to SSE/AVX/NEON registers)
+typedef float Lanes __attribute__((vector_size(BVH_WIDTH * sizeof(float))));
+typedef int Mask __attribute__((vector_size(BVH_WIDTH * sizeof(int))));
+
+enum Containment {OUTSIDE, INTERSECTING, INSIDE};
+
+//Sort key of an item along the split axis
+struct SplitKey {
+	float key;
+	unsigned item;
+};
+
+//Box enclosing an affine transformation of a box
+void transform_box(const struct Box box, mat4 m, struct Box* const result) {
+	vec3 center, extent;
+	for (unsigned i = 0; i < 3; ++i) {
+		center[i] = m[3][i];
+		extent[i] = 0;
+		for (unsigned j = 0; j < 3; ++j) {
+			center[i] += m[j][i] * (box.start[j] + box.end[j]) / 2;
+			extent[i] += fabsf(m[j][i]) * (box.end[j] - box.start[j]) / 2;
+		}
+	}
+	for (unsigned i = 0; i < 3; ++i) {
+		result->start[i] = center[i] - extent[i];
+		result->end[i] = center[i] + extent[i];
+	}
+}
+
+static void merge_box(struct Box* const box, const struct Box other) {
+	glm_vec3_minv(box->start, (float*) other.start, box->start);
+	glm_vec3_maxv(box->end, (float*) other.end, box->end);
+}
+
+static int compare_keys(const void* a, const void* b) {
+	const float x = ((const struct SplitKey*) a)->key, y = ((const struct SplitKey*) b)->key;
+	return (x > y) - (x < y);
+}
+
+//Split a node's items at the median of their centers along the longest axis
+static void build_node(
+	struct BVH* const bvh,
+	const unsigned node,
+	const struct Box* const boxes,
+	struct SplitKey* const keys) {
+	const unsigned first = bvh->nodes[node].first, count = bvh->nodes[node].count;
+	if (count <= BVH_LEAF_SIZE) return;
+	//Bounds of centers (doubled)
+	vec3 start, end;
+	for (unsigned i = 0; i < count; ++i) {
+		const struct Box box = boxes[bvh->items[first + i]];
+		for (unsigned j = 0; j < 3; ++j) {
+			const float center = box.start[j] + box.end[j];
+			if (!i || center < start[j]) start[j] = center;
+			if (!i || center > end[j]) end[j] = center;
+		}
+	}
+	unsigned axis = 0;
+	for (unsigned j = 1; j < 3; ++j)
+		if (end[j] - start[j] > end[axis] - start[axis]) axis = j;
+	//Sort items along it
+	for (unsigned i = 0; i < count; ++i) {
+		const unsigned item = bvh->items[first + i];
+		keys[i] = (struct SplitKey) {boxes[item].start[axis] + boxes[item].end[axis], item};
+	}
+	qsort(keys, count, sizeof(struct SplitKey), compare_keys);
+	for (unsigned i = 0; i < count; ++i)
+		bvh->items[first + i] = keys[i].item;
+	//Children
+	const unsigned child = bvh->node_count;
+	bvh->node_count += 2;
+	bvh->nodes[node].child = child;
+	bvh->nodes[child] = (struct BVHNode) {{}, first, count / 2, 0};
+	bvh->nodes[child + 1] = (struct BVHNode) {{}, first + count / 2, count - count / 2, 0};
+	build_node(bvh, child, boxes, keys);
+	build_node(bvh, child + 1, boxes, keys);
+}
+
+//Build a BVH over count items, each indexing boxes
+void create_bvh(
+	const unsigned count,
+	const unsigned* const items,
+	const struct Box* const boxes,
+	struct BVH* const bvh) {
+	const unsigned slot_count = count + BVH_WIDTH - 1; //Batches may start at the last item
+	float* const data = calloc(6 * slot_count, sizeof(float));
+	*bvh = (struct BVH) {
+		0,
+		malloc((count ? 2 * count - 1 : 0) * sizeof(struct BVHNode)),
+		count,
+		malloc(count * sizeof(unsigned)),
+		{data, data + slot_count, data + 2 * slot_count},
+		{data + 3 * slot_count, data + 4 * slot_count, data + 5 * slot_count}
+	};
+	if (!count) return;
+	memcpy(bvh->items, items, count * sizeof(unsigned));
+	bvh->nodes[0] = (struct BVHNode) {{}, 0, count, 0};
+	bvh->node_count = 1;
+	struct SplitKey* const keys = malloc(count * sizeof(struct SplitKey));
+	build_node(bvh, 0, boxes, keys);
+	free(keys);
+	refit_bvh(bvh, boxes);
+}
+
+void destroy_bvh(struct BVH* const bvh) {
+	free(bvh->nodes);
+	free(bvh->items);
+	free(bvh->centers[0]);
+}
+
+//Update the BVH's boxes after its items' boxes changed
+void refit_bvh(struct BVH* const bvh, const struct Box* const boxes) {
+	for (unsigned i = 0; i < bvh->item_count; ++i) {
+		const struct Box box = boxes[bvh->items[i]];
+		for (unsigned j = 0; j < 3; ++j) {
+			bvh->centers[j][i] = (box.start[j] + box.end[j]) / 2;
+			bvh->extents[j][i] = (box.end[j] - box.start[j]) / 2;
+		}
+	}
+	//Children before parents
+	for (unsigned i = bvh->node_count; i--;) {
+		struct BVHNode* const node = bvh->nodes + i;
+		if (node->child) {
+			node->box = bvh->nodes[node->child].box;
+			merge_box(&node->box, bvh->nodes[node->child + 1].box);
+		} else {
+			node->box = boxes[bvh->items[node->first]];
+			for (unsigned j = 1; j < node->count; ++j)
+				merge_box(&node->box, boxes[bvh->items[node->first + j]]);
+		}
+	}
+}
+
+static enum Containment classify_box(const struct Box box, const vec4* const planes) {
+	enum Containment result = INSIDE;
+	for (unsigned i = 0; i < 6; ++i) {
+		float distance = planes[i][3], radius = 0;
+		for (unsigned j = 0; j < 3; ++j) {
+			distance += planes[i][j] * (box.start[j] + box.end[j]) / 2;
+			radius += fabsf(planes[i][j]) * (box.end[j] - box.start[j]) / 2;
+		}
+		if (distance + radius < 0) return OUTSIDE;
+		if (distance - radius < 0) result = INTERSECTING;
+	}
+	return result;
+}
+
+//Load a lane per item from an array
+static inline Lanes load_lanes(const float* const data) {
+	Lanes lanes;
+	memcpy(&lanes, data, sizeof(Lanes));
+	return lanes;
+}
+
+//Test a leaf's items BVH_WIDTH at a time
+static unsigned cull_leaf(
+	const struct BVH* const bvh,
+	const struct BVHNode* const node,
+	const vec4* const planes,
+	unsigned* const visible) {
+	unsigned count = 0;
+	const unsigned end = node->first + node->count;
+	for (unsigned i = node->first; i < end; i += BVH_WIDTH) {
+		const Lanes x = load_lanes(bvh->centers[0] + i);
+		const Lanes y = load_lanes(bvh->centers[1] + i);
+		const Lanes z = load_lanes(bvh->centers[2] + i);
+		const Lanes ex = load_lanes(bvh->extents[0] + i);
+		const Lanes ey = load_lanes(bvh->extents[1] + i);
+		const Lanes ez = load_lanes(bvh->extents[2] + i);
+		Mask outside = {0};
+		for (unsigned j = 0; j < 6; ++j) {
+			const Lanes distance = planes[j][0] * x + planes[j][1] * y + planes[j][2] * z + planes[j][3];
+			const Lanes radius = fabsf(planes[j][0]) * ex + fabsf(planes[j][1]) * ey + fabsf(planes[j][2]) * ez;
+			outside |= distance + radius < 0;
+		}
+		const unsigned batch_end = end - i < BVH_WIDTH ? end - i : BVH_WIDTH;
+		for (unsigned k = 0; k < batch_end; ++k)
+			if (!outside[k]) visible[count++] = bvh->items[i + k];
+	}
+	return count;
+}
+
+/*
+	Write the roots of subtrees with at most max_items items (or leaves), covering every slot in order.
+	Returns their count.
+*/
+unsigned split_bvh(const struct BVH* const bvh, const unsigned max_items, unsigned* const roots) {
+	if (!bvh->node_count) return 0;
+	unsigned count = 0;
+	unsigned stack[STACK_SIZE];
+	unsigned stack_size = 1;
+	stack[0] = 0;
+	while (stack_size) {
+		const unsigned root = stack[--stack_size];
+		const struct BVHNode* const node = bvh->nodes + root;
+		if (node->count <= max_items || !node->child) roots[count++] = root;
+		else {
+			stack[stack_size++] = node->child + 1;
+			stack[stack_size++] = node->child;
+		}
+	}
+	return count;
+}
+
+/*
+	Write the items of a subtree whose boxes intersect the volume bounded by planes (pointing inwards) to visible,
+	in slot order.
+	Returns their count.
+	Subtrees entirely inside are taken whole, & leaves crossing a plane are tested item by item.
+*/
+unsigned cull_bvh_subtree(const struct BVH* const bvh, const unsigned root, const vec4* const planes, unsigned* const visible) {
+	unsigned count = 0;
+	unsigned stack[STACK_SIZE];
+	unsigned stack_size = 1;
+	stack[0] = root;
+	while (stack_size) {
+		const struct BVHNode* const node = bvh->nodes + stack[--stack_size];
+		switch (classify_box(node->box, planes)) {
+			case OUTSIDE:
+				break;
+			case INSIDE:
+				memcpy(visible + count, bvh->items + node->first, node->count * sizeof(unsigned));
+				count += node->count;
+				break;
+			case INTERSECTING:
+				if (node->child) {
+					stack[stack_size++] = node->child + 1;
+					stack[stack_size++] = node->child;
+				} else count += cull_leaf(bvh, node, planes, visible + count);
+				break;
+		}
+	}
+	return count;
+}
+
+//Cull every item (see cull_bvh_subtree)
+unsigned cull_bvh(const struct BVH* const bvh, const vec4* const planes, unsigned* const visible) {
+	return bvh->node_count ? cull_bvh_subtree(bvh, 0, planes, visible) : 0;
+}
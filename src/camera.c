@@ -1,6 +1,7 @@
 #include "camera.h"
 #include <cglm/affine.h>
 #include <cglm/cam.h>
+#include <cglm/frustum.h>
 #include <cglm/mat3.h>
 #include <cglm/mat4.h>
 #include <cglm/vec3.h>
@@ -31,6 +32,15 @@ void camera_projection(struct Camera camera, mat4 result) {
 	result[1][1] *= -1;
 }
 
+//Planes (left, right, bottom, top, near, far) with normals pointing into the frustum
+void camera_frustum(struct Camera camera, vec4* planes) {
+	mat4 view, projection, view_projection;
+	camera_view(camera, view);
+	camera_projection(camera, projection);
+	glm_mat4_mul(projection, view, view_projection);
+	glm_frustum_planes(view_projection, planes);
+}
+
 void camera_look(struct Camera* camera, vec3 target) {
 	glm_vec3_sub(target, camera->position, camera->direction);
 	glm_vec3_normalize(camera->direction);
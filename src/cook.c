@@ -0,0 +1,51 @@
+#include "package.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <SDL2/SDL.h>
+
+//Cook a glTF scene into a package for load_package (optimizing its primitives with --optimize)
+int main(int argc, char** argv) {
+	const bool optimize = argc > 1 && !strcmp(argv[1], "--optimize");
+	if (argc != 3 + optimize) {
+		fprintf(stderr, "Usage: %s [--optimize] <scene.glb|scene.gltf> <output%s>\n", argv[0], PACKAGE_EXTENSION);
+		return 1;
+	}
+	const char* const input = argv[1 + optimize];
+	const char* const output = argv[2 + optimize];
+	if (SDL_Init(0) < 0) {
+		fprintf(stderr, "Error initializing SDL: %s\n", SDL_GetError());
+		return 1;
+	}
+	if (!IMG_Init(IMG_INIT_JPG | IMG_INIT_PNG)) {
+		fprintf(stderr, "Error initializing SDL_image\n");
+		SDL_Quit();
+		return 1;
+	}
+	struct JobSystem jobs;
+	create_job_system(0, &jobs);
+	struct Scene scene;
+	struct OptimizationStats stats = {};
+	const bool load_error = load_scene(input, &jobs, optimize ? &stats : NULL, &scene);
+	destroy_job_system(&jobs);
+	if (load_error) {
+		fprintf(stderr, "Error loading scene %s\n", input);
+		IMG_Quit();
+		SDL_Quit();
+		return 1;
+	}
+	if (optimize) {
+		printf(
+			"Vertex cache: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f (%u triangles)\n",
+			cache_acmr(stats.before), cache_acmr(stats.after),
+			cache_atvr(stats.before), cache_atvr(stats.after),
+			stats.after.triangle_count
+		);
+	}
+	const bool save_error = save_package(output, &scene);
+	destroy_scene(scene);
+	IMG_Quit();
+	SDL_Quit();
+	return save_error;
+}
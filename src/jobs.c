@@ -0,0 +1,300 @@
+#include "jobs.h"
+#include <stdalign.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEQUE_CAPACITY 1024 //Power of 2; jobs beyond it run immediately
+
+//Chase-Lev deque
+struct Deque {
+	alignas(64) atomic_llong top; //Stolen from
+	alignas(64) atomic_llong bottom; //Pushed & popped by the owner
+	struct Job jobs[DEQUE_CAPACITY];
+};
+
+struct Worker {
+	struct JobSystem* system;
+	SDL_Thread* thread;
+	unsigned index;
+	uint32_t random; //Victim selection state
+	struct JobStats stats;
+	struct Deque deque;
+};
+
+//Worker running on this thread
+static _Thread_local struct Worker* current_worker;
+
+static bool push(struct Worker* const worker, const struct Job* const job) {
+	struct Deque* const deque = &worker->deque;
+	const long long bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+	const long long top = atomic_load_explicit(&deque->top, memory_order_acquire);
+	if (bottom - top >= DEQUE_CAPACITY) return false;
+	deque->jobs[bottom & (DEQUE_CAPACITY - 1)] = *job;
+	atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_release);
+	return true;
+}
+
+static bool pop(struct Worker* const worker, struct Job* const job) {
+	struct Deque* const deque = &worker->deque;
+	const long long bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+	atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+	long long top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+	if (top > bottom) {
+		//Empty
+		atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+		return false;
+	}
+	*job = deque->jobs[bottom & (DEQUE_CAPACITY - 1)];
+	if (top < bottom) return true;
+	//Last job: race thieves for it
+	const bool taken = atomic_compare_exchange_strong_explicit(
+		&deque->top, &top, top + 1,
+		memory_order_seq_cst, memory_order_relaxed
+	);
+	atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+	return taken;
+}
+
+static bool steal(struct Worker* const victim, struct Job* const job) {
+	struct Deque* const deque = &victim->deque;
+	long long top = atomic_load_explicit(&deque->top, memory_order_acquire);
+	atomic_thread_fence(memory_order_seq_cst);
+	const long long bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+	if (top >= bottom) return false;
+	*job = deque->jobs[top & (DEQUE_CAPACITY - 1)];
+	return atomic_compare_exchange_strong_explicit(
+		&deque->top, &top, top + 1,
+		memory_order_seq_cst, memory_order_relaxed
+	);
+}
+
+//Pop a job, or steal one starting from a random victim
+static bool take(struct JobSystem* const jobs, struct Worker* const worker, struct Job* const job) {
+	bool taken = pop(worker, job);
+	if (!taken) {
+		//Xorshift
+		worker->random ^= worker->random << 13;
+		worker->random ^= worker->random >> 17;
+		worker->random ^= worker->random << 5;
+		const unsigned start = worker->random % jobs->thread_count;
+		for (unsigned i = 0; !taken && i < jobs->thread_count; ++i) {
+			struct Worker* const victim = jobs->workers + (start + i) % jobs->thread_count;
+			if (victim != worker) taken = steal(victim, job);
+		}
+		if (taken) ++worker->stats.steal_count;
+	}
+	if (taken) atomic_fetch_sub(&jobs->queued, 1);
+	return taken;
+}
+
+//Push a job onto the worker's deque & wake a sleeping worker
+static bool enqueue(struct JobSystem* const jobs, struct Worker* const worker, const struct Job* const job) {
+	atomic_fetch_add(&jobs->queued, 1);
+	if (!push(worker, job)) {
+		atomic_fetch_sub(&jobs->queued, 1);
+		return false;
+	}
+	if (atomic_load(&jobs->sleeping)) {
+		SDL_LockMutex(jobs->mutex);
+		SDL_CondSignal(jobs->wake_cond);
+		SDL_UnlockMutex(jobs->mutex);
+	}
+	return true;
+}
+
+//Signal a counter, submitting its continuation if it reaches zero
+static void finish(struct JobSystem* const jobs, struct JobCounter* const counter) {
+	if (!counter) return;
+	//The counter may be released as soon as it reaches zero
+	const struct JobCounter continuation = {
+		0,
+		counter->then,
+		counter->then_data,
+		counter->then_count,
+		counter->then_counter
+	};
+	if (atomic_fetch_sub_explicit(&counter->count, 1, memory_order_acq_rel) != 1 || !continuation.then) return;
+	jobs_submit(jobs, continuation.then_count, continuation.then, continuation.then_data, continuation.then_counter);
+	finish(jobs, continuation.then_counter); //Placeholder added by jobs_counter_then
+}
+
+static void call(struct JobSystem* const jobs, struct Worker* const worker, const struct Job* const job, const unsigned i) {
+	if (!jobs || !jobs->timing || !worker) {
+		job->function(job->data, i);
+	} else {
+		const Uint64 start = SDL_GetPerformanceCounter();
+		job->function(job->data, i);
+		const double time = (double) (SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+		worker->stats.job_time += time;
+		if (time > worker->stats.max_job_time) worker->stats.max_job_time = time;
+	}
+	if (worker) ++worker->stats.job_count;
+}
+
+static void execute(struct JobSystem* const jobs, struct Worker* const worker, struct Job job) {
+	//Leave halves for idle workers to steal
+	while (job.end - job.begin > job.grain) {
+		struct Job half = job;
+		half.begin = job.begin + (job.end - job.begin) / 2;
+		if (job.counter) atomic_fetch_add_explicit(&job.counter->count, 1, memory_order_relaxed);
+		if (!enqueue(jobs, worker, &half)) {
+			if (job.counter) atomic_fetch_sub_explicit(&job.counter->count, 1, memory_order_relaxed);
+			break;
+		}
+		job.end = half.begin;
+	}
+	for (unsigned i = job.begin; i < job.end; ++i)
+		call(jobs, worker, &job, i);
+	finish(jobs, job.counter);
+}
+
+static int worker_main(void* data) {
+	struct Worker* const worker = data;
+	struct JobSystem* const jobs = worker->system;
+	current_worker = worker;
+	while (!atomic_load(&jobs->quit)) {
+		struct Job job;
+		if (take(jobs, worker, &job)) {
+			execute(jobs, worker, job);
+			continue;
+		}
+		//Sleep until jobs are queued
+		SDL_LockMutex(jobs->mutex);
+		atomic_fetch_add(&jobs->sleeping, 1);
+		while (!atomic_load(&jobs->queued) && !atomic_load(&jobs->quit))
+			SDL_CondWait(jobs->wake_cond, jobs->mutex);
+		atomic_fetch_sub(&jobs->sleeping, 1);
+		SDL_UnlockMutex(jobs->mutex);
+	}
+	return 0;
+}
+
+//A thread count of 0 uses every CPU
+bool create_job_system(const unsigned thread_count, struct JobSystem* const jobs) {
+	memset(jobs, 0, sizeof(struct JobSystem));
+	jobs->thread_count = thread_count ? thread_count : SDL_GetCPUCount();
+	jobs->mutex = SDL_CreateMutex();
+	jobs->wake_cond = SDL_CreateCond();
+	if (!jobs->mutex || !jobs->wake_cond) {
+		fprintf(stderr, "Error creating job system: %s\n", SDL_GetError());
+		return true;
+	}
+	jobs->workers = aligned_alloc(alignof(struct Worker), jobs->thread_count * sizeof(struct Worker));
+	memset(jobs->workers, 0, jobs->thread_count * sizeof(struct Worker));
+	for (unsigned i = 0; i < jobs->thread_count; ++i) {
+		jobs->workers[i].system = jobs;
+		jobs->workers[i].index = i;
+		jobs->workers[i].random = 2654435761u * (i + 1);
+	}
+	current_worker = jobs->workers;
+	for (unsigned i = 1; i < jobs->thread_count; ++i) {
+		jobs->workers[i].thread = SDL_CreateThread(worker_main, "worker", jobs->workers + i);
+		if (!jobs->workers[i].thread) {
+			fprintf(stderr, "Error creating worker thread: %s\n", SDL_GetError());
+			jobs->thread_count = i;
+			break;
+		}
+	}
+	return false;
+}
+
+void destroy_job_system(struct JobSystem* const jobs) {
+	SDL_LockMutex(jobs->mutex);
+	atomic_store(&jobs->quit, true);
+	SDL_CondBroadcast(jobs->wake_cond);
+	SDL_UnlockMutex(jobs->mutex);
+	for (unsigned i = 1; i < jobs->thread_count; ++i)
+		SDL_WaitThread(jobs->workers[i].thread, NULL);
+	if (current_worker == jobs->workers) current_worker = NULL;
+	free(jobs->workers);
+	SDL_DestroyCond(jobs->wake_cond);
+	SDL_DestroyMutex(jobs->mutex);
+}
+
+/*
+	Run function for each index in [0, count), signaling counter when all are done.
+	Runs immediately if jobs is NULL or this thread isn't one of its workers.
+*/
+void jobs_submit(
+	struct JobSystem* const jobs,
+	const unsigned count,
+	const JobFunction function,
+	void* const data,
+	struct JobCounter* const counter) {
+	if (!count) {
+		//Still signal, so continuations run
+		if (counter) atomic_fetch_add_explicit(&counter->count, 1, memory_order_relaxed);
+		finish(jobs, counter);
+		return;
+	}
+	struct Worker* const worker = jobs && current_worker && current_worker->system == jobs
+		? current_worker
+		: NULL;
+	const unsigned split_count = worker ? 4 * jobs->thread_count : 1; //Ranges per worker
+	const struct Job job = {
+		function,
+		data,
+		0, count,
+		count > split_count ? count / split_count : 1,
+		counter
+	};
+	if (counter) atomic_fetch_add_explicit(&counter->count, 1, memory_order_relaxed);
+	if (!worker || jobs->thread_count < 2 || !enqueue(jobs, worker, &job)) {
+		for (unsigned i = 0; i < count; ++i)
+			call(jobs, worker, &job, i);
+		finish(jobs, counter);
+	}
+}
+
+/*
+	Make the continuation of counter signal then_counter.
+	then_counter is incremented now so it can't reach zero before the continuation is submitted.
+*/
+void jobs_counter_then(
+	struct JobCounter* const counter,
+	const unsigned count,
+	const JobFunction function,
+	void* const data,
+	struct JobCounter* const then_counter) {
+	counter->then = function;
+	counter->then_data = data;
+	counter->then_count = count;
+	counter->then_counter = then_counter;
+	if (then_counter) atomic_fetch_add_explicit(&then_counter->count, 1, memory_order_relaxed);
+}
+
+//Run jobs until the counter reaches zero
+void jobs_wait(struct JobSystem* const jobs, struct JobCounter* const counter) {
+	struct Worker* const worker = jobs && current_worker && current_worker->system == jobs
+		? current_worker
+		: NULL;
+	while (atomic_load_explicit(&counter->count, memory_order_acquire)) {
+		struct Job job;
+		if (worker && take(jobs, worker, &job)) execute(jobs, worker, job);
+		else SDL_Delay(0);
+	}
+}
+
+//Returns once every job has run (serially if jobs is NULL)
+void jobs_parallel_for(
+	struct JobSystem* const jobs,
+	const unsigned count,
+	const JobFunction function,
+	void* const data) {
+	struct JobCounter counter = {0};
+	jobs_submit(jobs, count, function, data, &counter);
+	jobs_wait(jobs, &counter);
+}
+
+//Statistics of each worker (read while no jobs run)
+void jobs_get_stats(const struct JobSystem* const jobs, struct JobStats* const stats) {
+	for (unsigned i = 0; i < jobs->thread_count; ++i)
+		stats[i] = jobs->workers[i].stats;
+}
+
+void jobs_reset_stats(struct JobSystem* const jobs) {
+	for (unsigned i = 0; i < jobs->thread_count; ++i)
+		jobs->workers[i].stats = (struct JobStats) {0, 0, 0, 0};
+}
@@ -0,0 +1,386 @@
+#include "lod.h"
+#include "scene.h"
+#include <limits.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+//Sum of squared distances to planes, weighted by their triangles' areas
+struct Quadric {
+	double a00, a01, a02, a11, a12, a22; //Outer product of the normal
+	double b0, b1, b2; //Normal scaled by the plane's offset
+	double c; //Offset squared
+	double weight;
+};
+
+//Position moved onto a neighbour, removing the triangles between them
+struct Collapse {
+	double error; //Mean squared distance to the source & target's quadric planes
+	unsigned source, target;
+};
+
+//Vertex sorted by position
+struct Position {
+	vec3 pos;
+	unsigned vertex;
+};
+
+static int compare_positions(const void* a, const void* b) {
+	const struct Position* const x = a;
+	const struct Position* const y = b;
+	for (unsigned i = 0; i < 3; ++i)
+		if (x->pos[i] != y->pos[i]) return x->pos[i] < y->pos[i] ? -1 : 1;
+	return (x->vertex > y->vertex) - (x->vertex < y->vertex);
+}
+
+static int compare_edges(const void* a, const void* b) {
+	const uint64_t x = *(const uint64_t*) a, y = *(const uint64_t*) b;
+	return (x > y) - (x < y);
+}
+
+static int compare_collapses(const void* a, const void* b) {
+	const struct Collapse* const x = a;
+	const struct Collapse* const y = b;
+	return (x->error > y->error) - (x->error < y->error);
+}
+
+static bool same_tex(const struct Vertex* const a, const struct Vertex* const b) {
+	return a->tex[0] == b->tex[0] && a->tex[1] == b->tex[1];
+}
+
+static void add_quadric(struct Quadric* const q, const struct Quadric* const other) {
+	q->a00 += other->a00;
+	q->a01 += other->a01;
+	q->a02 += other->a02;
+	q->a11 += other->a11;
+	q->a12 += other->a12;
+	q->a22 += other->a22;
+	q->b0 += other->b0;
+	q->b1 += other->b1;
+	q->b2 += other->b2;
+	q->c += other->c;
+	q->weight += other->weight;
+}
+
+//Plane of a triangle, weighted by its area (false if degenerate)
+static bool triangle_quadric(const float* const a, const float* const b, const float* const c, struct Quadric* const q) {
+	vec3 ab, ac, normal;
+	glm_vec3_sub((float*) b, (float*) a, ab);
+	glm_vec3_sub((float*) c, (float*) a, ac);
+	glm_vec3_cross(ab, ac, normal);
+	const float length = glm_vec3_norm(normal);
+	if (length == 0) return false;
+	glm_vec3_scale(normal, 1 / length, normal);
+	const double x = normal[0], y = normal[1], z = normal[2];
+	const double d = -glm_vec3_dot(normal, (float*) a);
+	const double w = length / 2;
+	*q = (struct Quadric) {
+		w * x * x, w * x * y, w * x * z, w * y * y, w * y * z, w * z * z,
+		w * x * d, w * y * d, w * z * d,
+		w * d * d,
+		w
+	};
+	return true;
+}
+
+//Mean squared distance of a position to a quadric's planes
+static double quadric_error(const struct Quadric* const q, const float* const p) {
+	if (q->weight == 0) return 0;
+	const double x = p[0], y = p[1], z = p[2];
+	const double error = q->a00 * x * x + q->a11 * y * y + q->a22 * z * z
+		+ 2 * (q->a01 * x * y + q->a02 * x * z + q->a12 * y * z)
+		+ 2 * (q->b0 * x + q->b1 * y + q->b2 * z)
+		+ q->c;
+	return fmax(error, 0) / q->weight;
+}
+
+/*
+	Simplify triangles by collapsing edges in order of quadric error, until target_index_count is reached
+	or the next collapse would exceed max_error (distance).
+	Vertices are only moved onto their neighbours, so the result references the same vertices.
+	Vertices sharing a position (attribute seams) collapse together, each onto a target vertex on its side of the seam,
+	& vertices of open or non-manifold edges are locked, so the surface never cracks.
+	The quadrics' error is an area-weighted RMS distance, which only orders collapses & ends passes.
+	The error written instead sums, along each triangle's collapses, how far they moved vertices off their fans' surface
+	(along its area-weighted normal), a conservative estimate of how far the surface moved.
+	Writes up to index_count indices & that error.
+	Returns the result's index count.
+*/
+unsigned simplify(
+	const unsigned vertex_count,
+	const struct Vertex* const vertices,
+	const unsigned index_count,
+	const unsigned* const indices,
+	const unsigned target_index_count,
+	const float max_error,
+	unsigned* const result,
+	float* const error) {
+	memcpy(result, indices, index_count * sizeof(unsigned));
+	unsigned count = index_count / 3 * 3;
+	*error = 0;
+	//Vertices at the same position share the first one's topology & collapses
+	struct Position* const positions = malloc(vertex_count * sizeof(struct Position));
+	for (unsigned i = 0; i < vertex_count; ++i) {
+		glm_vec3_copy((float*) vertices[i].pos, positions[i].pos);
+		positions[i].vertex = i;
+	}
+	qsort(positions, vertex_count, sizeof(struct Position), compare_positions);
+	unsigned* const remap = malloc(vertex_count * sizeof(unsigned));
+	unsigned* const group_starts = malloc(vertex_count * sizeof(unsigned)); //Of each position in positions
+	bool* const locked = calloc(vertex_count, sizeof(bool));
+	for (unsigned i = 0, first = 0; i < vertex_count; ++i) {
+		if (!glm_vec3_eqv(positions[i].pos, positions[first].pos)) first = i;
+		remap[positions[i].vertex] = positions[first].vertex;
+		group_starts[positions[i].vertex] = first;
+	}
+	//Lock positions of edges without exactly two triangles (seams' edges have both sides' triangles)
+	uint64_t* const edges = malloc(count * sizeof(uint64_t));
+	unsigned edge_count = 0;
+	for (unsigned i = 0; i < count; i += 3) {
+		for (unsigned j = 0; j < 3; ++j) {
+			const unsigned a = remap[result[i + j]], b = remap[result[i + (j + 1) % 3]];
+			if (a == b) continue;
+			edges[edge_count++] = a < b ? (uint64_t) a << 32 | b : (uint64_t) b << 32 | a;
+		}
+	}
+	qsort(edges, edge_count, sizeof(uint64_t), compare_edges);
+	for (unsigned i = 0; i < edge_count;) {
+		unsigned j = i + 1;
+		while (j < edge_count && edges[j] == edges[i]) ++j;
+		if (j - i != 2) {
+			locked[edges[i] >> 32] = true;
+			locked[edges[i] & UINT32_MAX] = true;
+		}
+		i = j;
+	}
+	free(edges);
+	//Quadrics of each position's triangles
+	struct Quadric* const quadrics = calloc(vertex_count, sizeof(struct Quadric));
+	for (unsigned i = 0; i < count; i += 3) {
+		struct Quadric q;
+		if (!triangle_quadric(
+			vertices[result[i]].pos,
+			vertices[result[i + 1]].pos,
+			vertices[result[i + 2]].pos,
+			&q
+		)) continue;
+		for (unsigned j = 0; j < 3; ++j)
+			add_quadric(quadrics + remap[result[i + j]], &q);
+	}
+	//Passes of independent collapses, cheapest first
+	unsigned* const fan_offsets = malloc((vertex_count + 1) * sizeof(unsigned));
+	unsigned* const fans = malloc(count * sizeof(unsigned)); //Triangles around each position
+	struct Collapse* const collapses = malloc(2 * count * sizeof(struct Collapse));
+	unsigned* const targets = malloc(vertex_count * sizeof(unsigned));
+	bool* const touched = malloc(vertex_count * sizeof(bool));
+	double* const drifts = calloc(count / 3, sizeof(double)); //Distance each triangle moved
+	const double max_error_squared = (double) max_error * max_error;
+	double reached_error = 0;
+	while (count > target_index_count) {
+		//Triangles around each position
+		memset(fan_offsets, 0, (vertex_count + 1) * sizeof(unsigned));
+		for (unsigned i = 0; i < count; ++i)
+			++fan_offsets[remap[result[i]] + 1];
+		for (unsigned i = 0; i < vertex_count; ++i)
+			fan_offsets[i + 1] += fan_offsets[i];
+		for (unsigned i = 0; i < count; ++i)
+			fans[fan_offsets[remap[result[i]]]++] = i / 3;
+		for (unsigned i = vertex_count; i > 0; --i)
+			fan_offsets[i] = fan_offsets[i - 1];
+		fan_offsets[0] = 0;
+		//Collapses along every edge, both ways
+		unsigned collapse_count = 0;
+		for (unsigned i = 0; i < count; i += 3) {
+			for (unsigned j = 0; j < 3; ++j) {
+				const unsigned a = result[i + j], b = result[i + (j + 1) % 3];
+				const unsigned ra = remap[a], rb = remap[b];
+				if (ra == rb) continue;
+				struct Quadric q = quadrics[ra];
+				add_quadric(&q, quadrics + rb);
+				if (!locked[ra])
+					collapses[collapse_count++] = (struct Collapse) {quadric_error(&q, vertices[b].pos), a, b};
+				if (!locked[rb])
+					collapses[collapse_count++] = (struct Collapse) {quadric_error(&q, vertices[a].pos), b, a};
+			}
+		}
+		qsort(collapses, collapse_count, sizeof(struct Collapse), compare_collapses);
+		for (unsigned i = 0; i < vertex_count; ++i)
+			targets[i] = i;
+		memset(touched, 0, vertex_count * sizeof(bool));
+		unsigned removed_count = 0, collapsed_count = 0;
+		for (unsigned i = 0; i < collapse_count; ++i) {
+			const struct Collapse collapse = collapses[i];
+			if (collapse.error > max_error_squared || count - removed_count <= target_index_count) break;
+			const unsigned source = remap[collapse.source], target = remap[collapse.target];
+			if (touched[source] || touched[target]) continue;
+			//Each vertex at the source moves onto a target vertex sharing one of its triangles (its side of a seam)
+			for (unsigned j = fan_offsets[source]; j < fan_offsets[source + 1]; ++j) {
+				const unsigned* const triangle = result + 3 * fans[j];
+				unsigned from = UINT_MAX, to = UINT_MAX;
+				for (unsigned k = 0; k < 3; ++k) {
+					if (remap[triangle[k]] == source) from = triangle[k];
+					else if (remap[triangle[k]] == target) to = triangle[k];
+				}
+				if (to != UINT_MAX && targets[from] == from) targets[from] = to;
+			}
+			/*
+				Others (split normals) move onto the target vertex with the closest normal,
+				among those with the texture coordinates of a source vertex with the same ones.
+				Source vertices without any are alone on their side of a seam.
+			*/
+			for (unsigned j = fan_offsets[source]; j < fan_offsets[source + 1]; ++j) {
+				const unsigned* const triangle = result + 3 * fans[j];
+				unsigned from = triangle[0];
+				for (unsigned k = 1; k < 3; ++k)
+					if (remap[triangle[k]] == source) from = triangle[k];
+				if (targets[from] != from) continue;
+				unsigned side = UINT_MAX;
+				for (unsigned k = fan_offsets[source]; k < fan_offsets[source + 1] && side == UINT_MAX; ++k)
+					for (unsigned l = 0; l < 3; ++l) {
+						const unsigned other = result[3 * fans[k] + l];
+						if (remap[other] == source && targets[other] != other && same_tex(vertices + other, vertices + from))
+							side = targets[other];
+					}
+				if (side == UINT_MAX) continue;
+				float best = -INFINITY;
+				for (unsigned k = group_starts[target]; k < vertex_count && remap[positions[k].vertex] == target; ++k) {
+					const unsigned other = positions[k].vertex;
+					const float alignment = glm_vec3_dot((float*) vertices[other].normal, (float*) vertices[from].normal);
+					if (same_tex(vertices + other, vertices + side) && alignment > best) {
+						targets[from] = other;
+						best = alignment;
+					}
+				}
+			}
+			//Reject collapses stranding a seam vertex, flipping a remaining triangle or exceeding max_error
+			bool rejected = false;
+			unsigned removed = 0;
+			double drift = 0;
+			vec3 fan_normal = {0, 0, 0}; //Area-weighted, so slivers' planes barely count
+			for (unsigned j = fan_offsets[source]; j < fan_offsets[source + 1] && !rejected; ++j) {
+				const unsigned* const triangle = result + 3 * fans[j];
+				drift = fmax(drift, drifts[fans[j]]);
+				if (remap[triangle[0]] == target || remap[triangle[1]] == target || remap[triangle[2]] == target) {
+					++removed;
+					continue;
+				}
+				vec3 before[3], after[3];
+				for (unsigned k = 0; k < 3; ++k) {
+					if (remap[triangle[k]] == source && targets[triangle[k]] == triangle[k]) rejected = true;
+					glm_vec3_copy((float*) vertices[triangle[k]].pos, before[k]);
+					glm_vec3_copy((float*) vertices[targets[triangle[k]]].pos, after[k]);
+				}
+				vec3 ab, ac, old_normal, new_normal;
+				glm_vec3_sub(before[1], before[0], ab);
+				glm_vec3_sub(before[2], before[0], ac);
+				glm_vec3_cross(ab, ac, old_normal);
+				glm_vec3_sub(after[1], after[0], ab);
+				glm_vec3_sub(after[2], after[0], ac);
+				glm_vec3_cross(ab, ac, new_normal);
+				rejected |= glm_vec3_dot(old_normal, new_normal) <= 0;
+				glm_vec3_add(fan_normal, old_normal, fan_normal);
+			}
+			//Distance the source moves off its triangles' surface
+			vec3 offset;
+			glm_vec3_sub((float*) vertices[collapse.target].pos, (float*) vertices[collapse.source].pos, offset);
+			const float length = glm_vec3_norm(fan_normal);
+			drift += length > 0 ? fabs(glm_vec3_dot(fan_normal, offset)) / length : glm_vec3_norm(offset);
+			if (rejected || drift > max_error) {
+				for (unsigned j = fan_offsets[source]; j < fan_offsets[source + 1]; ++j)
+					for (unsigned k = 0; k < 3; ++k)
+						targets[result[3 * fans[j] + k]] = result[3 * fans[j] + k];
+				continue;
+			}
+			//The source's neighbourhood changes: leave it to the next pass
+			for (unsigned j = fan_offsets[source]; j < fan_offsets[source + 1]; ++j) {
+				for (unsigned k = 0; k < 3; ++k)
+					touched[remap[result[3 * fans[j] + k]]] = true;
+				drifts[fans[j]] = drift;
+			}
+			add_quadric(quadrics + target, quadrics + source);
+			removed_count += 3 * removed;
+			reached_error = fmax(reached_error, drift);
+			++collapsed_count;
+		}
+		if (!collapsed_count) break;
+		//Move collapsed vertices & drop degenerate triangles
+		unsigned new_count = 0;
+		for (unsigned i = 0; i < count; i += 3) {
+			const unsigned a = targets[result[i]], b = targets[result[i + 1]], c = targets[result[i + 2]];
+			if (remap[a] == remap[b] || remap[b] == remap[c] || remap[c] == remap[a]) continue;
+			drifts[new_count / 3] = drifts[i / 3];
+			result[new_count++] = a;
+			result[new_count++] = b;
+			result[new_count++] = c;
+		}
+		count = new_count;
+	}
+	free(fan_offsets);
+	free(fans);
+	free(collapses);
+	free(targets);
+	free(touched);
+	free(drifts);
+	free(quadrics);
+	free(positions);
+	free(group_starts);
+	free(remap);
+	free(locked);
+	*error = reached_error;
+	return count;
+}
+
+/*
+	Simplify a primitive into a chain of levels, each from the previous one.
+	Levels' errors accumulate, so each bounds its distance to the full-resolution surface.
+	The chain ends at LOD_MAX_COUNT levels, once simplification stalls or at LOD_MAX_ERROR.
+	Writes the levels & their consecutive indices.
+	Returns the level count.
+*/
+unsigned build_lods(
+	const unsigned vertex_count,
+	const struct Vertex* const vertices,
+	const unsigned index_count,
+	const unsigned* const indices,
+	struct Lod** const lods,
+	unsigned** const lod_indices) {
+	*lods = malloc(LOD_MAX_COUNT * sizeof(struct Lod));
+	*lod_indices = malloc(LOD_MAX_COUNT * index_count * sizeof(unsigned));
+	//Error budget
+	vec3 start = {0, 0, 0}, end = {0, 0, 0};
+	if (vertex_count) {
+		glm_vec3_copy((float*) vertices->pos, start);
+		glm_vec3_copy((float*) vertices->pos, end);
+	}
+	for (unsigned i = 1; i < vertex_count; ++i) {
+		glm_vec3_minv(start, (float*) vertices[i].pos, start);
+		glm_vec3_maxv(end, (float*) vertices[i].pos, end);
+	}
+	const float max_error = LOD_MAX_ERROR * glm_vec3_distance(start, end);
+	unsigned lod_count = 0, lod_index_count = 0;
+	unsigned source_offset = 0, source_count = index_count;
+	float error = 0;
+	while (lod_count < LOD_MAX_COUNT) {
+		const unsigned* const source = lod_count ? *lod_indices + source_offset : indices;
+		float level_error;
+		const unsigned count = simplify(
+			vertex_count, vertices,
+			source_count, source,
+			(unsigned) (source_count * LOD_REDUCTION) / 3 * 3,
+			max_error - error,
+			*lod_indices + lod_index_count,
+			&level_error
+		);
+		if (!count || count > source_count * LOD_MIN_REDUCTION) break;
+		error += level_error;
+		(*lods)[lod_count++] = (struct Lod) {lod_index_count, count, error};
+		source_offset = lod_index_count;
+		source_count = count;
+		lod_index_count += count;
+	}
+	*lods = realloc(*lods, lod_count * sizeof(struct Lod));
+	*lod_indices = realloc(*lod_indices, lod_index_count * sizeof(unsigned));
+	return lod_count;
+}
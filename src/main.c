@@ -1,7 +1,10 @@
+#include "package.h"
 #include "renderer.h"
 
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 #include <cglm/vec3.h>
@@ -56,14 +59,37 @@ int main() {
 	//Renderer
 	struct Renderer renderer;
 	//printf("Creating renderer\n");
-	create_renderer(window, &renderer);
+	create_renderer(window, DEFAULT_FRAME_COUNT, &renderer);
 	//printf("Created renderer\n");
+	const char* const culling = getenv("LIGHTRAIL_CULLING"); //none, cpu, gpu (default), occlusion, software or meshlet
+	if (culling && !strcmp(culling, "none")) renderer.culling = CULLING_NONE;
+	else if (culling && !strcmp(culling, "cpu")) renderer.culling = CULLING_CPU;
+	else if (culling && !strcmp(culling, "occlusion")) renderer.culling = CULLING_OCCLUSION;
+	else if (culling && !strcmp(culling, "software")) renderer.culling = CULLING_SOFTWARE;
+	else if (culling && !strcmp(culling, "meshlet")) renderer.culling = CULLING_MESHLET;
+	const char* const lod_threshold = getenv("LIGHTRAIL_LOD_THRESHOLD"); //Pixels (0 for full detail)
+	if (lod_threshold) renderer.lod_threshold = strtof(lod_threshold, NULL);
+	const char* const compact_vertices = getenv("LIGHTRAIL_COMPACT_VERTICES"); //1 for quantized vertices & 16-bit indices
+	if (compact_vertices) renderer.compact_vertices = strtoul(compact_vertices, NULL, 10);
+	const char* const instancing = getenv("LIGHTRAIL_INSTANCING"); //0 for a command per draw
+	if (instancing) renderer.instancing = strtoul(instancing, NULL, 10);
+	const char* const static_batching = getenv("LIGHTRAIL_STATIC_BATCHING"); //1 to merge static nodes into world-space batches
+	if (static_batching) renderer.static_batching = strtoul(static_batching, NULL, 10);
 	struct Camera camera = create_camera();
 
+	//Jobs
+	const char* const thread_count = getenv("LIGHTRAIL_THREADS"); //Default: every CPU
+	struct JobSystem jobs;
+	create_job_system(thread_count ? strtoul(thread_count, NULL, 10) : 0, &jobs);
+	jobs.timing = getenv("LIGHTRAIL_JOB_STATS");
+	renderer.jobs = &jobs;
+
 	//Scene
 	struct Scene scene;
+	const char* const optimize = getenv("LIGHTRAIL_OPTIMIZE"); //1 to optimize glTF primitives for the vertex cache, overdraw & vertex fetch
+	struct OptimizationStats optimization = {};
 	//printf("Loading scene\n");
-	load_scene("BarramundiFish.glb", &scene);
+	load_scene_file("BarramundiFish.glb", &jobs, optimize && strtoul(optimize, NULL, 10) ? &optimization : NULL, &scene);
 	//printf("Scene loaded\n");
 	//printf("Loading scene into renderer\n");
 	renderer_load_scene(&renderer, scene);
@@ -217,7 +243,8 @@ int main() {
 		//Rendering
 		if (shown && !minimized) {
 			renderer_update_camera(&renderer, camera);
-			renderer_update_nodes(&renderer, scene);
+			scene_update_transformations(&scene, &jobs);
+			renderer_update_nodes(&renderer, &scene);
 			renderer_draw(&renderer);
 			usleep(min_frame_time > delta ? (min_frame_time - delta) * MICRO : 0);
 		} else {
@@ -230,6 +257,22 @@ int main() {
 	destroy_renderer(renderer);
 	//printf("Renderer destroyed\n");
 	//destroy_scene(scene);
+	if (jobs.timing) {
+		struct JobStats* const stats = malloc(jobs.thread_count * sizeof(struct JobStats));
+		jobs_get_stats(&jobs, stats);
+		printf("worker\tjobs\tsteals\tms_total\tms_max\n");
+		for (unsigned i = 0; i < jobs.thread_count; ++i)
+			printf(
+				"%u\t%lu\t%lu\t%.3f\t%.3f\n",
+				i,
+				(unsigned long) stats[i].job_count,
+				(unsigned long) stats[i].steal_count,
+				1000 * stats[i].job_time,
+				1000 * stats[i].max_job_time
+			);
+		free(stats);
+	}
+	destroy_job_system(&jobs);
 	IMG_Quit();
 	SDL_DestroyWindow(window);
 	SDL_Quit();
@@ -0,0 +1,94 @@
+#include "meshlet.h"
+#include "scene.h"
+#include <math.h>
+#include <stdlib.h>
+
+#define CONE_MIN_DOT 0.1f //Normals must be within this cosine of the axis (~84 degrees) for the cone to cull
+
+//Bounding sphere & normal cone of a range of triangles
+static void meshlet_bounds(const struct Vertex* const vertices, const unsigned* const indices, struct Meshlet* const meshlet) {
+	const unsigned* const triangles = indices + meshlet->first_index;
+	//Sphere around the center of the vertices' box
+	vec3 start, end;
+	glm_vec3_copy((float*) vertices[triangles[0]].pos, start);
+	glm_vec3_copy((float*) vertices[triangles[0]].pos, end);
+	for (unsigned i = 1; i < meshlet->index_count; ++i) {
+		glm_vec3_minv(start, (float*) vertices[triangles[i]].pos, start);
+		glm_vec3_maxv(end, (float*) vertices[triangles[i]].pos, end);
+	}
+	glm_vec3_center(start, end, meshlet->center);
+	float radius = 0;
+	for (unsigned i = 0; i < meshlet->index_count; ++i)
+		radius = fmaxf(radius, glm_vec3_distance(meshlet->center, (float*) vertices[triangles[i]].pos));
+	meshlet->radius = radius;
+	//Cone around the average of the triangles' normals (counterclockwise front faces)
+	vec3* const normals = malloc(meshlet->index_count / 3 * sizeof(vec3));
+	unsigned normal_count = 0;
+	vec3 axis = {0, 0, 0};
+	for (unsigned i = 0; i + 2 < meshlet->index_count; i += 3) {
+		vec3 ab, ac;
+		glm_vec3_sub((float*) vertices[triangles[i + 1]].pos, (float*) vertices[triangles[i]].pos, ab);
+		glm_vec3_sub((float*) vertices[triangles[i + 2]].pos, (float*) vertices[triangles[i]].pos, ac);
+		glm_vec3_cross(ab, ac, normals[normal_count]);
+		const float length = glm_vec3_norm(normals[normal_count]);
+		if (length == 0) continue; //Degenerate
+		glm_vec3_scale(normals[normal_count], 1 / length, normals[normal_count]);
+		glm_vec3_add(axis, normals[normal_count], axis);
+		++normal_count;
+	}
+	const float axis_length = glm_vec3_norm(axis);
+	float min_dot = axis_length > 0 ? 1 : -1;
+	if (axis_length > 0) glm_vec3_scale(axis, 1 / axis_length, axis);
+	for (unsigned i = 0; i < normal_count; ++i)
+		min_dot = fminf(min_dot, glm_vec3_dot(axis, normals[i]));
+	free(normals);
+	glm_vec3_copy(axis, meshlet->cone_axis);
+	meshlet->cone_cutoff = min_dot < CONE_MIN_DOT ? 1 : sqrtf(1 - min_dot * min_dot);
+}
+
+/*
+	Split a primitive's triangles into meshlets, in index order.
+	A meshlet ends when the next triangle would exceed its vertex or triangle limit,
+	so their locality follows the index order's.
+	Returns the meshlet count.
+*/
+unsigned build_meshlets(
+	const unsigned vertex_count,
+	const struct Vertex* const vertices,
+	const unsigned index_count,
+	const unsigned* const indices,
+	struct Meshlet** const result) {
+	//Upper bound: meshlets but the last end with more than MESHLET_MAX_VERTICES - 3 vertices
+	const unsigned triangle_count = index_count / 3;
+	const unsigned max_meshlet_count = triangle_count / ((MESHLET_MAX_VERTICES - 2) / 3) + 1;
+	struct Meshlet* const meshlets = malloc(max_meshlet_count * sizeof(struct Meshlet));
+	unsigned* const last_meshlet = malloc(vertex_count * sizeof(unsigned)); //Last meshlet using each vertex
+	for (unsigned i = 0; i < vertex_count; ++i)
+		last_meshlet[i] = ~0u;
+	unsigned meshlet_count = 0, meshlet_vertex_count = 0;
+	for (unsigned i = 0; i < triangle_count; ++i) {
+		const unsigned* const triangle = indices + 3 * i;
+		//Vertices the triangle would add (overestimated for degenerate triangles)
+		unsigned new_vertex_count = 0;
+		for (unsigned j = 0; j < 3; ++j)
+			new_vertex_count += !meshlet_count || last_meshlet[triangle[j]] != meshlet_count - 1;
+		//Start a meshlet if the current one is full
+		if (!meshlet_count
+			|| meshlet_vertex_count + new_vertex_count > MESHLET_MAX_VERTICES
+			|| meshlets[meshlet_count - 1].index_count / 3 >= MESHLET_MAX_TRIANGLES) {
+			meshlets[meshlet_count++] = (struct Meshlet) {3 * i, 0};
+			meshlet_vertex_count = 0;
+		}
+		for (unsigned j = 0; j < 3; ++j) {
+			if (last_meshlet[triangle[j]] == meshlet_count - 1) continue;
+			last_meshlet[triangle[j]] = meshlet_count - 1;
+			++meshlet_vertex_count;
+		}
+		meshlets[meshlet_count - 1].index_count += 3;
+	}
+	free(last_meshlet);
+	for (unsigned i = 0; i < meshlet_count; ++i)
+		meshlet_bounds(vertices, indices, meshlets + i);
+	*result = realloc(meshlets, meshlet_count * sizeof(struct Meshlet));
+	return meshlet_count;
+}
@@ -0,0 +1,210 @@
+#include "occlusion.h"
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NEAR_W 1e-5f //Triangles with a vertex nearer to the camera plane are skipped
+
+//One float per pixel of a row span (compiled to SSE/AVX/NEON registers)
+typedef float Lanes __attribute__((vector_size(OCCLUSION_WIDTH * sizeof(float))));
+typedef int Mask __attribute__((vector_size(OCCLUSION_WIDTH * sizeof(int))));
+
+void create_occlusion_buffer(const unsigned width, const unsigned height, struct OcclusionBuffer* const buffer) {
+	const unsigned tiles_x = (width + OCCLUSION_TILE_SIZE - 1) / OCCLUSION_TILE_SIZE;
+	const unsigned tiles_y = (height + OCCLUSION_TILE_SIZE - 1) / OCCLUSION_TILE_SIZE;
+	*buffer = (struct OcclusionBuffer) {
+		tiles_x * OCCLUSION_TILE_SIZE,
+		tiles_y * OCCLUSION_TILE_SIZE,
+		malloc(tiles_x * tiles_y * OCCLUSION_TILE_SIZE * OCCLUSION_TILE_SIZE * sizeof(float)),
+		malloc(tiles_x * tiles_y * sizeof(float)),
+		0
+	};
+	clear_occlusion_buffer(buffer);
+}
+
+void destroy_occlusion_buffer(struct OcclusionBuffer* const buffer) {
+	free(buffer->depths);
+	free(buffer->tile_depths);
+}
+
+//Nothing occludes
+void clear_occlusion_buffer(struct OcclusionBuffer* const buffer) {
+	for (unsigned i = 0; i < buffer->width * buffer->height; ++i)
+		buffer->depths[i] = FLT_MAX;
+	const unsigned tile_count = buffer->width * buffer->height / (OCCLUSION_TILE_SIZE * OCCLUSION_TILE_SIZE);
+	for (unsigned i = 0; i < tile_count; ++i)
+		buffer->tile_depths[i] = FLT_MAX;
+	buffer->triangle_count = 0;
+}
+
+//Load a lane per pixel
+static inline Lanes load_lanes(const float* const data) {
+	Lanes lanes;
+	memcpy(&lanes, data, sizeof(Lanes));
+	return lanes;
+}
+
+static inline void store_lanes(float* const data, const Lanes lanes) {
+	memcpy(data, &lanes, sizeof(Lanes));
+}
+
+/*
+	Draw a triangle (x & y in pixels) at its farthest depth, so it never occludes more than itself.
+	Pixels are covered by their centers, OCCLUSION_WIDTH at a time.
+*/
+static void rasterize_triangle(struct OcclusionBuffer* const buffer, const vec3 a, vec3 b, vec3 c) {
+	//Counterclockwise in pixel coordinates
+	const float area = (b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0]);
+	if (area == 0) return;
+	if (area < 0) {
+		float* const swap = b;
+		b = c;
+		c = swap;
+	}
+	//Pixels whose centers are in the bounding rectangle
+	const float min_x = fminf(a[0], fminf(b[0], c[0])), max_x = fmaxf(a[0], fmaxf(b[0], c[0]));
+	const float min_y = fminf(a[1], fminf(b[1], c[1])), max_y = fmaxf(a[1], fmaxf(b[1], c[1]));
+	const int start_x = fmaxf(ceilf(min_x - 0.5f), 0);
+	const int end_x = fminf(floorf(max_x - 0.5f), buffer->width - 1);
+	const int start_y = fmaxf(ceilf(min_y - 0.5f), 0);
+	const int end_y = fminf(floorf(max_y - 0.5f), buffer->height - 1);
+	if (start_x > end_x || start_y > end_y) return;
+	const Lanes depth = (Lanes) {0} + fmaxf(a[2], fmaxf(b[2], c[2]));
+	//Edge functions: e = dx * x + dy * y + offset, non-negative inside
+	const float* const vertices[] = {a, b, c};
+	float dx[3], dy[3], offsets[3];
+	for (unsigned i = 0; i < 3; ++i) {
+		const float* const p = vertices[i];
+		const float* const q = vertices[(i + 1) % 3];
+		dx[i] = p[1] - q[1];
+		dy[i] = q[0] - p[0];
+		offsets[i] = -(dx[i] * p[0] + dy[i] * p[1]);
+	}
+	//Spans start at multiples of OCCLUSION_WIDTH, which divides the width
+	Lanes x = {0};
+	for (unsigned i = 0; i < OCCLUSION_WIDTH; ++i)
+		x[i] = (start_x & ~(OCCLUSION_WIDTH - 1)) + i + 0.5f;
+	for (int y = start_y; y <= end_y; ++y) {
+		float* const row = buffer->depths + y * buffer->width;
+		Lanes span_x = x;
+		for (int i = start_x & ~(OCCLUSION_WIDTH - 1); i <= end_x; i += OCCLUSION_WIDTH) {
+			Mask inside = ~(Mask) {0};
+			for (unsigned j = 0; j < 3; ++j)
+				inside &= dx[j] * span_x + (dy[j] * (y + 0.5f) + offsets[j]) >= 0;
+			const Lanes old = load_lanes(row + i);
+			const Mask nearer = inside & (depth < old);
+			store_lanes(row + i, (Lanes) (((Mask) old & ~nearer) | ((Mask) depth & nearer)));
+			span_x += OCCLUSION_WIDTH;
+		}
+	}
+}
+
+/*
+	Rasterize an occluder's triangles, transformed to clip space by m.
+	Triangles crossing the camera plane are skipped instead of clipped.
+	Tiles are updated by update_occlusion_tiles once every occluder is drawn.
+*/
+void rasterize_occluder(struct OcclusionBuffer* const buffer, mat4 m, const struct Occluder* const occluder) {
+	//Vertices in pixels & normalized device depth (w <= 0 marks vertices behind the camera)
+	vec4* const screen = malloc(occluder->vertex_count * sizeof(vec4));
+	for (unsigned i = 0; i < occluder->vertex_count; ++i) {
+		vec4 clip;
+		glm_mat4_mulv(m, (vec4) {occluder->positions[i][0], occluder->positions[i][1], occluder->positions[i][2], 1}, clip);
+		if (clip[3] < NEAR_W) {
+			screen[i][3] = 0;
+			continue;
+		}
+		screen[i][0] = (clip[0] / clip[3] * 0.5f + 0.5f) * buffer->width;
+		screen[i][1] = (clip[1] / clip[3] * 0.5f + 0.5f) * buffer->height;
+		screen[i][2] = clip[2] / clip[3];
+		screen[i][3] = 1;
+	}
+	for (unsigned i = 0; i + 2 < occluder->index_count; i += 3) {
+		const unsigned* const triangle = occluder->indices + i;
+		if (!screen[triangle[0]][3] || !screen[triangle[1]][3] || !screen[triangle[2]][3]) continue;
+		rasterize_triangle(buffer, screen[triangle[0]], screen[triangle[1]], screen[triangle[2]]);
+		++buffer->triangle_count;
+	}
+	free(screen);
+}
+
+//Farthest depth of each tile
+void update_occlusion_tiles(struct OcclusionBuffer* const buffer) {
+	const unsigned tiles_x = buffer->width / OCCLUSION_TILE_SIZE, tiles_y = buffer->height / OCCLUSION_TILE_SIZE;
+	for (unsigned i = 0; i < tiles_y; ++i) {
+		for (unsigned j = 0; j < tiles_x; ++j) {
+			Lanes farthest = load_lanes(buffer->depths + i * OCCLUSION_TILE_SIZE * buffer->width + j * OCCLUSION_TILE_SIZE);
+			for (unsigned y = 0; y < OCCLUSION_TILE_SIZE; ++y) {
+				const float* const row = buffer->depths + (i * OCCLUSION_TILE_SIZE + y) * buffer->width;
+				for (unsigned x = j * OCCLUSION_TILE_SIZE; x < (j + 1) * OCCLUSION_TILE_SIZE; x += OCCLUSION_WIDTH) {
+					const Lanes depths = load_lanes(row + x);
+					const Mask farther = depths > farthest;
+					farthest = (Lanes) (((Mask) farthest & ~farther) | ((Mask) depths & farther));
+				}
+			}
+			float depth = farthest[0];
+			for (unsigned k = 1; k < OCCLUSION_WIDTH; ++k)
+				depth = fmaxf(depth, farthest[k]);
+			buffer->tile_depths[i * tiles_x + j] = depth;
+		}
+	}
+}
+
+/*
+	Bounds of a box transformed by m, in normalized device coordinates.
+	Boxes crossing the camera plane cover the whole screen infinitely near.
+*/
+void project_box(const struct Box box, mat4 m, struct Box* const result) {
+	for (unsigned i = 0; i < 8; ++i) {
+		vec4 clip;
+		glm_mat4_mulv(m, (vec4) {
+			i & 1 ? box.end[0] : box.start[0],
+			i & 2 ? box.end[1] : box.start[1],
+			i & 4 ? box.end[2] : box.start[2],
+			1
+		}, clip);
+		if (clip[3] < NEAR_W) {
+			*result = (struct Box) {{-1, -1, -INFINITY}, {1, 1, INFINITY}};
+			return;
+		}
+		for (unsigned j = 0; j < 3; ++j) {
+			const float x = clip[j] / clip[3];
+			if (!i || x < result->start[j]) result->start[j] = x;
+			if (!i || x > result->end[j]) result->end[j] = x;
+		}
+	}
+}
+
+//Whether any part of a projected box may be nearer than the occluders (false if hidden)
+bool test_occlusion(const struct OcclusionBuffer* const buffer, const struct Box box) {
+	//Pixel coordinates
+	const float box_start_x = (box.start[0] * 0.5f + 0.5f) * buffer->width;
+	const float box_end_x = (box.end[0] * 0.5f + 0.5f) * buffer->width;
+	const float box_start_y = (box.start[1] * 0.5f + 0.5f) * buffer->height;
+	const float box_end_y = (box.end[1] * 0.5f + 0.5f) * buffer->height;
+	if (box_end_x < 0 || box_start_x > buffer->width || box_end_y < 0 || box_start_y > buffer->height)
+		return false; //Off screen
+	/*
+		Pixels whose centers are within the box, as depths are of the occluders at pixel centers:
+		a pixel the box only partly covers may be occluded at its center but not where the box is
+	*/
+	const int start_x = fmaxf(ceilf(box_start_x - 0.5f), 0);
+	const int end_x = fminf(floorf(box_end_x - 0.5f), buffer->width - 1);
+	const int start_y = fmaxf(ceilf(box_start_y - 0.5f), 0);
+	const int end_y = fminf(floorf(box_end_y - 0.5f), buffer->height - 1);
+	if (start_x > end_x || start_y > end_y) return true; //Between pixel centers
+	const float depth = box.start[2];
+	const unsigned tiles_x = buffer->width / OCCLUSION_TILE_SIZE;
+	for (int i = start_y / OCCLUSION_TILE_SIZE; i <= end_y / OCCLUSION_TILE_SIZE; ++i) {
+		for (int j = start_x / OCCLUSION_TILE_SIZE; j <= end_x / OCCLUSION_TILE_SIZE; ++j) {
+			if (depth > buffer->tile_depths[i * tiles_x + j]) continue; //Whole tile occludes
+			//Pixels of the tile within the box
+			const int tile_end_y = (i + 1) * OCCLUSION_TILE_SIZE - 1, tile_end_x = (j + 1) * OCCLUSION_TILE_SIZE - 1;
+			for (int y = i * OCCLUSION_TILE_SIZE > start_y ? i * OCCLUSION_TILE_SIZE : start_y; y <= tile_end_y && y <= end_y; ++y)
+				for (int x = j * OCCLUSION_TILE_SIZE > start_x ? j * OCCLUSION_TILE_SIZE : start_x; x <= tile_end_x && x <= end_x; ++x)
+					if (depth <= buffer->depths[y * buffer->width + x]) return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,302 @@
+#include "optimize.h"
+#include "scene.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+	Simulate a triangle in a FIFO cache, returning its misses.
+	Vertices are cached if fewer than VERTEX_CACHE_SIZE were inserted after them
+	(timestamps start at 0 & time at VERTEX_CACHE_SIZE + 1, adding VERTEX_CACHE_SIZE empties the cache).
+*/
+static unsigned cache_triangle(const unsigned* const triangle, unsigned* const timestamps, unsigned* const time) {
+	unsigned miss_count = 0;
+	for (unsigned i = 0; i < 3; ++i) {
+		if (*time - timestamps[triangle[i]] <= VERTEX_CACHE_SIZE) continue;
+		timestamps[triangle[i]] = (*time)++;
+		++miss_count;
+	}
+	return miss_count;
+}
+
+//Add the cache statistics of a primitive's triangles to stats
+void analyze_vertex_cache(
+	const unsigned index_count,
+	const unsigned* const indices,
+	const unsigned vertex_count,
+	struct CacheStats* const stats) {
+	unsigned* const timestamps = calloc(vertex_count, sizeof(unsigned));
+	unsigned time = VERTEX_CACHE_SIZE + 1;
+	for (unsigned i = 0; i + 2 < index_count; i += 3)
+		stats->miss_count += cache_triangle(indices + i, timestamps, &time);
+	free(timestamps);
+	stats->triangle_count += index_count / 3;
+	stats->vertex_count += vertex_count;
+}
+
+//Average cache miss ratio: vertices transformed per triangle (0.5 at best, 3 at worst)
+float cache_acmr(const struct CacheStats stats) {
+	return stats.triangle_count ? (float) stats.miss_count / stats.triangle_count : 0;
+}
+
+//Average transformed vertex ratio: transforms per vertex (1 at best)
+float cache_atvr(const struct CacheStats stats) {
+	return stats.vertex_count ? (float) stats.miss_count / stats.vertex_count : 0;
+}
+
+static uint32_t hash_vertex(const struct Vertex* const vertex) {
+	const unsigned char* const bytes = (const unsigned char*) vertex;
+	uint32_t hash = 2166136261u; //FNV-1a
+	for (unsigned i = 0; i < sizeof(struct Vertex); ++i)
+		hash = (hash ^ bytes[i]) * 16777619u;
+	return hash;
+}
+
+/*
+	Merge bitwise identical vertices, remapping the indices.
+	Vertices are compacted in place, in order of first occurrence.
+	Writes the new index of each vertex to remap if it isn't NULL.
+	Returns the new vertex count.
+*/
+unsigned deduplicate_vertices(
+	const unsigned vertex_count,
+	struct Vertex* const vertices,
+	const unsigned index_count,
+	unsigned* const indices,
+	unsigned* const vertex_remap) {
+	unsigned table_size = 1;
+	while (table_size < 2 * vertex_count) table_size *= 2;
+	unsigned* const table = malloc(table_size * sizeof(unsigned)); //Unique vertices (open addressing, ~0u if empty)
+	memset(table, 0xFF, table_size * sizeof(unsigned));
+	unsigned* const remap = vertex_remap ? vertex_remap : malloc(vertex_count * sizeof(unsigned));
+	unsigned unique_count = 0;
+	for (unsigned i = 0; i < vertex_count; ++i) {
+		unsigned slot = hash_vertex(vertices + i) & (table_size - 1);
+		while (table[slot] != ~0u && memcmp(vertices + table[slot], vertices + i, sizeof(struct Vertex)))
+			slot = (slot + 1) & (table_size - 1);
+		if (table[slot] == ~0u) {
+			vertices[unique_count] = vertices[i];
+			table[slot] = unique_count++;
+		}
+		remap[i] = table[slot];
+	}
+	for (unsigned i = 0; i < index_count; ++i)
+		indices[i] = remap[indices[i]];
+	free(table);
+	if (!vertex_remap) free(remap);
+	return unique_count;
+}
+
+/*
+	Reorder triangles for the post-transform vertex cache (Tipsify: Sander, Nehab & Barczak 2007).
+	Emits the remaining triangles around a fanning vertex, then continues from a vertex of that fan
+	whose triangles would still hit the cache, or else from the last vertex used with triangles left.
+*/
+void optimize_vertex_cache(const unsigned index_count, unsigned* const indices, const unsigned vertex_count) {
+	const unsigned triangle_count = index_count / 3;
+	if (!triangle_count) return;
+	//Triangles of each vertex
+	unsigned* const live = calloc(vertex_count, sizeof(unsigned)); //Triangles left
+	for (unsigned i = 0; i < 3 * triangle_count; ++i)
+		++live[indices[i]];
+	unsigned* const offsets = malloc((vertex_count + 1) * sizeof(unsigned));
+	offsets[0] = 0;
+	for (unsigned i = 0; i < vertex_count; ++i)
+		offsets[i + 1] = offsets[i] + live[i];
+	unsigned* const adjacency = malloc(3 * triangle_count * sizeof(unsigned));
+	unsigned* const timestamps = calloc(vertex_count, sizeof(unsigned)); //Used as fill counts first
+	for (unsigned i = 0; i < 3 * triangle_count; ++i)
+		adjacency[offsets[indices[i]] + timestamps[indices[i]]++] = i / 3;
+	memset(timestamps, 0, vertex_count * sizeof(unsigned));
+	//Fans
+	bool* const emitted = calloc(triangle_count, sizeof(bool));
+	unsigned* const dead_ends = malloc(3 * triangle_count * sizeof(unsigned)); //Stack of vertices used
+	unsigned* const candidates = malloc(3 * triangle_count * sizeof(unsigned));
+	unsigned* const result = malloc(3 * triangle_count * sizeof(unsigned));
+	unsigned time = VERTEX_CACHE_SIZE + 1, dead_end_count = 0, cursor = 0, output = 0;
+	unsigned fan = indices[0];
+	while (fan != ~0u) {
+		unsigned candidate_count = 0;
+		for (unsigned i = offsets[fan]; i < offsets[fan + 1]; ++i) {
+			const unsigned triangle = adjacency[i];
+			if (emitted[triangle]) continue;
+			emitted[triangle] = true;
+			for (unsigned j = 0; j < 3; ++j) {
+				const unsigned vertex = indices[3 * triangle + j];
+				result[output++] = vertex;
+				dead_ends[dead_end_count++] = vertex;
+				candidates[candidate_count++] = vertex;
+				--live[vertex];
+				if (time - timestamps[vertex] > VERTEX_CACHE_SIZE) timestamps[vertex] = time++;
+			}
+		}
+		//Oldest candidate whose remaining triangles would stay in the cache (or any with triangles left)
+		fan = ~0u;
+		unsigned best_priority = 0;
+		for (unsigned i = 0; i < candidate_count; ++i) {
+			const unsigned vertex = candidates[i];
+			if (!live[vertex]) continue;
+			const unsigned age = time - timestamps[vertex];
+			const unsigned priority = age + 2 * live[vertex] <= VERTEX_CACHE_SIZE ? age : 0;
+			if (fan == ~0u || priority > best_priority) {
+				fan = vertex;
+				best_priority = priority;
+			}
+		}
+		//Dead end: the last vertex used with triangles left, or the next in order
+		while (fan == ~0u && dead_end_count)
+			if (live[dead_ends[--dead_end_count]]) fan = dead_ends[dead_end_count];
+		for (; fan == ~0u && cursor < vertex_count; ++cursor)
+			if (live[cursor]) fan = cursor;
+	}
+	memcpy(indices, result, 3 * triangle_count * sizeof(unsigned));
+	free(live);
+	free(offsets);
+	free(adjacency);
+	free(timestamps);
+	free(emitted);
+	free(dead_ends);
+	free(candidates);
+	free(result);
+}
+
+struct Cluster {
+	float key; //Outwardness: sorted in decreasing order
+	unsigned start, end; //Triangles
+};
+
+static int compare_clusters(const void* a, const void* b) {
+	const float x = ((const struct Cluster*) a)->key, y = ((const struct Cluster*) b)->key;
+	return (x < y) - (x > y);
+}
+
+/*
+	Reorder clusters of triangles so those facing outwards are drawn first, reducing overdraw
+	(Sander, Nehab & Barczak 2007). Triangles keep their order within clusters,
+	which should already be optimized for the vertex cache.
+	Clusters end where the cache restarts (every vertex of a triangle misses),
+	or once their ACMR is within threshold times that of the run of triangles they split.
+*/
+void optimize_overdraw(
+	const unsigned index_count,
+	unsigned* const indices,
+	const struct Vertex* const vertices,
+	const unsigned vertex_count,
+	const float threshold) {
+	const unsigned triangle_count = index_count / 3;
+	if (!triangle_count) return;
+	unsigned* const timestamps = calloc(vertex_count, sizeof(unsigned));
+	unsigned time = VERTEX_CACHE_SIZE + 1;
+	//Hard boundaries
+	unsigned* const hard_starts = malloc(triangle_count * sizeof(unsigned));
+	unsigned hard_count = 0;
+	for (unsigned i = 0; i < triangle_count; ++i)
+		if (cache_triangle(indices + 3 * i, timestamps, &time) == 3 || !i) hard_starts[hard_count++] = i;
+	//Soft boundaries within runs between hard boundaries
+	struct Cluster* const clusters = malloc(triangle_count * sizeof(struct Cluster));
+	unsigned cluster_count = 0;
+	for (unsigned i = 0; i < hard_count; ++i) {
+		const unsigned start = hard_starts[i], end = i + 1 < hard_count ? hard_starts[i + 1] : triangle_count;
+		unsigned miss_count = 0;
+		time += VERTEX_CACHE_SIZE;
+		for (unsigned j = start; j < end; ++j)
+			miss_count += cache_triangle(indices + 3 * j, timestamps, &time);
+		const float max_acmr = threshold * miss_count / (end - start);
+		unsigned cluster_start = start;
+		miss_count = 0;
+		time += VERTEX_CACHE_SIZE;
+		for (unsigned j = start; j < end; ++j) {
+			miss_count += cache_triangle(indices + 3 * j, timestamps, &time);
+			if (j + 1 < end && miss_count <= max_acmr * (j + 1 - cluster_start)) {
+				clusters[cluster_count++] = (struct Cluster) {0, cluster_start, j + 1};
+				cluster_start = j + 1;
+				miss_count = 0;
+				time += VERTEX_CACHE_SIZE;
+			}
+		}
+		clusters[cluster_count++] = (struct Cluster) {0, cluster_start, end};
+	}
+	//Area-weighted centers & normals of clusters, & of the primitive
+	vec3* const centers = malloc(cluster_count * sizeof(vec3));
+	vec3* const normals = malloc(cluster_count * sizeof(vec3));
+	vec3 center = {0, 0, 0};
+	float area = 0;
+	for (unsigned i = 0; i < cluster_count; ++i) {
+		float cluster_area = 0;
+		glm_vec3_zero(centers[i]);
+		glm_vec3_zero(normals[i]);
+		for (unsigned j = clusters[i].start; j < clusters[i].end; ++j) {
+			const unsigned* const triangle = indices + 3 * j;
+			float* const a = (float*) vertices[triangle[0]].pos;
+			float* const b = (float*) vertices[triangle[1]].pos;
+			float* const c = (float*) vertices[triangle[2]].pos;
+			vec3 ab, ac, normal, centroid;
+			glm_vec3_sub(b, a, ab);
+			glm_vec3_sub(c, a, ac);
+			glm_vec3_cross(ab, ac, normal);
+			const float triangle_area = glm_vec3_norm(normal);
+			glm_vec3_add(a, b, centroid);
+			glm_vec3_add(centroid, c, centroid);
+			glm_vec3_scale(centroid, triangle_area / 3, centroid);
+			glm_vec3_add(centers[i], centroid, centers[i]);
+			glm_vec3_add(normals[i], normal, normals[i]);
+			cluster_area += triangle_area;
+		}
+		glm_vec3_add(center, centers[i], center);
+		area += cluster_area;
+		if (cluster_area > 0) glm_vec3_scale(centers[i], 1 / cluster_area, centers[i]);
+	}
+	if (area > 0) glm_vec3_scale(center, 1 / area, center);
+	for (unsigned i = 0; i < cluster_count; ++i) {
+		vec3 offset;
+		glm_vec3_sub(centers[i], center, offset);
+		const float length = glm_vec3_norm(normals[i]);
+		clusters[i].key = length > 0 ? glm_vec3_dot(offset, normals[i]) / length : 0;
+	}
+	qsort(clusters, cluster_count, sizeof(struct Cluster), compare_clusters);
+	//Write clusters in order
+	unsigned* const result = malloc(3 * triangle_count * sizeof(unsigned));
+	unsigned output = 0;
+	for (unsigned i = 0; i < cluster_count; ++i) {
+		const unsigned count = 3 * (clusters[i].end - clusters[i].start);
+		memcpy(result + output, indices + 3 * clusters[i].start, count * sizeof(unsigned));
+		output += count;
+	}
+	memcpy(indices, result, 3 * triangle_count * sizeof(unsigned));
+	free(timestamps);
+	free(hard_starts);
+	free(clusters);
+	free(centers);
+	free(normals);
+	free(result);
+}
+
+/*
+	Reorder vertices by first use in the index order, remapping the indices.
+	Unreferenced vertices are removed.
+	Writes the new index of each vertex (~0u if removed) to remap if it isn't NULL.
+	Returns the new vertex count.
+*/
+unsigned optimize_vertex_fetch(
+	const unsigned vertex_count,
+	struct Vertex* const vertices,
+	const unsigned index_count,
+	unsigned* const indices,
+	unsigned* const vertex_remap) {
+	unsigned* const remap = vertex_remap ? vertex_remap : malloc(vertex_count * sizeof(unsigned));
+	memset(remap, 0xFF, vertex_count * sizeof(unsigned));
+	struct Vertex* const reordered = malloc(vertex_count * sizeof(struct Vertex));
+	unsigned count = 0;
+	for (unsigned i = 0; i < index_count; ++i) {
+		if (remap[indices[i]] == ~0u) {
+			remap[indices[i]] = count;
+			reordered[count++] = vertices[indices[i]];
+		}
+		indices[i] = remap[indices[i]];
+	}
+	memcpy(vertices, reordered, count * sizeof(struct Vertex));
+	if (!vertex_remap) free(remap);
+	free(reordered);
+	return count;
+}
@@ -0,0 +1,376 @@
+#include "package.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static uint64_t align_offset(const uint64_t offset, const uint64_t alignment) {
+	const uint64_t rem = offset % alignment;
+	return rem ? offset + alignment - rem : offset;
+}
+
+//Reserve size bytes at the end of the package
+static uint64_t reserve(uint64_t* const size, const uint64_t bytes, const uint64_t alignment) {
+	const uint64_t offset = align_offset(*size, alignment);
+	*size = offset + bytes;
+	return offset;
+}
+
+//Returns true on error
+bool save_package(const char* const filename, const struct Scene* const scene) {
+	struct PackageHeader header = {
+		PACKAGE_MAGIC,
+		PACKAGE_VERSION,
+		sizeof(struct Vertex),
+		sizeof(struct Meshlet),
+		sizeof(struct Lod),
+		sizeof(struct Material),
+		scene->mesh_count,
+		0,
+		scene->node_count,
+		0,
+		scene->material_count,
+		scene->texture_count
+	};
+	for (unsigned i = 0; i < scene->mesh_count; ++i)
+		header.primitive_count += scene->meshes[i].primitive_count;
+	for (unsigned i = 0; i < scene->node_count; ++i)
+		header.child_count += scene->nodes[i].child_count;
+
+	//Layout
+	uint64_t size = sizeof(struct PackageHeader);
+	header.meshes = reserve(&size, header.mesh_count * sizeof(struct PackageMesh), PACKAGE_BLOB_ALIGNMENT);
+	header.primitives = reserve(&size, header.primitive_count * sizeof(struct PackagePrimitive), PACKAGE_BLOB_ALIGNMENT);
+	header.nodes = reserve(&size, header.node_count * sizeof(struct PackageNode), PACKAGE_BLOB_ALIGNMENT);
+	header.children = reserve(&size, header.child_count * sizeof(uint32_t), PACKAGE_BLOB_ALIGNMENT);
+	header.materials = reserve(&size, header.material_count * sizeof(struct Material), PACKAGE_BLOB_ALIGNMENT);
+	header.textures = reserve(&size, header.texture_count * sizeof(struct PackageTexture), PACKAGE_BLOB_ALIGNMENT);
+	struct PackagePrimitive* const primitives = malloc(header.primitive_count * sizeof(struct PackagePrimitive));
+	size = align_offset(size, PACKAGE_PAGE_SIZE);
+	for (unsigned i = 0, k = 0; i < scene->mesh_count; ++i) {
+		const struct Mesh mesh = scene->meshes[i];
+		for (unsigned j = 0; j < mesh.primitive_count; ++j, ++k) {
+			const struct Primitive primitive = mesh.primitives[j];
+			primitives[k] = (struct PackagePrimitive) {
+				primitive.vertex_count,
+				primitive.index_count,
+				reserve(&size, primitive.vertex_count * sizeof(struct Vertex), PACKAGE_BLOB_ALIGNMENT),
+				reserve(&size, primitive.index_count * sizeof(unsigned), PACKAGE_BLOB_ALIGNMENT),
+				primitive.material
+			};
+			memcpy(primitives[k].box_start, primitive.box_start, sizeof(vec3));
+			memcpy(primitives[k].box_end, primitive.box_end, sizeof(vec3));
+			primitives[k].meshlet_count = primitive.meshlet_count;
+			primitives[k].meshlets = reserve(&size, primitive.meshlet_count * sizeof(struct Meshlet), PACKAGE_BLOB_ALIGNMENT);
+			primitives[k].lod_count = primitive.lod_count;
+			primitives[k].lod_index_count = primitive.lod_count
+				? primitive.lods[primitive.lod_count - 1].first_index + primitive.lods[primitive.lod_count - 1].index_count
+				: 0;
+			primitives[k].lods = reserve(&size, primitive.lod_count * sizeof(struct Lod), PACKAGE_BLOB_ALIGNMENT);
+			primitives[k].lod_indices = reserve(&size, primitives[k].lod_index_count * sizeof(unsigned), PACKAGE_BLOB_ALIGNMENT);
+			primitives[k].grid_positions = primitive.grid_positions
+				? reserve(&size, 3 * primitive.vertex_count * sizeof(uint16_t), PACKAGE_BLOB_ALIGNMENT)
+				: 0;
+		}
+	}
+	struct PackageTexture* const textures = malloc(header.texture_count * sizeof(struct PackageTexture));
+	size = align_offset(size, PACKAGE_PAGE_SIZE);
+	for (unsigned i = 0; i < scene->texture_count; ++i) {
+		const SDL_Surface* const texture = scene->textures[i];
+		textures[i] = (struct PackageTexture) {
+			texture->w,
+			texture->h,
+			texture->pitch,
+			reserve(&size, (uint64_t) texture->pitch * texture->h, PACKAGE_BLOB_ALIGNMENT)
+		};
+	}
+	header.size = align_offset(size, PACKAGE_PAGE_SIZE);
+
+	//Contents
+	void* const package = calloc(1, header.size);
+	memcpy(package, &header, sizeof(struct PackageHeader));
+	struct PackageMesh* const meshes = package + header.meshes;
+	for (unsigned i = 0, first = 0; i < scene->mesh_count; ++i) {
+		meshes[i] = (struct PackageMesh) {scene->meshes[i].primitive_count, first};
+		memcpy(meshes[i].box_start, scene->meshes[i].box_start, sizeof(vec3));
+		memcpy(meshes[i].box_end, scene->meshes[i].box_end, sizeof(vec3));
+		memcpy(meshes[i].quantization_offset, scene->meshes[i].quantization_offset, sizeof(vec3));
+		memcpy(meshes[i].quantization_scale, scene->meshes[i].quantization_scale, sizeof(vec3));
+		first += scene->meshes[i].primitive_count;
+	}
+	memcpy(package + header.primitives, primitives, header.primitive_count * sizeof(struct PackagePrimitive));
+	for (unsigned i = 0, k = 0; i < scene->mesh_count; ++i) {
+		const struct Mesh mesh = scene->meshes[i];
+		for (unsigned j = 0; j < mesh.primitive_count; ++j, ++k) {
+			const struct Primitive primitive = mesh.primitives[j];
+			memcpy(package + primitives[k].vertices, primitive.vertices, primitive.vertex_count * sizeof(struct Vertex));
+			memcpy(package + primitives[k].indices, primitive.indices, primitive.index_count * sizeof(unsigned));
+			memcpy(package + primitives[k].meshlets, primitive.meshlets, primitive.meshlet_count * sizeof(struct Meshlet));
+			memcpy(package + primitives[k].lods, primitive.lods, primitive.lod_count * sizeof(struct Lod));
+			memcpy(package + primitives[k].lod_indices, primitive.lod_indices, primitives[k].lod_index_count * sizeof(unsigned));
+			if (primitive.grid_positions)
+				memcpy(package + primitives[k].grid_positions, primitive.grid_positions, 3 * primitive.vertex_count * sizeof(uint16_t));
+		}
+	}
+	struct PackageNode* const nodes = package + header.nodes;
+	uint32_t* const children = package + header.children;
+	for (unsigned i = 0, first = 0; i < scene->node_count; ++i) {
+		const struct Node node = scene->nodes[i];
+		nodes[i] = (struct PackageNode) {
+			node.child_count,
+			first,
+			node.mesh,
+			node.has_mesh,
+			node.dynamic
+		};
+		transforms_get(&scene->transforms, i, nodes[i].translation, nodes[i].rotation, nodes[i].scaling);
+		for (unsigned j = 0; j < node.child_count; ++j)
+			children[first++] = node.children[j];
+	}
+	memcpy(package + header.materials, scene->materials, header.material_count * sizeof(struct Material));
+	memcpy(package + header.textures, textures, header.texture_count * sizeof(struct PackageTexture));
+	for (unsigned i = 0; i < scene->texture_count; ++i) {
+		const SDL_Surface* const texture = scene->textures[i];
+		memcpy(package + textures[i].pixels, texture->pixels, (size_t) texture->pitch * texture->h);
+	}
+	free(textures);
+	free(primitives);
+
+	//Write
+	FILE* const file = fopen(filename, "wb");
+	if (!file) {
+		fprintf(stderr, "Error opening %s for writing!\n", filename);
+		free(package);
+		return true;
+	}
+	const bool error = fwrite(package, 1, header.size, file) != header.size;
+	if (fclose(file) || error) {
+		fprintf(stderr, "Error writing %s!\n", filename);
+		free(package);
+		return true;
+	}
+	free(package);
+	return false;
+}
+
+//Whether count elements at offset are aligned & within a package of size bytes
+static bool in_package(const uint64_t size, const uint64_t offset, const uint64_t count, const uint64_t element_size, const uint64_t alignment) {
+	return offset % alignment == 0 && offset <= size && count <= (size - offset) / element_size;
+}
+
+//Whether [first, first + count) is within [0, end)
+static bool in_range(const uint64_t first, const uint64_t count, const uint64_t end) {
+	return first <= end && count <= end - first;
+}
+
+//Whether every index is below count
+static bool valid_indices(const unsigned count, const unsigned* const indices, const unsigned index_count) {
+	for (unsigned i = 0; i < index_count; ++i)
+		if (indices[i] >= count) return false;
+	return true;
+}
+
+/*
+	Whether every table, blob & index of a package is within it,
+	so a truncated or corrupt package can't be read past its mapping.
+	Nodes must be flattened: each has at most one parent, which precedes it.
+*/
+static bool valid_package(const void* const package, const struct PackageHeader* const header) {
+	const uint64_t size = header->size;
+	if (!in_package(size, header->meshes, header->mesh_count, sizeof(struct PackageMesh), _Alignof(struct PackageMesh))
+		|| !in_package(size, header->primitives, header->primitive_count, sizeof(struct PackagePrimitive), _Alignof(struct PackagePrimitive))
+		|| !in_package(size, header->nodes, header->node_count, sizeof(struct PackageNode), _Alignof(struct PackageNode))
+		|| !in_package(size, header->children, header->child_count, sizeof(uint32_t), _Alignof(uint32_t))
+		|| !in_package(size, header->materials, header->material_count, sizeof(struct Material), _Alignof(struct Material))
+		|| !in_package(size, header->textures, header->texture_count, sizeof(struct PackageTexture), _Alignof(struct PackageTexture)))
+		return false;
+	const struct PackageMesh* const meshes = package + header->meshes;
+	for (unsigned i = 0; i < header->mesh_count; ++i)
+		if (!in_range(meshes[i].first_primitive, meshes[i].primitive_count, header->primitive_count)) return false;
+	const struct PackagePrimitive* const primitives = package + header->primitives;
+	for (unsigned i = 0; i < header->primitive_count; ++i) {
+		const struct PackagePrimitive primitive = primitives[i];
+		if (primitive.material >= header->material_count
+			|| !in_package(size, primitive.vertices, primitive.vertex_count, sizeof(struct Vertex), _Alignof(struct Vertex))
+			|| !in_package(size, primitive.indices, primitive.index_count, sizeof(unsigned), _Alignof(unsigned))
+			|| !in_package(size, primitive.meshlets, primitive.meshlet_count, sizeof(struct Meshlet), _Alignof(struct Meshlet))
+			|| !in_package(size, primitive.lods, primitive.lod_count, sizeof(struct Lod), _Alignof(struct Lod))
+			|| !in_package(size, primitive.lod_indices, primitive.lod_index_count, sizeof(unsigned), _Alignof(unsigned))
+			|| (primitive.grid_positions
+				&& !in_package(size, primitive.grid_positions, primitive.vertex_count, 3 * sizeof(uint16_t), _Alignof(uint16_t)))
+			|| !valid_indices(primitive.vertex_count, package + primitive.indices, primitive.index_count)
+			|| !valid_indices(primitive.vertex_count, package + primitive.lod_indices, primitive.lod_index_count))
+			return false;
+		const struct Meshlet* const meshlets = package + primitive.meshlets;
+		for (unsigned j = 0; j < primitive.meshlet_count; ++j)
+			if (!in_range(meshlets[j].first_index, meshlets[j].index_count, primitive.index_count)) return false;
+		const struct Lod* const lods = package + primitive.lods;
+		for (unsigned j = 0; j < primitive.lod_count; ++j)
+			if (!in_range(lods[j].first_index, lods[j].index_count, primitive.lod_index_count)) return false;
+	}
+	const struct PackageNode* const nodes = package + header->nodes;
+	const uint32_t* const children = package + header->children;
+	bool* const has_parent = calloc(header->node_count, sizeof(bool));
+	bool valid = true;
+	for (unsigned i = 0; valid && i < header->node_count; ++i) {
+		const struct PackageNode node = nodes[i];
+		valid = (!node.has_mesh || node.mesh < header->mesh_count)
+			&& in_range(node.first_child, node.child_count, header->child_count);
+		for (unsigned j = 0; valid && j < node.child_count; ++j) {
+			const uint32_t child = children[node.first_child + j];
+			valid = child > i && child < header->node_count && !has_parent[child];
+			if (valid) has_parent[child] = true;
+		}
+	}
+	free(has_parent);
+	if (!valid) return false;
+	const struct PackageTexture* const textures = package + header->textures;
+	for (unsigned i = 0; i < header->texture_count; ++i) {
+		const struct PackageTexture texture = textures[i];
+		if (texture.pitch / 4 < texture.width
+			|| !in_package(size, texture.pixels, texture.height, texture.pitch ? texture.pitch : 1, 4))
+			return false;
+	}
+	return true;
+}
+
+/*
+	Map a package & point the scene's geometry, hierarchy, materials & pixels into it.
+	Only the small per-mesh, per-node & per-texture arrays are allocated.
+	The mapping is private & writable, so the scene may be modified like a loaded one.
+	Returns true on error.
+*/
+bool load_package(const char* const filename, struct Scene* const output) {
+	const int fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Error opening %s!\n", filename);
+		return true;
+	}
+	struct stat file_stat;
+	if (fstat(fd, &file_stat) || (size_t) file_stat.st_size < sizeof(struct PackageHeader)) {
+		fprintf(stderr, "Error reading %s!\n", filename);
+		close(fd);
+		return true;
+	}
+	void* const package = mmap(NULL, file_stat.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (package == MAP_FAILED) {
+		fprintf(stderr, "Error mapping %s!\n", filename);
+		return true;
+	}
+	const struct PackageHeader* const header = package;
+	if (memcmp(header->magic, PACKAGE_MAGIC, sizeof(PACKAGE_MAGIC))
+		|| header->version != PACKAGE_VERSION
+		|| header->vertex_size != sizeof(struct Vertex)
+		|| header->meshlet_size != sizeof(struct Meshlet)
+		|| header->lod_size != sizeof(struct Lod)
+		|| header->material_size != sizeof(struct Material)
+		|| header->size != (uint64_t) file_stat.st_size) {
+		fprintf(stderr, "Error: %s is not a compatible package!\n", filename);
+		munmap(package, file_stat.st_size);
+		return true;
+	}
+	if (!valid_package(package, header)) {
+		fprintf(stderr, "Error: %s is truncated or corrupt!\n", filename);
+		munmap(package, file_stat.st_size);
+		return true;
+	}
+	//Sequential access for the geometry & pixels about to be uploaded
+	madvise(package, header->size, MADV_SEQUENTIAL);
+
+	struct Scene scene = {
+		header->mesh_count,
+		malloc(header->mesh_count * sizeof(struct Mesh)),
+		header->node_count,
+		malloc(header->node_count * sizeof(struct Node)),
+		header->material_count,
+		package + header->materials,
+		header->texture_count,
+		malloc(header->texture_count * sizeof(SDL_Surface*)),
+		NULL, NULL, {}, 0, NULL, 0, NULL, //Hierarchy, built by scene_flatten
+		package,
+		header->size
+	};
+	//Meshes
+	const struct PackageMesh* const meshes = package + header->meshes;
+	const struct PackagePrimitive* const primitives = package + header->primitives;
+	for (unsigned i = 0; i < scene.mesh_count; ++i) {
+		struct Mesh mesh = {
+			meshes[i].primitive_count,
+			malloc(meshes[i].primitive_count * sizeof(struct Primitive))
+		};
+		memcpy(mesh.box_start, meshes[i].box_start, sizeof(vec3));
+		memcpy(mesh.box_end, meshes[i].box_end, sizeof(vec3));
+		memcpy(mesh.quantization_offset, meshes[i].quantization_offset, sizeof(vec3));
+		memcpy(mesh.quantization_scale, meshes[i].quantization_scale, sizeof(vec3));
+		for (unsigned j = 0; j < mesh.primitive_count; ++j) {
+			const struct PackagePrimitive primitive = primitives[meshes[i].first_primitive + j];
+			mesh.primitives[j] = (struct Primitive) {
+				primitive.vertex_count,
+				package + primitive.vertices,
+				primitive.index_count,
+				package + primitive.indices,
+				primitive.material
+			};
+			memcpy(mesh.primitives[j].box_start, primitive.box_start, sizeof(vec3));
+			memcpy(mesh.primitives[j].box_end, primitive.box_end, sizeof(vec3));
+			mesh.primitives[j].meshlet_count = primitive.meshlet_count;
+			mesh.primitives[j].meshlets = package + primitive.meshlets;
+			mesh.primitives[j].lod_count = primitive.lod_count;
+			mesh.primitives[j].lods = package + primitive.lods;
+			mesh.primitives[j].lod_indices = package + primitive.lod_indices;
+			mesh.primitives[j].grid_positions = primitive.grid_positions ? package + primitive.grid_positions : NULL;
+		}
+		scene.meshes[i] = mesh;
+	}
+	//Nodes
+	const struct PackageNode* const nodes = package + header->nodes;
+	uint32_t* const children = package + header->children;
+	create_transforms(scene.node_count, &scene.transforms);
+	for (unsigned i = 0; i < scene.node_count; ++i) {
+		const struct PackageNode node = nodes[i];
+		scene.nodes[i] = (struct Node) {
+			node.child_count,
+			children + node.first_child,
+			node.has_mesh,
+			node.mesh,
+			node.dynamic,
+			true,
+			false
+		};
+		transforms_set(&scene.transforms, i, node.translation, node.rotation, node.scaling);
+	}
+	scene_flatten(&scene);
+	//Textures (surfaces borrow the mapped pixels)
+	const struct PackageTexture* const textures = package + header->textures;
+	for (unsigned i = 0; i < scene.texture_count; ++i) {
+		scene.textures[i] = SDL_CreateRGBSurfaceWithFormatFrom(
+			package + textures[i].pixels,
+			textures[i].width,
+			textures[i].height,
+			32,
+			textures[i].pitch,
+			SDL_PIXELFORMAT_BGRA32
+		);
+	}
+	*output = scene;
+	return false;
+}
+
+/*
+	Load a package or a glTF scene depending on the extension.
+	glTF primitives are optimized if optimization isn't NULL (packages are optimized when cooked, see lightrail-cook).
+*/
+bool load_scene_file(
+	const char* const filename,
+	struct JobSystem* const jobs,
+	struct OptimizationStats* const optimization,
+	struct Scene* const output) {
+	const size_t length = strlen(filename), extension_length = strlen(PACKAGE_EXTENSION);
+	if (length >= extension_length && !strcmp(filename + length - extension_length, PACKAGE_EXTENSION))
+		return load_package(filename, output);
+	return load_scene(filename, jobs, optimization, output);
+}
@@ -0,0 +1,57 @@
+#include "quantize.h"
+#include <math.h>
+#include <string.h>
+
+//Nearest half float (rounding to even, overflowing to infinity)
+uint16_t half_float(const float value) {
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(float));
+	const uint16_t sign = bits >> 16 & 0x8000;
+	const uint32_t magnitude = bits & 0x7FFFFFFF;
+	if (magnitude > 0x7F800000) return sign | 0x7E00; //NaN
+	if (magnitude >= 0x477FF000) return sign | 0x7C00; //Rounds to at least 65520
+	if (magnitude < 0x38800000) return sign | (uint16_t) nearbyintf(fabsf(value) * 16777216); //Subnormal (units of 2^-24)
+	//Rebias the exponent & round the mantissa's dropped 13 bits
+	return sign | (magnitude + 0xFFF + (magnitude >> 13 & 1) - 0x38000000) >> 13;
+}
+
+//Unit vector projected onto an octahedron, unfolded into a square
+void encode_octahedral(const vec3 normal, int16_t* const result) {
+	const float length = fabsf(normal[0]) + fabsf(normal[1]) + fabsf(normal[2]);
+	float x = length > 0 ? normal[0] / length : 0, y = length > 0 ? normal[1] / length : 0;
+	if (normal[2] < 0) {
+		//Fold the lower half over the diagonals
+		const float folded_x = (1 - fabsf(y)) * (x >= 0 ? 1 : -1);
+		y = (1 - fabsf(x)) * (y >= 0 ? 1 : -1);
+		x = folded_x;
+	}
+	result[0] = lroundf(x * INT16_MAX);
+	result[1] = lroundf(y * INT16_MAX);
+}
+
+/*
+	Convert vertices to the compact layout.
+	Positions are copied from grid_positions if it isn't NULL (already on the grid),
+	else rounded to the grid offset + scale * [0, 65535] (per axis).
+*/
+void quantize_vertices(
+	const unsigned count,
+	const struct Vertex* const vertices,
+	const uint16_t* const grid_positions,
+	const vec3 offset,
+	const vec3 scale,
+	struct CompactVertex* const result) {
+	for (unsigned i = 0; i < count; ++i) {
+		const struct Vertex vertex = vertices[i];
+		struct CompactVertex* const compact = result + i;
+		if (grid_positions) memcpy(compact->position, grid_positions + 3 * i, sizeof(compact->position));
+		else for (unsigned j = 0; j < 3; ++j) {
+			const float position = scale[j] > 0 ? (vertex.pos[j] - offset[j]) / scale[j] : 0;
+			compact->position[j] = fminf(fmaxf(roundf(position), 0), UINT16_MAX);
+		}
+		compact->padding = 0;
+		encode_octahedral(vertex.normal, compact->normal);
+		compact->tex[0] = half_float(vertex.tex[0]);
+		compact->tex[1] = half_float(vertex.tex[1]);
+	}
+}
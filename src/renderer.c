@@ -1,11 +1,20 @@
 #include "renderer.h"
 #include "vulkan/vulkan_core.h"
+#include <math.h>
 #include <stdio.h>
+#include <string.h>
 #include <SDL2/SDL_vulkan.h>
 #include <cglm/mat4.h>
 
 #define REQUIRED_EXT_COUNT 2
 #define MAX_TEXTURE_COUNT 8
+#define CULL_GRAIN 1024 //Nodes per job culling or writing draws on the CPU
+//Software occlusion culling
+#define OCCLUSION_BUFFER_WIDTH 256
+#define OCCLUSION_BUFFER_HEIGHT 128
+#define OCCLUDER_MAX_TRIANGLES 4096 //Meshes with more aren't occluders
+#define OCCLUDER_MIN_AREA 0.01f //Fraction of the screen an occluder's bounds cover
+#define OCCLUDER_TRIANGLE_BUDGET 32768 //Rasterized per frame
 
 struct LocalCamera {
 	mat4 view, projection;
@@ -22,6 +31,68 @@ struct LocalNode {
 	mat4 transformation;
 };
 
+//Mesh-space bounding box, detail levels & node of a draw
+struct LocalBounds {
+	vec4 center, extent;
+	uint32_t first_lod, lod_count;
+	uint32_t node;
+	uint32_t padding;
+};
+
+//Per-draw data of the vertex stage (indexed by the draw's instance)
+struct LocalDraw {
+	uint32_t node, material;
+};
+
+//Position grid of a node's mesh (compact vertices)
+struct LocalQuantization {
+	vec4 offset, scale;
+};
+
+//Meshlet with its indices & vertices offset to its primitive's in the static buffers
+struct LocalMeshlet {
+	vec4 sphere; //Mesh-space center & radius
+	vec4 cone; //Axis & cutoff
+	uint32_t first_index, index_count;
+	int32_t vertex_offset;
+	uint32_t padding;
+};
+
+//Meshlet of a draw (its primitive's), drawn by meshlet culling
+struct LocalMeshletDraw {
+	uint32_t draw, meshlet;
+};
+
+//Culling phases (see cull.comp)
+enum CullPhase {CULL_FRUSTUM, CULL_EARLY, CULL_LATE, CULL_MESHLETS};
+
+//Push constants of the culling pass
+struct CullConstants {
+	vec4 frustum[6];
+	unsigned draw_count; //Or meshlet draw count
+	uint32_t phase; //enum CullPhase
+	float pyramid_size[2];
+	float viewport_size[2];
+	float lod_threshold; //0 for full detail
+	uint32_t instance_count; //Of a list's instance groups (0 without instancing)
+};
+
+//Visible node whose mesh may occlude others
+struct OccluderCandidate {
+	float area; //Fraction of the screen covered by its bounds
+	unsigned node;
+};
+
+//Counters written by the culling pass
+struct LocalStats {
+	uint32_t draw_count;
+	uint32_t frustum_culled_count, occlusion_culled_count;
+	uint32_t cluster_culled_count;
+	uint32_t culled_triangle_count;
+	uint32_t triangle_count;
+	uint32_t command_count;
+};
+
 static VkShaderModule create_shader_module(
 	const struct Renderer* const r,
 	const char* filename) {
@@ -43,9 +114,10 @@ static VkShaderModule create_shader_module(
 	return result;
 }
 
-static VkResult create_pipeline(struct Renderer* const r) {
+//Graphics pipeline for the full (float) or compact vertex layout
+static VkResult create_pipeline(struct Renderer* const r, const bool compact, VkPipeline* const pipeline) {
 	//Shaders
-	const VkShaderModule vertex_shader = create_shader_module(r, "shaders/basic.vert.spv"),
+	const VkShaderModule vertex_shader = create_shader_module(r, compact ? "shaders/compact.vert.spv" : "shaders/basic.vert.spv"),
 		fragment_shader = create_shader_module(r, "shaders/basic.frag.spv");
 	const VkPipelineShaderStageCreateInfo shader_stages[2] = {
 		//Vertex stage
@@ -68,19 +140,23 @@ static VkResult create_pipeline(struct Renderer* const r) {
 	//Vertex input
 	const VkVertexInputBindingDescription binding_description = {
 		0,
-		sizeof(struct Vertex),
+		compact ? sizeof(struct CompactVertex) : sizeof(struct Vertex),
 		VK_VERTEX_INPUT_RATE_VERTEX
 	};
 	const VkVertexInputAttributeDescription attribute_descriptions[] = {
 		{0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(struct Vertex, pos)}, //Position
 		{1, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(struct Vertex, normal)}, //Normal
-		{2, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(struct Vertex, tex)}, //Texture
-		{3, 0, VK_FORMAT_R32_UINT, offsetof(struct Vertex, material)} //Material
+		{2, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(struct Vertex, tex)} //Texture
+	};
+	const VkVertexInputAttributeDescription compact_attribute_descriptions[] = {
+		{0, 0, VK_FORMAT_R16G16B16A16_UINT, offsetof(struct CompactVertex, position)}, //Quantized position (& padding)
+		{1, 0, VK_FORMAT_R16G16_SNORM, offsetof(struct CompactVertex, normal)}, //Octahedral normal
+		{2, 0, VK_FORMAT_R16G16_SFLOAT, offsetof(struct CompactVertex, tex)} //Texture
 	};
 	const VkPipelineVertexInputStateCreateInfo vertex_input = {
 		VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO, NULL, 0,
 		1, &binding_description,
-		4, attribute_descriptions
+		3, compact ? compact_attribute_descriptions : attribute_descriptions
 	};
 	//Input assembly
 	const VkPipelineInputAssemblyStateCreateInfo input_assembly = {
@@ -161,7 +237,6 @@ static VkResult create_pipeline(struct Renderer* const r) {
 	};
 
 	//Create pipeline
-	VkPipeline pipeline;
 	const VkGraphicsPipelineCreateInfo pipeline_info = {
 		VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO, NULL, 0,
 		2, shader_stages,
@@ -179,7 +254,7 @@ static VkResult create_pipeline(struct Renderer* const r) {
 		0
 	};
 	const VkResult result = vkCreateGraphicsPipelines(
-		r->device, r->pipeline_cache, 1, &pipeline_info, NULL, &r->pipeline
+		r->device, r->pipeline_cache, 1, &pipeline_info, NULL, pipeline
 	);
 
 	//Cleanup
@@ -188,6 +263,30 @@ static VkResult create_pipeline(struct Renderer* const r) {
 	return result;
 }
 
+static VkResult create_compute_pipeline(
+	struct Renderer* const r,
+	const char* const filename,
+	const VkPipelineLayout layout,
+	VkPipeline* const pipeline) {
+	const VkShaderModule compute_shader = create_shader_module(r, filename);
+	const VkComputePipelineCreateInfo pipeline_info = {
+		VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO, NULL, 0,
+		{
+			VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, NULL, 0,
+			VK_SHADER_STAGE_COMPUTE_BIT,
+			compute_shader,
+			"main"
+		},
+		layout,
+		VK_NULL_HANDLE, 0
+	};
+	const VkResult result = vkCreateComputePipelines(
+		r->device, r->pipeline_cache, 1, &pipeline_info, NULL, pipeline
+	);
+	vkDestroyShaderModule(r->device, compute_shader, NULL);
+	return result;
+}
+
 static void create_resolution(struct Renderer* const r, unsigned width, unsigned height) {
 	r->resolution = (VkExtent2D) {width, height};
 	//Attachment descriptions
@@ -253,13 +352,171 @@ static void create_resolution(struct Renderer* const r, unsigned width, unsigned
 		0, NULL
 	};
 	vkCreateRenderPass(r->device, &render_pass_info, NULL, &r->render_pass);
-	//Pipeline
-	create_pipeline(r);
+	//Render pass continuing from the contents of the color & depth attachments (compatible with the first)
+	VkAttachmentDescription load_attachments[3];
+	memcpy(load_attachments, attachments, sizeof(attachments));
+	load_attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	load_attachments[0].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	load_attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	load_attachments[2].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	load_attachments[2].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	const VkRenderPassCreateInfo load_render_pass_info = {
+		VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO, NULL, 0,
+		3, load_attachments,
+		1, &subpass_description,
+		0, NULL
+	};
+	vkCreateRenderPass(r->device, &load_render_pass_info, NULL, &r->load_render_pass);
+	//Pipelines
+	create_pipeline(r, false, &r->pipeline);
+	create_pipeline(r, true, &r->compact_pipeline);
 }
 
 static void destroy_resolution(struct Renderer* const r) {
 	vkDestroyPipeline(r->device, r->pipeline, NULL);
+	vkDestroyPipeline(r->device, r->compact_pipeline, NULL);
 	vkDestroyRenderPass(r->device, r->render_pass, NULL);
+	vkDestroyRenderPass(r->device, r->load_render_pass, NULL);
+}
+
+static unsigned previous_power_of_2(const unsigned x) {
+	unsigned result = 1;
+	while (2 * result <= x) result *= 2;
+	return result;
+}
+
+//Depth pyramid & its reduction descriptors (per frame, as each frame has its own depth image)
+static void create_depth_pyramid(struct Renderer* const r) {
+	r->pyramid_extent = (VkExtent2D) {
+		previous_power_of_2(r->resolution.width),
+		previous_power_of_2(r->resolution.height)
+	};
+	const unsigned max_extent = r->pyramid_extent.width > r->pyramid_extent.height
+		? r->pyramid_extent.width
+		: r->pyramid_extent.height;
+	r->pyramid_level_count = 1;
+	while (max_extent >> r->pyramid_level_count) ++r->pyramid_level_count;
+	const unsigned level_count = r->pyramid_level_count;
+	//Image
+	const VkImageCreateInfo image_info = {
+		VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO, NULL, 0,
+		VK_IMAGE_TYPE_2D,
+		VK_FORMAT_R32_SFLOAT,
+		{r->pyramid_extent.width, r->pyramid_extent.height, 1},
+		level_count,
+		1,
+		VK_SAMPLE_COUNT_1_BIT,
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		VK_SHARING_MODE_EXCLUSIVE,
+		0, NULL,
+		VK_IMAGE_LAYOUT_UNDEFINED
+	};
+	if (create_images(
+		&r->allocator,
+		1, &image_info,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		&r->pyramid,
+		&r->pyramid_alloc
+	)) fprintf(stderr, "Error creating depth pyramid!\n");
+	//Image views
+	VkImageViewCreateInfo view_info = {
+		VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO, NULL, 0,
+		r->pyramid,
+		VK_IMAGE_VIEW_TYPE_2D,
+		VK_FORMAT_R32_SFLOAT,
+		{
+			VK_COMPONENT_SWIZZLE_IDENTITY,
+			VK_COMPONENT_SWIZZLE_IDENTITY,
+			VK_COMPONENT_SWIZZLE_IDENTITY,
+			VK_COMPONENT_SWIZZLE_IDENTITY
+		},
+		{VK_IMAGE_ASPECT_COLOR_BIT, 0, level_count, 0, 1}
+	};
+	vkCreateImageView(r->device, &view_info, NULL, &r->pyramid_view);
+	r->pyramid_level_views = malloc(level_count * sizeof(VkImageView));
+	for (unsigned i = 0; i < level_count; ++i) {
+		view_info.subresourceRange.baseMipLevel = i;
+		view_info.subresourceRange.levelCount = 1;
+		vkCreateImageView(r->device, &view_info, NULL, r->pyramid_level_views + i);
+	}
+	//Descriptor sets
+	const unsigned set_count = r->frame_count * level_count;
+	const VkDescriptorPoolSize pool_sizes[] = {
+		{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, set_count},
+		{VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2 * set_count}
+	};
+	const VkDescriptorPoolCreateInfo pool_info = {
+		VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO, NULL, 0,
+		set_count,
+		2, pool_sizes
+	};
+	vkCreateDescriptorPool(r->device, &pool_info, NULL, &r->pyramid_descriptor_pool);
+	VkDescriptorSetLayout* const layouts = malloc(set_count * sizeof(VkDescriptorSetLayout));
+	for (unsigned i = 0; i < set_count; ++i)
+		layouts[i] = r->pyramid_descriptor_set_layout;
+	const VkDescriptorSetAllocateInfo set_alloc_info = {
+		VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO, NULL,
+		r->pyramid_descriptor_pool,
+		set_count, layouts
+	};
+	r->pyramid_descriptor_sets = malloc(set_count * sizeof(VkDescriptorSet));
+	vkAllocateDescriptorSets(r->device, &set_alloc_info, r->pyramid_descriptor_sets);
+	free(layouts);
+	/*
+		Each level reads the previous one.
+		Level 0 reads the frame's depth image instead,
+		but its source must still be a valid image: the last level, written only after it.
+	*/
+	VkDescriptorImageInfo* const image_infos = malloc(3 * set_count * sizeof(VkDescriptorImageInfo));
+	VkWriteDescriptorSet* const writes = malloc(3 * set_count * sizeof(VkWriteDescriptorSet));
+	for (unsigned i = 0; i < r->frame_count; ++i) {
+		for (unsigned j = 0; j < level_count; ++j) {
+			const unsigned set = i * level_count + j;
+			VkDescriptorImageInfo* const infos = image_infos + 3 * set;
+			infos[0] = (VkDescriptorImageInfo) {
+				VK_NULL_HANDLE,
+				r->image_views[3 * i + 2],
+				VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL
+			};
+			infos[1] = (VkDescriptorImageInfo) {
+				VK_NULL_HANDLE,
+				r->pyramid_level_views[j ? j - 1 : level_count - 1],
+				VK_IMAGE_LAYOUT_GENERAL
+			};
+			infos[2] = (VkDescriptorImageInfo) {
+				VK_NULL_HANDLE,
+				r->pyramid_level_views[j],
+				VK_IMAGE_LAYOUT_GENERAL
+			};
+			for (unsigned k = 0; k < 3; ++k)
+				writes[3 * set + k] = (VkWriteDescriptorSet) {
+					VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL,
+					r->pyramid_descriptor_sets[set],
+					k, //Binding
+					0,
+					1,
+					k ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+					infos + k,
+					NULL,
+					NULL
+				};
+		}
+	}
+	vkUpdateDescriptorSets(r->device, 3 * set_count, writes, 0, NULL);
+	free(writes);
+	free(image_infos);
+}
+
+static void destroy_depth_pyramid(struct Renderer* const r) {
+	vkDestroyDescriptorPool(r->device, r->pyramid_descriptor_pool, NULL);
+	free(r->pyramid_descriptor_sets);
+	for (unsigned i = 0; i < r->pyramid_level_count; ++i)
+		vkDestroyImageView(r->device, r->pyramid_level_views[i], NULL);
+	free(r->pyramid_level_views);
+	vkDestroyImageView(r->device, r->pyramid_view, NULL);
+	vkDestroyImage(r->device, r->pyramid, NULL);
+	free_allocation(&r->allocator, r->pyramid_alloc);
 }
 
 static void create_frames(struct Renderer* const r, unsigned frame_count) {
@@ -315,7 +572,8 @@ static void create_frames(struct Renderer* const r, unsigned frame_count) {
 			1,
 			VK_SAMPLE_COUNT_4_BIT,
 			VK_IMAGE_TILING_OPTIMAL,
-			VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+			VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT
+			| VK_IMAGE_USAGE_SAMPLED_BIT, //Depth pyramid source
 			VK_SHARING_MODE_EXCLUSIVE,
 			0, NULL,
 			VK_IMAGE_LAYOUT_UNDEFINED,
@@ -326,8 +584,7 @@ static void create_frames(struct Renderer* const r, unsigned frame_count) {
 		memcpy(all_image_infos + 3 * i, image_infos, sizeof(image_infos));
 	r->images = malloc(3 * frame_count * sizeof(VkImage));
 	create_images(
-		r->physical_device,
-		r->device,
+		&r->allocator,
 		3 * frame_count, all_image_infos,
 		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 		r->images,
@@ -401,15 +658,16 @@ static void create_frames(struct Renderer* const r, unsigned frame_count) {
 	vkAllocateCommandBuffers(r->device, &command_buffer_alloc_info, r->command_buffers);
 	//Descriptor pool
 	const VkDescriptorPoolSize pool_sizes[] = {
-		{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, frame_count},
-		{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2 * frame_count},
+		{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2 * frame_count}, //Rendering & culling
+		{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, (5 + 13) * frame_count},
 		{VK_DESCRIPTOR_TYPE_SAMPLER, frame_count},
-		{VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, MAX_TEXTURE_COUNT * frame_count}
+		{VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, MAX_TEXTURE_COUNT * frame_count},
+		{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, frame_count} //Depth pyramid
 	};
 	const VkDescriptorPoolCreateInfo descriptor_pool_info = {
 		VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO, NULL, 0,
-		frame_count,
-		4, pool_sizes
+		2 * frame_count,
+		5, pool_sizes
 	};
 	vkCreateDescriptorPool(r->device, &descriptor_pool_info, NULL, &r->descriptor_pool);
 	//Allocate descriptor sets
@@ -423,7 +681,47 @@ static void create_frames(struct Renderer* const r, unsigned frame_count) {
 	};
 	r->descriptor_sets = malloc(frame_count * sizeof(VkDescriptorSet));
 	vkAllocateDescriptorSets(r->device, &descriptor_set_alloc_info, r->descriptor_sets);
+	for (unsigned i = 0; i < frame_count; ++i)
+		all_descriptor_set_layouts[i] = r->cull_descriptor_set_layout;
+	r->cull_descriptor_sets = malloc(frame_count * sizeof(VkDescriptorSet));
+	vkAllocateDescriptorSets(r->device, &descriptor_set_alloc_info, r->cull_descriptor_sets);
 	free(all_descriptor_set_layouts);
+	create_depth_pyramid(r);
+	//Statistics
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(r->physical_device, &properties);
+	uint32_t queue_family_count;
+	vkGetPhysicalDeviceQueueFamilyProperties(r->physical_device, &queue_family_count, NULL);
+	VkQueueFamilyProperties* const queue_families = malloc(queue_family_count * sizeof(VkQueueFamilyProperties));
+	vkGetPhysicalDeviceQueueFamilyProperties(r->physical_device, &queue_family_count, queue_families);
+	r->timestamp_period = queue_families[r->graphics_queue_family].timestampValidBits
+		? properties.limits.timestampPeriod
+		: 0;
+	free(queue_families);
+	const VkQueryPoolCreateInfo query_pool_info = {
+		VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO, NULL, 0,
+		VK_QUERY_TYPE_TIMESTAMP,
+		2 * frame_count,
+		0
+	};
+	vkCreateQueryPool(r->device, &query_pool_info, NULL, &r->query_pool);
+	r->stats_stride = align_size(sizeof(struct LocalStats), properties.limits.minStorageBufferOffsetAlignment);
+	const VkBufferCreateInfo stats_buffer_info = {
+		VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, NULL, 0,
+		frame_count * r->stats_stride,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_SHARING_MODE_EXCLUSIVE,
+		0, NULL
+	};
+	if (create_buffers(
+		&r->allocator,
+		1, &stats_buffer_info,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		&r->stats_buffer,
+		&r->stats_alloc
+	)) fprintf(stderr, "Error creating statistics buffer!\n");
+	memset(&r->stats, 0, sizeof(struct RenderStats));
+	r->submitted_count = 0;
 	//Semaphores
 	const VkSemaphoreCreateInfo semaphore_info = {VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO, NULL, 0};
 	r->semaphores = malloc(2 * frame_count * sizeof(VkSemaphore));
@@ -442,6 +740,11 @@ static void create_frames(struct Renderer* const r, unsigned frame_count) {
 
 static void destroy_frames(struct Renderer* const r) {
 	const unsigned frame_count = r->frame_count;
+	//Statistics
+	vkDestroyBuffer(r->device, r->stats_buffer, NULL);
+	free_allocation(&r->allocator, r->stats_alloc);
+	vkDestroyQueryPool(r->device, r->query_pool, NULL);
+	destroy_depth_pyramid(r);
 	//Fences
 	for (unsigned i = 0; i < frame_count; ++i)
 		vkDestroyFence(r->device, r->fences[i], NULL);
@@ -453,6 +756,7 @@ static void destroy_frames(struct Renderer* const r) {
 	//Descriptors
 	vkDestroyDescriptorPool(r->device, r->descriptor_pool, NULL);
 	free(r->descriptor_sets);
+	free(r->cull_descriptor_sets);
 	//Command buffers
 	vkFreeCommandBuffers(r->device, r->command_pool, frame_count, r->command_buffers);
 	free(r->command_buffers);
@@ -467,80 +771,42 @@ static void destroy_frames(struct Renderer* const r) {
 	}
 	free(r->image_views);
 	free(r->images);
-	free_allocation(r->device, r->image_alloc);
+	free_allocation(&r->allocator, r->image_alloc);
 }
 
 static void create_frame_data(
 	struct Renderer* const r,
-	const VkDeviceSize staging_size,
 	const VkDeviceSize uniform_size,
-	const VkDeviceSize storage_size) {
-	//Set sizes
-	r->staging_size = staging_size;
+	const VkDeviceSize storage_size,
+	const VkDeviceSize draw_size,
+	const VkDeviceSize instance_size) {
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(r->physical_device, &properties);
+	//Region layout (matrices are written in place, so keep them aligned)
+	VkDeviceSize storage_alignment = properties.limits.minStorageBufferOffsetAlignment;
+	if (storage_alignment < _Alignof(mat4)) storage_alignment = _Alignof(mat4);
+	r->uniform_offset = 0;
 	r->uniform_size = uniform_size;
+	r->storage_offset = align_size(uniform_size, storage_alignment);
 	r->storage_size = storage_size;
-	//Create staging buffer
-	const VkBufferCreateInfo staging_buffer_info = {
-		VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, NULL, 0,
-		r->frame_count * staging_size,
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_SHARING_MODE_EXCLUSIVE,
-		0, NULL
-	};
-	create_buffers(
-		r->physical_device,
-		r->device,
-		1, &staging_buffer_info,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-		&r->staging_buffer,
-		&r->staging_alloc
-	);
-	//Create frame buffers
-	const VkBufferCreateInfo buffer_infos[] = {
-		//Uniform buffer
-		{
-			VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, NULL, 0,
-			uniform_size,
-			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT
-				| VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-			VK_SHARING_MODE_EXCLUSIVE,
-			0, NULL
-		},
-		//Storage buffer
-		{
-			VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, NULL, 0,
-			storage_size,
-			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
-				| VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-			VK_SHARING_MODE_EXCLUSIVE,
-			0, NULL
-		},
-	};
-	const unsigned buffer_count = 2 * r->frame_count;
-	VkBufferCreateInfo* const all_buffer_infos = malloc(buffer_count * sizeof(VkBufferCreateInfo));
-	for (unsigned i = 0; i < r->frame_count; ++i)
-		memcpy(all_buffer_infos + 2 * i, buffer_infos, sizeof(buffer_infos));
-	r->frame_buffers = malloc(buffer_count * sizeof(VkBuffer));
-	create_buffers(
-		r->physical_device,
-		r->device,
-		buffer_count, all_buffer_infos,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		r->frame_buffers,
-		&r->frame_buffer_alloc
-	);
-	free(all_buffer_infos);
+	r->draw_offset = align_size(r->storage_offset + storage_size, sizeof(VkDrawIndexedIndirectCommand));
+	r->draw_size = draw_size;
+	r->instance_offset = align_size(r->draw_offset + draw_size, storage_alignment);
+	r->instance_size = instance_size;
+	//Create ring
+	if (create_frame_ring(
+		&r->allocator,
+		r->frame_count,
+		r->instance_offset + instance_size,
+		VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT
+		| VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+		| VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+		&r->frame_data
+	)) fprintf(stderr, "Error creating frame data!\n");
 }
 
 static void destroy_frame_data(struct Renderer* const r) {
-	//Staging buffer
-	vkDestroyBuffer(r->device, r->staging_buffer, NULL);
-	free_allocation(r->device, r->staging_alloc);
-	//Frame buffers
-	for (unsigned i = 0; i < 2 * r->frame_count; ++i)
-		vkDestroyBuffer(r->device, r->frame_buffers[i], NULL);
-	free(r->frame_buffers);
-	free_allocation(r->device, r->frame_buffer_alloc);
+	destroy_frame_ring(&r->allocator, r->frame_data);
 }
 
 static bool create_swapchain(struct Renderer* const r, bool old) {
@@ -653,178 +919,10 @@ static void save_pipeline_cache(struct Renderer* const r) {
 	fclose(pipeline_cache_file);
 }
 
-static void staged_buffer_write(
-	//Vulkan objects
-	const VkPhysicalDevice physical_device,
-	const VkDevice device,
-	const VkCommandBuffer command_buffer,
-	const VkQueue queue,
-	//Parameters
-	const unsigned count,
-	VkBuffer* const dst_buffers,
-	const void** const data,
-	const VkDeviceSize* sizes) {
-	VkDeviceSize total_size = 0;
-	VkDeviceSize* const offsets = malloc(count * sizeof(VkDeviceSize));
-	for (unsigned i = 0; i < count; ++i) {
-		offsets[i] = total_size;
-		total_size += sizes[i];
-	}
-	//Create staging buffer
-	const VkBufferCreateInfo staging_buffer_info = {
-		VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, NULL, 0,
-		total_size,
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_SHARING_MODE_EXCLUSIVE,
-		0, NULL
-	};
-	VkBuffer staging_buffer;
-	struct Allocation staging_alloc;
-	create_buffers(
-		physical_device, device,
-		1, &staging_buffer_info,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
-		| VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		&staging_buffer,
-		&staging_alloc
-	);
-	//Write to staging buffer
-	void* buffer_data;
-	for (unsigned i = 0; i < count; ++i) {
-		vkMapMemory(device, staging_alloc.memory, offsets[i], sizes[i], 0, &buffer_data);
-		memcpy(buffer_data, data[i], sizes[i]);
-		vkUnmapMemory(device, staging_alloc.memory);
-	}
-	//Record commands for transfer
-	const VkCommandBufferBeginInfo begin_info = {
-		VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, NULL,
-		VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
-	};
-	vkBeginCommandBuffer(command_buffer, &begin_info);
-	for (unsigned i = 0; i < count; ++i) {
-		const VkBufferCopy region = {offsets[i], 0, sizes[i]};
-		vkCmdCopyBuffer(command_buffer, staging_buffer, dst_buffers[i], 1, &region);
-	}
-	vkEndCommandBuffer(command_buffer);
-	//Submit to queue
-	const VkSubmitInfo submit_info = {
-		VK_STRUCTURE_TYPE_SUBMIT_INFO, NULL,
-		0, NULL,
-		0,
-		1, &command_buffer,
-		0, NULL
-	};
-	vkQueueSubmit(queue, 1, &submit_info, VK_NULL_HANDLE);
-	vkQueueWaitIdle(queue); //TODO: Better synchronization
-	free(offsets);
-	vkDestroyBuffer(device, staging_buffer, NULL);
-	free_allocation(device, staging_alloc);
-}
-
-static void copy_buffer_to_images(
-	//Vulkan objects
-	const VkCommandBuffer command_buffer,
-	const VkQueue queue,
-	//Parameters
-	const VkBuffer src_buffer,
-	const unsigned count,
-	VkImage* const images,
-	VkBufferImageCopy* const regions,
-	const VkImageLayout layout) {
-	//Record command buffer
-	const VkCommandBufferBeginInfo begin_info = {
-		VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, NULL,
-		VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
-	};
-	vkBeginCommandBuffer(command_buffer, &begin_info);
-	//Image layout transition
-	const VkImageSubresourceRange color_subresource_range = {
-		VK_IMAGE_ASPECT_COLOR_BIT,
-		0, 1,
-		0, 1
-	};
-	VkImageMemoryBarrier2* const before_image_barriers
-		= malloc(count * sizeof(VkImageMemoryBarrier2));
-	for (unsigned i = 0; i < count; ++i)
-		before_image_barriers[i] = (VkImageMemoryBarrier2) {
-			VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2, NULL,
-			VK_PIPELINE_STAGE_2_NONE,
-			VK_ACCESS_2_NONE,
-			VK_PIPELINE_STAGE_2_COPY_BIT,
-			VK_ACCESS_2_TRANSFER_WRITE_BIT,
-			VK_IMAGE_LAYOUT_UNDEFINED,
-			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			VK_QUEUE_FAMILY_IGNORED,
-			VK_QUEUE_FAMILY_IGNORED,
-			images[i],
-			color_subresource_range
-		};
-	const VkDependencyInfo before_copy_dependency = {
-		VK_STRUCTURE_TYPE_DEPENDENCY_INFO, NULL, 0,
-		0, NULL,
-		0, NULL,
-		count, before_image_barriers
-	};
-	vkCmdPipelineBarrier2(command_buffer, &before_copy_dependency);
-	//Image copy command
-	for (unsigned i = 0; i < count; ++i)
-		vkCmdCopyBufferToImage(
-			command_buffer,
-			src_buffer,
-			images[i],
-			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			1, regions + i
-		);
-	//Image layout transition
-	VkImageMemoryBarrier2* const after_image_barriers
-		= malloc(count * sizeof(VkImageMemoryBarrier2));
-	for (unsigned i = 0; i < count; ++i)
-		after_image_barriers[i] = (VkImageMemoryBarrier2) {
-			VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2, NULL,
-			VK_PIPELINE_STAGE_2_COPY_BIT,
-			VK_ACCESS_2_TRANSFER_WRITE_BIT,
-			VK_PIPELINE_STAGE_2_NONE,
-			VK_ACCESS_2_NONE,
-			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			layout,
-			VK_QUEUE_FAMILY_IGNORED,
-			VK_QUEUE_FAMILY_IGNORED,
-			images[i],
-			color_subresource_range
-		};
-	const VkDependencyInfo after_copy_dependency = {
-		VK_STRUCTURE_TYPE_DEPENDENCY_INFO, NULL, 0,
-		0, NULL,
-		0, NULL,
-		count, after_image_barriers
-	};
-	vkCmdPipelineBarrier2(command_buffer, &after_copy_dependency);
-	vkEndCommandBuffer(command_buffer);
-	//Submit to queue
-	const VkCommandBufferSubmitInfo command_buffer_submit = {
-		VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO, NULL,
-		command_buffer,
-		0
-	};
-	const VkSubmitInfo2 submit_info = {
-		VK_STRUCTURE_TYPE_SUBMIT_INFO_2, NULL, 0,
-		0, NULL,
-		1, &command_buffer_submit,
-		0, NULL
-	};
-	vkQueueSubmit2(queue, 1, &submit_info, VK_NULL_HANDLE);
-	vkQueueWaitIdle(queue); //TODO: Better synchronization
-	//Cleanup
-	free(before_image_barriers);
-	free(after_image_barriers);
-}
-
-static void write_textures_to_images(
+static uint64_t write_textures_to_images(
 	//Vulkan objects
-	const VkPhysicalDevice physical_device,
-	const VkDevice device,
-	const VkCommandBuffer command_buffer,
-	const VkQueue queue,
+	struct Allocator* const allocator,
+	struct Uploader* const uploader,
 	//Parameters
 	unsigned count,
 	SDL_Surface** const textures,
@@ -834,18 +932,21 @@ static void write_textures_to_images(
 ) {
 	//Textures
 	VkImageCreateInfo* const image_create_infos = malloc(count * sizeof(VkImageCreateInfo));
-	VkBufferImageCopy* const regions = malloc(count * sizeof(VkBufferImageCopy));
-	unsigned buffer_size = 0;
+	VkExtent3D* const extents = malloc(count * sizeof(VkExtent3D));
+	const void** const data = malloc(count * sizeof(void*));
+	VkDeviceSize* const sizes = malloc(count * sizeof(VkDeviceSize));
 	const VkFormat format = VK_FORMAT_B8G8R8A8_SRGB;
 	for (unsigned i = 0; i < count; ++i) {
 		const SDL_Surface* texture = textures[i];
-		const VkExtent3D extent = {texture->w, texture->h, 1};
+		extents[i] = (VkExtent3D) {texture->w, texture->h, 1};
+		data[i] = texture->pixels;
+		sizes[i] = texture->pitch * texture->h;
 		//Image create info
 		image_create_infos[i] = (VkImageCreateInfo) {
 			VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO, NULL, 0,
 			VK_IMAGE_TYPE_2D,
 			format,
-			extent,
+			extents[i],
 			1,
 			1,
 			VK_SAMPLE_COUNT_1_BIT,
@@ -855,64 +956,23 @@ static void write_textures_to_images(
 			0, NULL,
 			VK_IMAGE_LAYOUT_UNDEFINED
 		};
-		//Region
-		regions[i] = (VkBufferImageCopy) {
-			buffer_size,
-			0,
-			0,
-			{VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
-			{0, 0, 0},
-			{texture->w, texture->h, 1}
-		};
-		buffer_size += texture->pitch * texture->h;
-	}
-	//Create staging buffer
-	VkBuffer buffer;
-	struct Allocation buffer_alloc;
-	const VkBufferCreateInfo buffer_info = {
-		VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, NULL, 0,
-		buffer_size,
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_SHARING_MODE_EXCLUSIVE,
-		0, NULL
-	};
-	create_buffers(
-		physical_device,
-		device,
-		1,
-		&buffer_info,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
-		| VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		&buffer,
-		&buffer_alloc
-	);
-	//Write to staging buffer
-	void* buffer_data;
-	vkMapMemory(device, buffer_alloc.memory, 0, buffer_size, 0, &buffer_data);
-	for (unsigned i = 0; i < count; ++i) {
-		const SDL_Surface* texture = textures[i];
-		const VkBufferImageCopy region = regions[i];
-		const unsigned texture_size = texture->pitch * texture->h;
-		memcpy(buffer_data + region.bufferOffset, texture->pixels, texture_size);
 	}
-	vkUnmapMemory(device, buffer_alloc.memory);
 	//Create images
 	create_images(
-		physical_device,
-		device,
+		allocator,
 		count, image_create_infos,
 		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 		images,
 		image_alloc
 	);
 	//Write to images
-	copy_buffer_to_images(
-		command_buffer,
-		queue,
-		buffer,
+	const uint64_t upload_value = upload_images(
+		uploader,
 		count,
 		images,
-		regions,
+		extents,
+		data,
+		sizes,
 		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
 	);
 	//Image views
@@ -931,103 +991,280 @@ static void write_textures_to_images(
 			component_mapping,
 			{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1}
 		};
-		vkCreateImageView(device, &image_view_info, NULL, image_views + i);
+		vkCreateImageView(allocator->device, &image_view_info, NULL, image_views + i);
 	}
 	//Cleanup
 	free(image_create_infos);
-	free(regions);
-	vkDestroyBuffer(device, buffer, NULL);
-	free_allocation(device, buffer_alloc);
+	free(extents);
+	free(data);
+	free(sizes);
+	return upload_value;
 }
 
-static void record_draw_commands(
-	struct Renderer* const r,
-	unsigned frame,
-	unsigned swapchain_image_index,
-	unsigned draw_count) {
-	const VkCommandBuffer command_buffer = r->command_buffers[frame];
-	const VkCommandBufferBeginInfo begin_info = {
-		VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, NULL,
-		VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+//Reset the culled draw counts, statistics & (after loading) visibility once the previous frame has read them
+static void record_cull_reset(struct Renderer* const r, const VkCommandBuffer command_buffer, const unsigned frame) {
+	const VkMemoryBarrier2 reset_barrier = {
+		VK_STRUCTURE_TYPE_MEMORY_BARRIER_2, NULL,
+		VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT
+		| VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		VK_ACCESS_2_NONE,
+		VK_PIPELINE_STAGE_2_CLEAR_BIT,
+		VK_ACCESS_2_TRANSFER_WRITE_BIT
 	};
-	vkBeginCommandBuffer(command_buffer, &begin_info);
-	//Staging buffer memory barrier
-	const VkBufferMemoryBarrier2 staging_buffer_barrier = {
-		VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2, NULL,
-		VK_PIPELINE_STAGE_2_HOST_BIT,
-		VK_ACCESS_2_HOST_WRITE_BIT,
-		VK_PIPELINE_STAGE_2_COPY_BIT,
-		VK_ACCESS_2_TRANSFER_READ_BIT,
-		r->graphics_queue_family,
-		r->graphics_queue_family,
-		r->staging_buffer,
-		frame * r->staging_size, r->staging_size
+	const VkDependencyInfo reset_dependency = {
+		VK_STRUCTURE_TYPE_DEPENDENCY_INFO, NULL, 0,
+		1, &reset_barrier,
+		0, NULL,
+		0, NULL
 	};
-	const VkDependencyInfo staging_buffer_dependency = {
+	vkCmdPipelineBarrier2(command_buffer, &reset_dependency);
+	vkCmdFillBuffer(command_buffer, r->cull_buffers[1], 0, 2 * sizeof(uint32_t), 0);
+	if (r->instancing) vkCmdFillBuffer(command_buffer, r->cull_buffers[3], 0, VK_WHOLE_SIZE, 0);
+	vkCmdFillBuffer(command_buffer, r->stats_buffer, frame * r->stats_stride, sizeof(struct LocalStats), 0);
+	if (r->reset_visibility) {
+		//Nothing was visible before the first frame: the late phase draws it all
+		vkCmdFillBuffer(command_buffer, r->cull_buffers[2], 0, VK_WHOLE_SIZE, 0);
+		r->reset_visibility = false;
+	}
+	const VkMemoryBarrier2 cull_barrier = {
+		VK_STRUCTURE_TYPE_MEMORY_BARRIER_2, NULL,
+		VK_PIPELINE_STAGE_2_CLEAR_BIT,
+		VK_ACCESS_2_TRANSFER_WRITE_BIT,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		VK_ACCESS_2_SHADER_STORAGE_READ_BIT
+		| VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT
+	};
+	const VkDependencyInfo cull_dependency = {
 		VK_STRUCTURE_TYPE_DEPENDENCY_INFO, NULL, 0,
+		1, &cull_barrier,
 		0, NULL,
-		1, &staging_buffer_barrier,
 		0, NULL
 	};
-	vkCmdPipelineBarrier2(r->command_buffers[frame], &staging_buffer_dependency);
-	//Copy staging buffer to framebuffers
-	//Uniform
-	const VkBufferCopy uniform_region = {
-		frame * r->staging_size,
+	vkCmdPipelineBarrier2(command_buffer, &cull_dependency);
+}
+
+/*
+	Cull & compact draw commands into the culled draw buffer.
+	Its previous contents may still be read by the previous frame's draws.
+	With instancing, visible draws are compacted into the frame's instance list instead,
+	& a second dispatch writes the instanced commands of their groups.
+*/
+static void record_culling(
+	struct Renderer* const r,
+	const VkCommandBuffer command_buffer,
+	const unsigned frame,
+	const enum CullPhase phase) {
+	struct CullConstants constants;
+	memcpy(constants.frustum, r->frustum, sizeof(constants.frustum));
+	constants.draw_count = phase == CULL_MESHLETS ? r->meshlet_draw_count : r->draw_count;
+	constants.phase = phase;
+	constants.pyramid_size[0] = r->pyramid_extent.width;
+	constants.pyramid_size[1] = r->pyramid_extent.height;
+	constants.viewport_size[0] = r->resolution.width;
+	constants.viewport_size[1] = r->resolution.height;
+	constants.lod_threshold = r->lod_threshold;
+	constants.instance_count = 0;
+	if (r->instancing) constants.instance_count = phase == CULL_MESHLETS ? r->meshlet_draw_count : r->lod_instance_count;
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, r->cull_pipeline);
+	vkCmdBindDescriptorSets(
+		command_buffer,
+		VK_PIPELINE_BIND_POINT_COMPUTE,
+		r->cull_pipeline_layout,
 		0,
-		r->uniform_size
+		1, r->cull_descriptor_sets + frame,
+		0, NULL
+	);
+	vkCmdPushConstants(
+		command_buffer,
+		r->cull_pipeline_layout,
+		VK_SHADER_STAGE_COMPUTE_BIT,
+		0, sizeof(struct CullConstants), &constants
+	);
+	if (constants.draw_count) vkCmdDispatch(command_buffer, (constants.draw_count + 63) / 64, 1, 1); //None without meshlets
+	if (constants.draw_count && constants.instance_count) {
+		//Commands of groups once their instances are counted (same layout, so the set & constants stay bound)
+		const VkMemoryBarrier2 group_barrier = {
+			VK_STRUCTURE_TYPE_MEMORY_BARRIER_2, NULL,
+			VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+			VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+			VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+			VK_ACCESS_2_SHADER_STORAGE_READ_BIT
+			| VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT
+		};
+		const VkDependencyInfo group_dependency = {
+			VK_STRUCTURE_TYPE_DEPENDENCY_INFO, NULL, 0,
+			1, &group_barrier,
+			0, NULL,
+			0, NULL
+		};
+		vkCmdPipelineBarrier2(command_buffer, &group_dependency);
+		const unsigned group_count = phase == CULL_MESHLETS ? r->meshlet_count : r->lod_count;
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, r->group_pipeline);
+		vkCmdDispatch(command_buffer, (group_count + 63) / 64, 1, 1);
+	}
+	//Draw once culled (& read the statistics once the frame completes)
+	const VkMemoryBarrier2 draw_barrier = {
+		VK_STRUCTURE_TYPE_MEMORY_BARRIER_2, NULL,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+		VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT
+		| VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT
+		| VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT
+		| VK_PIPELINE_STAGE_2_HOST_BIT,
+		VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT
+		| VK_ACCESS_2_SHADER_STORAGE_READ_BIT
+		| VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT
+		| VK_ACCESS_2_HOST_READ_BIT
+	};
+	const VkDependencyInfo draw_dependency = {
+		VK_STRUCTURE_TYPE_DEPENDENCY_INFO, NULL, 0,
+		1, &draw_barrier,
+		0, NULL,
+		0, NULL
 	};
-	vkCmdCopyBuffer(command_buffer, r->staging_buffer, r->frame_buffers[2 * frame], 1, &uniform_region);
-	//Storage
-	const VkBufferCopy storage_region = {
-		frame * r->staging_size + r->uniform_size,
-		0,
-		r->storage_size};
-	vkCmdCopyBuffer(command_buffer, r->staging_buffer, r->frame_buffers[2 * frame + 1], 1, &storage_region);
-	//Memory barrier
-	const VkBufferMemoryBarrier2 shader_buffer_barriers[] = {
-		//Uniform buffer
+	vkCmdPipelineBarrier2(command_buffer, &draw_dependency);
+}
+
+/*
+	Reduce the frame's depth attachment into the depth pyramid, one dispatch per level.
+	The attachment is sampled in between the early & late render passes.
+*/
+static void record_depth_pyramid(struct Renderer* const r, const VkCommandBuffer command_buffer, const unsigned frame) {
+	const VkImageSubresourceRange depth_subresource_range = {
+		VK_IMAGE_ASPECT_DEPTH_BIT,
+		0, 1,
+		0, 1
+	};
+	const VkImageSubresourceRange pyramid_subresource_range = {
+		VK_IMAGE_ASPECT_COLOR_BIT,
+		0, r->pyramid_level_count,
+		0, 1
+	};
+	const VkMemoryBarrier2 color_barrier = {
+		VK_STRUCTURE_TYPE_MEMORY_BARRIER_2, NULL,
+		VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+		VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+		VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+		VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT
+		| VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT
+	};
+	const VkImageMemoryBarrier2 reduce_barriers[] = {
+		//Depth attachment
 		{
-			VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2, NULL,
-			VK_PIPELINE_STAGE_2_COPY_BIT,
-			VK_ACCESS_2_TRANSFER_WRITE_BIT,
-			VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT,
-			VK_ACCESS_2_UNIFORM_READ_BIT,
+			VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2, NULL,
+			VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+			VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+			VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+			VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+			VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
 			r->graphics_queue_family,
 			r->graphics_queue_family,
-			r->frame_buffers[2 * frame],
-			0, VK_WHOLE_SIZE
+			r->images[3 * frame + 2],
+			depth_subresource_range
 		},
-		//Storage buffer
+		//Depth pyramid (after the previous frame's late phase sampled it)
 		{
-			VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2, NULL,
-			VK_PIPELINE_STAGE_2_COPY_BIT,
-			VK_ACCESS_2_TRANSFER_WRITE_BIT,
-			VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT,
-			VK_ACCESS_2_SHADER_STORAGE_READ_BIT,
+			VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2, NULL,
+			VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+			VK_ACCESS_2_NONE,
+			VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+			VK_ACCESS_2_SHADER_STORAGE_READ_BIT
+			| VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+			VK_IMAGE_LAYOUT_UNDEFINED,
+			VK_IMAGE_LAYOUT_GENERAL,
 			r->graphics_queue_family,
 			r->graphics_queue_family,
-			r->frame_buffers[2 * frame + 1],
-			0, VK_WHOLE_SIZE
+			r->pyramid,
+			pyramid_subresource_range
 		}
 	};
-	const VkDependencyInfo shader_buffer_dependency= {
+	const VkDependencyInfo reduce_dependency = {
+		VK_STRUCTURE_TYPE_DEPENDENCY_INFO, NULL, 0,
+		1, &color_barrier,
+		0, NULL,
+		2, reduce_barriers
+	};
+	vkCmdPipelineBarrier2(command_buffer, &reduce_dependency);
+	//Levels
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, r->pyramid_pipeline);
+	const VkMemoryBarrier2 level_barrier = {
+		VK_STRUCTURE_TYPE_MEMORY_BARRIER_2, NULL,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		VK_ACCESS_2_SHADER_STORAGE_READ_BIT
+		| VK_ACCESS_2_SHADER_SAMPLED_READ_BIT
+	};
+	const VkDependencyInfo level_dependency = {
 		VK_STRUCTURE_TYPE_DEPENDENCY_INFO, NULL, 0,
+		1, &level_barrier,
 		0, NULL,
-		2, shader_buffer_barriers,
 		0, NULL
 	};
-	vkCmdPipelineBarrier2(command_buffer, &shader_buffer_dependency);
-
-	//Render pass
-	const VkClearValue clear_values[3] = {
-		{0, 0, 0, 1}, //Color
+	for (uint32_t i = 0; i < r->pyramid_level_count; ++i) {
+		vkCmdBindDescriptorSets(
+			command_buffer,
+			VK_PIPELINE_BIND_POINT_COMPUTE,
+			r->pyramid_pipeline_layout,
+			0,
+			1, r->pyramid_descriptor_sets + frame * r->pyramid_level_count + i,
+			0, NULL
+		);
+		vkCmdPushConstants(
+			command_buffer,
+			r->pyramid_pipeline_layout,
+			VK_SHADER_STAGE_COMPUTE_BIT,
+			0, sizeof(uint32_t), &i
+		);
+		const unsigned width = r->pyramid_extent.width >> i, height = r->pyramid_extent.height >> i;
+		vkCmdDispatch(
+			command_buffer,
+			((width ? width : 1) + 7) / 8,
+			((height ? height : 1) + 7) / 8,
+			1
+		);
+		vkCmdPipelineBarrier2(command_buffer, &level_dependency);
+	}
+	//Return the depth attachment to the late render pass
+	const VkImageMemoryBarrier2 attachment_barrier = {
+		VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2, NULL,
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		VK_ACCESS_2_NONE,
+		VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT
+		| VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+		VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT
+		| VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+		VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+		VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+		r->graphics_queue_family,
+		r->graphics_queue_family,
+		r->images[3 * frame + 2],
+		depth_subresource_range
+	};
+	const VkDependencyInfo attachment_dependency = {
+		VK_STRUCTURE_TYPE_DEPENDENCY_INFO, NULL, 0,
+		0, NULL,
+		0, NULL,
+		1, &attachment_barrier
+	};
+	vkCmdPipelineBarrier2(command_buffer, &attachment_dependency);
+}
+
+//Begin a render pass into the frame's attachments & bind the scene
+static void begin_drawing(
+	struct Renderer* const r,
+	const VkCommandBuffer command_buffer,
+	const unsigned frame,
+	const VkRenderPass render_pass) {
+	const VkClearValue clear_values[3] = {
+		{0, 0, 0, 1}, //Color
 		{0, 0, 0, 1}, //Resolve
 		{1, 0} //Depth
 	};
 	const VkRenderPassBeginInfo render_pass_begin_info = {
 		VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO, NULL,
-		r->render_pass,
+		render_pass,
 		r->framebuffers[frame],
 		{{0, 0}, r->resolution},
 		3, clear_values
@@ -1037,7 +1274,11 @@ static void record_draw_commands(
 		&render_pass_begin_info,
 		VK_SUBPASS_CONTENTS_INLINE
 	);
-	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, r->pipeline);
+	vkCmdBindPipeline(
+		command_buffer,
+		VK_PIPELINE_BIND_POINT_GRAPHICS,
+		r->compact_vertices ? r->compact_pipeline : r->pipeline
+	);
 	//Bind descriptors
 	vkCmdBindDescriptorSets(
 		command_buffer,
@@ -1058,17 +1299,146 @@ static void record_draw_commands(
 		command_buffer,
 		r->static_buffers[1],
 		0,
-		VK_INDEX_TYPE_UINT32
+		r->index_type
 	);
-	//Drawing
-	vkCmdDrawIndexedIndirect(
+}
+
+//Draw a list of culled draws (0 for early, frustum culled or meshlets, 1 for late)
+static void draw_culled(
+	struct Renderer* const r,
+	const VkCommandBuffer command_buffer,
+	const unsigned list,
+	const unsigned max_count) {
+	vkCmdDrawIndexedIndirectCount(
 		command_buffer,
-		r->static_buffers[3],
-		0,
-		draw_count,
+		r->cull_buffers[0],
+		list * r->draw_count * sizeof(VkDrawIndexedIndirectCommand),
+		r->cull_buffers[1],
+		list * sizeof(uint32_t),
+		max_count,
 		sizeof(VkDrawIndexedIndirectCommand)
 	);
+}
+
+static void record_draw_commands(
+	struct Renderer* const r,
+	unsigned frame,
+	unsigned swapchain_image_index,
+	unsigned draw_count) {
+	const VkCommandBuffer command_buffer = r->command_buffers[frame];
+	const VkCommandBufferBeginInfo begin_info = {
+		VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, NULL,
+		VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+	};
+	vkBeginCommandBuffer(command_buffer, &begin_info);
+	vkCmdResetQueryPool(command_buffer, r->query_pool, 2 * frame, 2);
+	vkCmdWriteTimestamp2(command_buffer, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT, r->query_pool, 2 * frame);
+	//Take ownership of uploaded resources
+	uploader_acquire(&r->uploader, command_buffer);
+	//Frame data
+	if (r->frame_data.staging_buffer) {
+		//Device can't read host memory: copy the camera, changed nodes & draw commands
+		const VkDeviceSize frame_offset = frame * r->frame_data.frame_size;
+		if (r->stale_frame_count) {
+			//First use of the region since loading: copy all of it
+			r->copy_regions[0] = (VkBufferCopy) {frame_offset, frame_offset, r->frame_data.frame_size};
+			r->copy_region_count = 0;
+			--r->stale_frame_count;
+		} else r->copy_regions[r->copy_region_count] = (VkBufferCopy) {
+			frame_offset + r->uniform_offset,
+			frame_offset + r->uniform_offset,
+			r->uniform_size
+		};
+		vkCmdCopyBuffer(
+			command_buffer,
+			r->frame_data.staging_buffer,
+			r->frame_data.buffer,
+			r->copy_region_count + 1, r->copy_regions
+		);
+		r->copy_region_count = 0;
+		const VkBufferMemoryBarrier2 frame_barrier = {
+			VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2, NULL,
+			VK_PIPELINE_STAGE_2_COPY_BIT,
+			VK_ACCESS_2_TRANSFER_WRITE_BIT,
+			VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT
+			| VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT
+			| VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT,
+			VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT
+			| VK_ACCESS_2_UNIFORM_READ_BIT
+			| VK_ACCESS_2_SHADER_STORAGE_READ_BIT
+			| VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, //Instances of GPU culling
+			r->graphics_queue_family,
+			r->graphics_queue_family,
+			r->frame_data.buffer,
+			frame_offset, r->frame_data.frame_size
+		};
+		const VkDependencyInfo frame_dependency = {
+			VK_STRUCTURE_TYPE_DEPENDENCY_INFO, NULL, 0,
+			0, NULL,
+			1, &frame_barrier,
+			0, NULL
+		};
+		vkCmdPipelineBarrier2(command_buffer, &frame_dependency);
+	}
+	if (r->culling == CULLING_GPU || r->culling == CULLING_OCCLUSION || r->culling == CULLING_MESHLET)
+		record_cull_reset(r, command_buffer, frame);
+
+	//Drawing
+	switch (r->culling) {
+		case CULLING_NONE:
+			begin_drawing(r, command_buffer, frame, r->render_pass);
+			//Detail levels are selected into the frame's region
+			if (r->lod_threshold > 0) vkCmdDrawIndexedIndirect(
+				command_buffer,
+				r->frame_data.buffer,
+				frame * r->frame_data.frame_size + r->draw_offset,
+				draw_count,
+				sizeof(VkDrawIndexedIndirectCommand)
+			);
+			else vkCmdDrawIndexedIndirect(
+				command_buffer,
+				r->static_buffers[3],
+				r->instancing ? r->draw_count * sizeof(VkDrawIndexedIndirectCommand) : 0,
+				draw_count,
+				sizeof(VkDrawIndexedIndirectCommand)
+			);
+			break;
+		case CULLING_CPU:
+		case CULLING_SOFTWARE:
+			begin_drawing(r, command_buffer, frame, r->render_pass);
+			vkCmdDrawIndexedIndirect(
+				command_buffer,
+				r->frame_data.buffer,
+				frame * r->frame_data.frame_size + r->draw_offset,
+				draw_count,
+				sizeof(VkDrawIndexedIndirectCommand)
+			);
+			break;
+		case CULLING_GPU:
+			record_culling(r, command_buffer, frame, CULL_FRUSTUM);
+			begin_drawing(r, command_buffer, frame, r->render_pass);
+			draw_culled(r, command_buffer, 0, r->draw_count);
+			break;
+		case CULLING_OCCLUSION:
+			//Early: what was visible last frame
+			record_culling(r, command_buffer, frame, CULL_EARLY);
+			begin_drawing(r, command_buffer, frame, r->render_pass);
+			draw_culled(r, command_buffer, 0, r->draw_count);
+			vkCmdEndRenderPass(command_buffer);
+			//Late: the rest, unless behind what the early phase drew
+			record_depth_pyramid(r, command_buffer, frame);
+			record_culling(r, command_buffer, frame, CULL_LATE);
+			begin_drawing(r, command_buffer, frame, r->load_render_pass);
+			draw_culled(r, command_buffer, 1, r->draw_count);
+			break;
+		case CULLING_MESHLET:
+			record_culling(r, command_buffer, frame, CULL_MESHLETS);
+			begin_drawing(r, command_buffer, frame, r->render_pass);
+			draw_culled(r, command_buffer, 0, r->meshlet_draw_count);
+			break;
+	}
 	vkCmdEndRenderPass(command_buffer);
+	vkCmdWriteTimestamp2(command_buffer, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, r->query_pool, 2 * frame + 1);
 
 	//Blitting
 	const VkImageSubresourceRange color_subresource_range = {
@@ -1157,7 +1527,7 @@ static void record_draw_commands(
 	vkEndCommandBuffer(command_buffer);
 }
 
-bool create_renderer(SDL_Window* window, struct Renderer* const result) {
+bool create_renderer(SDL_Window* window, const unsigned frame_count, struct Renderer* const result) {
 	struct Renderer r;
 	r.window = window;
 
@@ -1261,6 +1631,18 @@ bool create_renderer(SDL_Window* window, struct Renderer* const result) {
 				break;
 			}
 		}
+		//Transfer queue (prefer a dedicated DMA family without graphics or compute)
+		r.transfer_queue_family = r.graphics_queue_family;
+		unsigned transfer_score = 0;
+		for (unsigned i = 0; i < queue_family_count; ++i) {
+			const VkQueueFlags flags = queue_families[i].queueFlags;
+			if (!(flags & VK_QUEUE_TRANSFER_BIT) || flags & VK_QUEUE_GRAPHICS_BIT) continue;
+			const unsigned score = flags & VK_QUEUE_COMPUTE_BIT ? 1 : 2;
+			if (score > transfer_score) {
+				transfer_score = score;
+				r.transfer_queue_family = i;
+			}
+		}
 		free(queue_families);
 
 		//Swapchain support
@@ -1307,22 +1689,35 @@ bool create_renderer(SDL_Window* window, struct Renderer* const result) {
 		1,
 		&QUEUE_PRIORITY
 	};
-	VkDeviceQueueCreateInfo queue_infos[2];
-	queue_infos[0] = queue_info;
-	unsigned queue_info_count = 1;
-	//Graphics & present queues are different
-	if (r.graphics_queue_family != r.present_queue_family) {
-		queue_info_count = 2;
-		queue_infos[1] = queue_info;
-		queue_infos[1].queueFamilyIndex = r.present_queue_family;
+	const uint32_t queue_families[] = {
+		r.graphics_queue_family,
+		r.present_queue_family,
+		r.transfer_queue_family
+	};
+	VkDeviceQueueCreateInfo queue_infos[3];
+	unsigned queue_info_count = 0;
+	for (unsigned i = 0; i < 3; ++i) {
+		//One queue per distinct family
+		bool duplicate = false;
+		for (unsigned j = 0; j < i; ++j)
+			duplicate |= queue_families[i] == queue_families[j];
+		if (duplicate) continue;
+		queue_infos[queue_info_count] = queue_info;
+		queue_infos[queue_info_count++].queueFamilyIndex = queue_families[i];
 	}
 	//Logical device
 	const VkPhysicalDeviceFeatures features = {
 		.multiDrawIndirect = true,
+		.drawIndirectFirstInstance = true, //Node of each draw
 		.fillModeNonSolid = true //FIXME: Debug
 	};
+	VkPhysicalDeviceVulkan12Features features_12 = {
+		VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES, NULL,
+		.drawIndirectCount = true, //GPU culling
+		.timelineSemaphore = true
+	};
 	const VkPhysicalDeviceVulkan13Features features_13 = {
-		VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES, NULL,
+		VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES, &features_12,
 		.synchronization2 = true
 	};
 	const VkDeviceCreateInfo device_info = {
@@ -1338,6 +1733,8 @@ bool create_renderer(SDL_Window* window, struct Renderer* const result) {
 	//Queue handles
 	vkGetDeviceQueue(r.device, r.graphics_queue_family, 0, &r.graphics_queue);
 	vkGetDeviceQueue(r.device, r.present_queue_family, 0, &r.present_queue);
+	//Memory allocator
+	create_allocator(r.physical_device, r.device, &r.allocator);
 
 	//Pipeline cache
 	FILE* const pipeline_cache_file = fopen(PIPELINE_CACHE_FILENAME, "rb");
@@ -1370,14 +1767,15 @@ bool create_renderer(SDL_Window* window, struct Renderer* const result) {
 	};
 	vkCreateCommandPool(r.device, &pool_info, NULL, &r.command_pool);
 
-	//Transfer command buffer
-	const VkCommandBufferAllocateInfo command_buffer_alloc_info = {
-		VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO, NULL,
-		r.command_pool,
-		VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-		1
-	};
-	vkAllocateCommandBuffers(r.device, &command_buffer_alloc_info, &r.transfer_command_buffer);
+	//Uploads
+	create_uploader(
+		&r.allocator,
+		r.transfer_queue_family,
+		r.graphics_queue_family,
+		DEFAULT_STAGING_SIZE,
+		&r.uploader
+	);
+	r.upload_value = 0;
 	
 	//Sampler
 	const VkSamplerCreateInfo sampler_info = {
@@ -1407,10 +1805,13 @@ bool create_renderer(SDL_Window* window, struct Renderer* const result) {
 		{2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, NULL}, //Materials
 		{3, VK_DESCRIPTOR_TYPE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, &r.sampler}, //Sampler
 		{4, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, MAX_TEXTURE_COUNT, VK_SHADER_STAGE_FRAGMENT_BIT, NULL}, //Textures
+		{5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT, NULL}, //Node quantization
+		{6, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT, NULL}, //Draw data
+		{7, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT, NULL}, //Instances
 	};
 	const VkDescriptorSetLayoutCreateInfo descriptor_set_layout_info = {
 		VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO, NULL, 0,
-		5, descriptor_set_layout_bindings
+		8, descriptor_set_layout_bindings
 	};
 	vkCreateDescriptorSetLayout(r.device, &descriptor_set_layout_info, NULL, &r.descriptor_set_layout);
 
@@ -1422,10 +1823,91 @@ bool create_renderer(SDL_Window* window, struct Renderer* const result) {
 	};
 	vkCreatePipelineLayout(r.device, &layout_info, NULL, &r.pipeline_layout);
 
+	//Depth pyramid pipeline
+	const VkSamplerCreateInfo pyramid_sampler_info = {
+		VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO, NULL, 0,
+		VK_FILTER_NEAREST, VK_FILTER_NEAREST,
+		VK_SAMPLER_MIPMAP_MODE_NEAREST,
+		VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+		VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+		VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+		0,
+		VK_FALSE, 1,
+		VK_FALSE, VK_COMPARE_OP_ALWAYS,
+		0, VK_LOD_CLAMP_NONE,
+		VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE,
+		VK_FALSE
+	};
+	vkCreateSampler(r.device, &pyramid_sampler_info, NULL, &r.pyramid_sampler);
+	const VkDescriptorSetLayoutBinding pyramid_bindings[] = {
+		{0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, &r.pyramid_sampler}, //Depth
+		{1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, NULL}, //Previous level
+		{2, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, NULL} //Level
+	};
+	const VkDescriptorSetLayoutCreateInfo pyramid_descriptor_set_layout_info = {
+		VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO, NULL, 0,
+		3, pyramid_bindings
+	};
+	vkCreateDescriptorSetLayout(r.device, &pyramid_descriptor_set_layout_info, NULL, &r.pyramid_descriptor_set_layout);
+	const VkPushConstantRange pyramid_constants = {
+		VK_SHADER_STAGE_COMPUTE_BIT,
+		0, sizeof(uint32_t) //Level
+	};
+	const VkPipelineLayoutCreateInfo pyramid_layout_info = {
+		VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO, NULL, 0,
+		1, &r.pyramid_descriptor_set_layout,
+		1, &pyramid_constants
+	};
+	vkCreatePipelineLayout(r.device, &pyramid_layout_info, NULL, &r.pyramid_pipeline_layout);
+	create_compute_pipeline(&r, "shaders/depth_pyramid.comp.spv", r.pyramid_pipeline_layout, &r.pyramid_pipeline);
+
+	//Culling pipeline
+	const VkDescriptorSetLayoutBinding cull_bindings[] = {
+		{0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, NULL}, //Draws
+		{1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, NULL}, //Draw bounds
+		{2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, NULL}, //Nodes
+		{3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, NULL}, //Culled draws
+		{4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, NULL}, //Culled draw counts
+		{5, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, NULL}, //Camera
+		{6, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, &r.pyramid_sampler}, //Depth pyramid
+		{7, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, NULL}, //Visibility
+		{8, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, NULL}, //Statistics
+		{9, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, NULL}, //Meshlets
+		{10, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, NULL}, //Meshlet draws
+		{11, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, NULL}, //Detail levels
+		{12, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, NULL}, //Instance groups
+		{13, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, NULL}, //Group instance counts
+		{14, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, NULL}, //Instances
+	};
+	const VkDescriptorSetLayoutCreateInfo cull_descriptor_set_layout_info = {
+		VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO, NULL, 0,
+		15, cull_bindings
+	};
+	vkCreateDescriptorSetLayout(r.device, &cull_descriptor_set_layout_info, NULL, &r.cull_descriptor_set_layout);
+	const VkPushConstantRange cull_constants = {
+		VK_SHADER_STAGE_COMPUTE_BIT,
+		0, sizeof(struct CullConstants)
+	};
+	const VkPipelineLayoutCreateInfo cull_layout_info = {
+		VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO, NULL, 0,
+		1, &r.cull_descriptor_set_layout,
+		1, &cull_constants
+	};
+	vkCreatePipelineLayout(r.device, &cull_layout_info, NULL, &r.cull_pipeline_layout);
+	create_compute_pipeline(&r, "shaders/cull.comp.spv", r.cull_pipeline_layout, &r.cull_pipeline);
+	create_compute_pipeline(&r, "shaders/group.comp.spv", r.cull_pipeline_layout, &r.group_pipeline);
+
 	//Partytime
 	create_resolution(&r, 1048, 1048);
-	create_frames(&r, 2);
+	create_frames(&r, frame_count ? frame_count : 1);
 	create_swapchain(&r, false);
+	r.culling = CULLING_GPU;
+	r.lod_threshold = DEFAULT_LOD_THRESHOLD;
+	r.compact_vertices = false;
+	r.instancing = true;
+	r.static_batching = false;
+	r.jobs = NULL;
+	memset(r.frustum, 0, sizeof(r.frustum)); //Nothing is culled until the camera is set
 
 	*result = r;
 	return false;
@@ -1439,20 +1921,374 @@ void destroy_renderer(struct Renderer r) {
 	destroy_swapchain(&r, false);
 	destroy_resolution(&r);
 	vkDestroyPipelineCache(r.device, r.pipeline_cache, NULL);
+	vkDestroyPipeline(r.device, r.cull_pipeline, NULL);
+	vkDestroyPipeline(r.device, r.group_pipeline, NULL);
+	vkDestroyPipelineLayout(r.device, r.cull_pipeline_layout, NULL);
+	vkDestroyDescriptorSetLayout(r.device, r.cull_descriptor_set_layout, NULL);
+	vkDestroyPipeline(r.device, r.pyramid_pipeline, NULL);
+	vkDestroyPipelineLayout(r.device, r.pyramid_pipeline_layout, NULL);
+	vkDestroyDescriptorSetLayout(r.device, r.pyramid_descriptor_set_layout, NULL);
+	vkDestroySampler(r.device, r.pyramid_sampler, NULL);
 	vkDestroyPipelineLayout(r.device, r.pipeline_layout, NULL);
 	vkDestroySampler(r.device, r.sampler, NULL);
 	vkDestroyDescriptorSetLayout(r.device, r.descriptor_set_layout, NULL);
 	vkDestroyCommandPool(r.device, r.command_pool, NULL);
+	destroy_uploader(&r.allocator, &r.uploader);
+	destroy_allocator(&r.allocator);
 	vkDestroyDevice(r.device, NULL);
 	vkDestroySurfaceKHR(r.instance, r.surface, NULL);
 	vkDestroyInstance(r.instance, NULL);
 }
 
+//Largest first
+static int compare_candidates(const void* a, const void* b) {
+	const float x = ((const struct OccluderCandidate*) a)->area, y = ((const struct OccluderCandidate*) b)->area;
+	return (x < y) - (x > y);
+}
+
+//Nodes split into jobs of CULL_GRAIN nodes, each writing into its own range of the outputs
+struct NodeJobs {
+	struct Renderer* r;
+	unsigned count;
+	const unsigned* nodes;
+	VkDrawIndexedIndirectCommand* commands; //Written by write_draw_range without instancing
+};
+
+static unsigned node_job_count(const unsigned count) {
+	return (count + CULL_GRAIN - 1) / CULL_GRAIN;
+}
+
+//Nodes of a job
+static void node_range(const struct NodeJobs* const jobs, const unsigned job, unsigned* const start, unsigned* const end) {
+	*start = job * CULL_GRAIN;
+	*end = jobs->count - *start < CULL_GRAIN ? jobs->count : *start + CULL_GRAIN;
+}
+
+//Move each job's results after the previous job's, returning their total count
+static unsigned compact_node_jobs(const unsigned job_count, const struct NodeJob* const jobs, void* const data, const size_t size) {
+	unsigned count = 0;
+	for (unsigned i = 0; i < job_count; ++i) {
+		memmove(data + count * size, data + jobs[i].first * size, jobs[i].count * size);
+		count += jobs[i].count;
+	}
+	return count;
+}
+
+//Cull a BVH subtree into its slots of the visible nodes
+static void cull_subtree(void* const data, const unsigned job) {
+	struct Renderer* const r = data;
+	const unsigned root = r->cull_roots[job];
+	const unsigned first = r->bvh.nodes[root].first;
+	const unsigned count = cull_bvh_subtree(&r->bvh, root, (const vec4*) r->frustum, r->visible_nodes + first);
+	unsigned draw_count = 0;
+	for (unsigned i = first; i < first + count; ++i)
+		draw_count += r->node_first_draws[r->visible_nodes[i] + 1] - r->node_first_draws[r->visible_nodes[i]];
+	r->node_jobs[job] = (struct NodeJob) {first, count, draw_count, 0, 0};
+}
+
+//Project visible nodes' bounds, & write the occluder candidates among them into their range
+static void project_nodes(void* const data, const unsigned job) {
+	const struct NodeJobs* const jobs = data;
+	struct Renderer* const r = jobs->r;
+	unsigned start, end;
+	node_range(jobs, job, &start, &end);
+	unsigned candidate_count = 0;
+	for (unsigned i = start; i < end; ++i) {
+		const unsigned node = jobs->nodes[i];
+		struct Box* const box = r->screen_boxes + i;
+		project_box(r->node_boxes[node], r->view_projection, box);
+		if (!r->occluders[r->node_meshes[node]].index_count) continue;
+		const float area = (fminf(box->end[0], 1) - fmaxf(box->start[0], -1))
+			* (fminf(box->end[1], 1) - fmaxf(box->start[1], -1)) / 4;
+		if (area >= OCCLUDER_MIN_AREA)
+			r->occluder_candidates[start + candidate_count++] = (struct OccluderCandidate) {area, node};
+	}
+	r->node_jobs[job] = (struct NodeJob) {start, candidate_count, 0, 0, 0};
+}
+
+//Keep the visible nodes of a range that aren't behind the occlusion buffer, at its start
+static void test_nodes(void* const data, const unsigned job) {
+	const struct NodeJobs* const jobs = data;
+	struct Renderer* const r = jobs->r;
+	unsigned start, end;
+	node_range(jobs, job, &start, &end);
+	unsigned visible_count = 0;
+	for (unsigned i = start; i < end; ++i)
+		if (test_occlusion(&r->occlusion_buffer, r->screen_boxes[i]))
+			r->visible_nodes[start + visible_count++] = r->visible_nodes[i];
+	r->node_jobs[job] = (struct NodeJob) {start, visible_count, 0, 0, 0};
+}
+
+/*
+	Remove the visible nodes hidden behind occluders, returning how many remain.
+	Occluders are the visible nodes covering the most of the screen, drawn until the triangle budget is spent.
+	Projection & testing run in jobs, rasterization on the calling thread.
+*/
+static unsigned cull_occluded_nodes(struct Renderer* const r, const unsigned count) {
+	struct OcclusionBuffer* const buffer = &r->occlusion_buffer;
+	clear_occlusion_buffer(buffer);
+	//Choose occluders by the screen area of their bounds
+	struct NodeJobs jobs = {r, count, r->visible_nodes, NULL};
+	const unsigned job_count = node_job_count(count);
+	jobs_parallel_for(r->jobs, job_count, project_nodes, &jobs);
+	const unsigned candidate_count = compact_node_jobs(
+		job_count, r->node_jobs,
+		r->occluder_candidates, sizeof(struct OccluderCandidate)
+	);
+	qsort(r->occluder_candidates, candidate_count, sizeof(struct OccluderCandidate), compare_candidates);
+	for (unsigned i = 0; i < candidate_count && buffer->triangle_count < OCCLUDER_TRIANGLE_BUDGET; ++i) {
+		const unsigned node = r->occluder_candidates[i].node;
+		mat4 m;
+		glm_mat4_mul(r->view_projection, r->node_transformations[node], m);
+		rasterize_occluder(buffer, m, r->occluders + r->node_meshes[node]);
+	}
+	update_occlusion_tiles(buffer);
+	//Test every visible node (occluders pass, being no nearer than their bounds)
+	jobs_parallel_for(r->jobs, job_count, test_nodes, &jobs);
+	return compact_node_jobs(job_count, r->node_jobs, r->visible_nodes, sizeof(unsigned));
+}
+
+//Pixels per unit of mesh-space error of a node's draws, at the nearest point of its bounds
+static float lod_pixels(const struct Renderer* const r, const unsigned node) {
+	float scale = 0;
+	for (unsigned i = 0; i < 3; ++i)
+		scale = fmaxf(scale, glm_vec3_norm(r->node_transformations[node][i]));
+	float pixels = scale * r->lod_scale;
+	if (r->perspective) {
+		const struct Box box = r->node_boxes[node];
+		vec3 offset;
+		for (unsigned i = 0; i < 3; ++i)
+			offset[i] = fmaxf(fmaxf(box.start[i] - r->camera_position[i], r->camera_position[i] - box.end[i]), 0);
+		pixels /= fmaxf(glm_vec3_norm(offset), 1e-6f);
+	}
+	return pixels;
+}
+
+//Coarsest detail level of a draw's primitive within the error threshold (the first without a threshold)
+static unsigned select_lod(const struct Renderer* const r, const unsigned i, const float pixels) {
+	const unsigned first_lod = r->primitive_lods[r->draw_primitives[i]];
+	const unsigned end_lod = r->primitive_lods[r->draw_primitives[i] + 1];
+	unsigned lod = first_lod;
+	if (r->lod_threshold <= 0) return lod;
+	while (lod + 1 < end_lod && r->lods[lod + 1].error * pixels <= r->lod_threshold) ++lod;
+	return lod;
+}
+
+//Count the draws of a job's nodes
+static void count_node_draws(void* const data, const unsigned job) {
+	const struct NodeJobs* const jobs = data;
+	const struct Renderer* const r = jobs->r;
+	unsigned start, end;
+	node_range(jobs, job, &start, &end);
+	unsigned draw_count = 0;
+	for (unsigned i = start; i < end; ++i)
+		draw_count += r->node_first_draws[jobs->nodes[i] + 1] - r->node_first_draws[jobs->nodes[i]];
+	r->node_jobs[job].draw_count = draw_count;
+}
+
+/*
+	Select the detail levels of a job's draws, into its range of the visible draws
+	(& of the commands without instancing).
+*/
+static void write_draw_range(void* const data, const unsigned job) {
+	const struct NodeJobs* const jobs = data;
+	const struct Renderer* const r = jobs->r;
+	struct NodeJob* const result = r->node_jobs + job;
+	unsigned start, end;
+	node_range(jobs, job, &start, &end);
+	unsigned visible_count = result->first;
+	result->triangle_count = result->full_triangle_count = 0;
+	for (unsigned i = start; i < end; ++i) {
+		const unsigned node = jobs->nodes[i];
+		const float pixels = r->lod_threshold > 0 ? lod_pixels(r, node) : 0;
+		for (unsigned j = r->node_first_draws[node]; j < r->node_first_draws[node + 1]; ++j, ++visible_count) {
+			const unsigned draw = r->node_draws[j];
+			const unsigned lod = select_lod(r, draw, pixels);
+			r->instance_draws[visible_count] = draw;
+			r->instance_lods[visible_count] = lod;
+			result->triangle_count += r->lods[lod].index_count / 3;
+			result->full_triangle_count += r->draws[draw].indexCount / 3;
+			if (jobs->commands) {
+				VkDrawIndexedIndirectCommand command = r->draws[draw];
+				command.firstIndex = r->lods[lod].first_index;
+				command.indexCount = r->lods[lod].index_count;
+				jobs->commands[visible_count] = command;
+			}
+		}
+	}
+}
+
+/*
+	Write the draw commands of nodes, at their detail levels, into the frame's region.
+	Levels are selected in jobs of CULL_GRAIN nodes, each writing its draws after the previous jobs' draws.
+	With instancing, draws of a primitive at the same level share a command,
+	their instances following the identity in the frame's instance list.
+	Returns the command count, & the draw & triangle counts in draw_count & triangle_count
+	(& at full detail in full_triangle_count if it isn't NULL).
+*/
+static unsigned write_node_draws(
+	struct Renderer* const r,
+	const unsigned count,
+	const unsigned* const nodes,
+	unsigned* const draw_count,
+	unsigned* const triangle_count,
+	unsigned* const full_triangle_count) {
+	void* const frame_data = frame_ring_data(&r->frame_data, r->current_frame);
+	VkDrawIndexedIndirectCommand* const commands = frame_data + r->draw_offset;
+	const VkDeviceSize frame_offset = r->current_frame * r->frame_data.frame_size;
+	//Draws & their detail levels
+	struct NodeJobs jobs = {r, count, nodes, r->instancing ? NULL : commands};
+	const unsigned job_count = node_job_count(count);
+	jobs_parallel_for(r->jobs, job_count, count_node_draws, &jobs);
+	unsigned visible_count = 0;
+	for (unsigned i = 0; i < job_count; ++i) {
+		r->node_jobs[i].first = visible_count;
+		visible_count += r->node_jobs[i].draw_count;
+	}
+	jobs_parallel_for(r->jobs, job_count, write_draw_range, &jobs);
+	*draw_count = visible_count;
+	*triangle_count = 0;
+	if (full_triangle_count) *full_triangle_count = 0;
+	for (unsigned i = 0; i < job_count; ++i) {
+		*triangle_count += r->node_jobs[i].triangle_count;
+		if (full_triangle_count) *full_triangle_count += r->node_jobs[i].full_triangle_count;
+	}
+	//Commands
+	unsigned command_count = 0;
+	if (r->instancing) {
+		//Instances of each level used, consecutive after the identity
+		memset(r->lod_instances, 0, r->lod_count * sizeof(unsigned));
+		for (unsigned i = 0; i < visible_count; ++i)
+			++r->lod_instances[r->instance_lods[i]];
+		unsigned instance = r->draw_count;
+		for (unsigned i = 0; i < r->primitive_count; ++i) {
+			for (unsigned j = r->primitive_lods[i]; j < r->primitive_lods[i + 1]; ++j) {
+				if (!r->lod_instances[j]) continue;
+				commands[command_count++] = (VkDrawIndexedIndirectCommand) {
+					r->lods[j].index_count,
+					r->lod_instances[j],
+					r->lods[j].first_index,
+					r->primitive_draws[i].vertexOffset,
+					instance
+				};
+				const unsigned first_instance = instance;
+				instance += r->lod_instances[j];
+				r->lod_instances[j] = first_instance;
+			}
+		}
+		uint32_t* const instances = frame_data + r->instance_offset;
+		for (unsigned i = 0; i < visible_count; ++i)
+			instances[r->lod_instances[r->instance_lods[i]]++] = r->instance_draws[i];
+		if (r->frame_data.staging_buffer && visible_count) {
+			const VkDeviceSize offset = frame_offset + r->instance_offset + r->draw_count * sizeof(uint32_t);
+			r->copy_regions[r->copy_region_count++] = (VkBufferCopy) {offset, offset, visible_count * sizeof(uint32_t)};
+		}
+	} else command_count = visible_count;
+	if (r->frame_data.staging_buffer && command_count) {
+		const VkDeviceSize offset = frame_offset + r->draw_offset;
+		r->copy_regions[r->copy_region_count++] = (VkBufferCopy) {
+			offset, offset,
+			command_count * sizeof(VkDrawIndexedIndirectCommand)
+		};
+	}
+	return command_count;
+}
+
+//Select the detail level of every draw without culling
+static unsigned select_lods(struct Renderer* const r) {
+	unsigned draw_count, triangle_count;
+	const unsigned command_count = write_node_draws(r, r->bvh.item_count, r->bvh.items, &draw_count, &triangle_count, NULL);
+	r->stats = (struct RenderStats) {draw_count, command_count, 0, 0, 0, 0, triangle_count, r->stats.gpu_time};
+	return command_count;
+}
+
+/*
+	Write the draw commands of nodes in the frustum to the current frame's region,
+	at their detail levels, after removing occluded nodes (software occlusion culling).
+	Returns the command count.
+*/
+static unsigned cull_nodes(struct Renderer* const r) {
+	if (r->stale_bvh) {
+		refit_bvh(&r->bvh, r->node_boxes);
+		r->stale_bvh = false;
+	}
+	//Each subtree's visible nodes are in its slots, then compacted
+	jobs_parallel_for(r->jobs, r->cull_root_count, cull_subtree, r);
+	unsigned frustum_draw_count = 0;
+	for (unsigned i = 0; i < r->cull_root_count; ++i)
+		frustum_draw_count += r->node_jobs[i].draw_count;
+	const unsigned frustum_count = compact_node_jobs(r->cull_root_count, r->node_jobs, r->visible_nodes, sizeof(unsigned));
+	const unsigned visible_count = r->culling == CULLING_SOFTWARE
+		? cull_occluded_nodes(r, frustum_count)
+		: frustum_count;
+	unsigned draw_count, triangle_count, visible_triangle_count;
+	const unsigned command_count = write_node_draws(
+		r,
+		visible_count, r->visible_nodes,
+		&draw_count, &triangle_count, &visible_triangle_count
+	);
+	//Statistics
+	r->stats.draw_count = draw_count;
+	r->stats.command_count = command_count;
+	r->stats.frustum_culled_count = r->draw_count - frustum_draw_count;
+	r->stats.occlusion_culled_count = frustum_draw_count - draw_count;
+	r->stats.cluster_culled_count = 0;
+	r->stats.culled_triangle_count = r->triangle_count - visible_triangle_count;
+	r->stats.triangle_count = triangle_count;
+	return command_count;
+}
+
+/*
+	Read the statistics of a completed frame.
+	Counts of CPU culling are written when culling, so they are of the last recorded frame.
+*/
+static void read_stats(struct Renderer* const r, const unsigned frame) {
+	if (r->submitted_count < r->frame_count) return; //Not submitted yet
+	switch (r->culling) {
+		case CULLING_NONE:
+			//Written when selecting detail levels
+			if (r->lod_threshold <= 0) r->stats = (struct RenderStats) {
+				r->draw_count,
+				r->instancing ? r->instanced_draw_count : r->draw_count,
+				0, 0, 0, 0,
+				r->triangle_count,
+				0
+			};
+			break;
+		case CULLING_CPU:
+		case CULLING_SOFTWARE:
+			break;
+		case CULLING_GPU:
+		case CULLING_OCCLUSION:
+		case CULLING_MESHLET: {
+			const struct LocalStats* const stats
+				= r->stats_alloc.mapped + r->stats_alloc.offsets[0] + frame * r->stats_stride;
+			r->stats.draw_count = stats->draw_count;
+			r->stats.command_count = stats->command_count;
+			r->stats.frustum_culled_count = stats->frustum_culled_count;
+			r->stats.occlusion_culled_count = stats->occlusion_culled_count;
+			r->stats.cluster_culled_count = stats->cluster_culled_count;
+			r->stats.culled_triangle_count = stats->culled_triangle_count;
+			r->stats.triangle_count = stats->triangle_count;
+			break;
+		}
+	}
+	uint64_t timestamps[2];
+	r->stats.gpu_time = r->timestamp_period && vkGetQueryPoolResults(
+		r->device,
+		r->query_pool,
+		2 * frame, 2,
+		sizeof(timestamps), timestamps,
+		sizeof(uint64_t),
+		VK_QUERY_RESULT_64_BIT
+	) == VK_SUCCESS
+		? (timestamps[1] - timestamps[0]) * r->timestamp_period * 1e-9
+		: 0;
+}
+
 void renderer_draw(struct Renderer* const r) {
-	const unsigned current_frame = (r->current_frame + 1) % r->frame_count;
-	r->current_frame = current_frame;
-	vkWaitForFences(r->device, 1, r->fences + current_frame, VK_FALSE, UINT64_MAX);
-	vkResetFences(r->device, 1, r->fences + current_frame);
+	//The frame's fence was waited on when it became current
+	const unsigned current_frame = r->current_frame;
 	//Acquire swapchain image
 	unsigned image_index;
 	VkResult swapchain_status = VK_ERROR_UNKNOWN;
@@ -1460,7 +2296,7 @@ void renderer_draw(struct Renderer* const r) {
 		swapchain_status = vkAcquireNextImageKHR(
 			r->device,
 			r->swapchain,
-			0,
+			UINT64_MAX,
 			r->semaphores[2 * current_frame],
 			NULL,
 			&image_index
@@ -1472,34 +2308,32 @@ void renderer_draw(struct Renderer* const r) {
 			create_swapchain(r, true);
 		}
 	}
-	//Copy local data to staging buffer
-	void* staging_data;
-	const VkMappedMemoryRange memory_range = {
-		VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE, NULL,
-		r->staging_alloc.memory,
-		current_frame * r->staging_size,
-		r->staging_size
-	};
-	vkMapMemory(
-		r->device,
-		memory_range.memory,
-		memory_range.offset,
-		memory_range.size,
-		0,
-		&staging_data
-	);
-	memcpy(staging_data, r->host_data, r->staging_size);
-	vkFlushMappedMemoryRanges(r->device, 1, &memory_range);
-	vkUnmapMemory(r->device, r->staging_alloc.memory);
+	vkResetFences(r->device, 1, r->fences + current_frame);
+	uploader_collect(&r->uploader);
 	//Record command buffer
-	record_draw_commands(r, current_frame, image_index, r->draw_count);
+	unsigned command_count = r->draw_count; //Maximum with GPU culling
+	if (r->culling == CULLING_CPU || r->culling == CULLING_SOFTWARE) command_count = cull_nodes(r);
+	else if (r->culling == CULLING_NONE && r->lod_threshold > 0) command_count = select_lods(r);
+	else if (r->culling == CULLING_NONE && r->instancing) command_count = r->instanced_draw_count;
+	record_draw_commands(r, current_frame, image_index, command_count);
 	//Submit command buffer to queue
-	const VkSemaphoreSubmitInfo wait_semaphore = {
-		VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO, NULL,
-		r->semaphores[2 * current_frame],
-		0,
-		VK_PIPELINE_STAGE_2_BLIT_BIT,
-		0
+	const VkSemaphoreSubmitInfo wait_semaphores[] = {
+		//Swapchain image
+		{
+			VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO, NULL,
+			r->semaphores[2 * current_frame],
+			0,
+			VK_PIPELINE_STAGE_2_BLIT_BIT,
+			0
+		},
+		//Scene uploads (already signaled once loading has finished)
+		{
+			VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO, NULL,
+			r->uploader.semaphore,
+			r->upload_value,
+			UPLOAD_DST_STAGES,
+			0
+		}
 	};
 	const VkCommandBufferSubmitInfo command_buffer = {
 		VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO, NULL,
@@ -1515,11 +2349,12 @@ void renderer_draw(struct Renderer* const r) {
 	};
 	const VkSubmitInfo2 submit_info = {
 		VK_STRUCTURE_TYPE_SUBMIT_INFO_2, NULL, 0,
-		1, &wait_semaphore,
+		2, wait_semaphores,
 		1, &command_buffer,
 		1, &signal_semaphore 
 	};
 	vkQueueSubmit2(r->graphics_queue, 1, &submit_info, r->fences[current_frame]);
+	if (r->submitted_count < r->frame_count) ++r->submitted_count;
 	//Presentation
 	const VkPresentInfoKHR present_info = {
 		VK_STRUCTURE_TYPE_PRESENT_INFO_KHR, NULL,
@@ -1529,15 +2364,36 @@ void renderer_draw(struct Renderer* const r) {
 		NULL
 	};
 	vkQueuePresentKHR(r->present_queue, &present_info);
-	vkQueueWaitIdle(r->graphics_queue);
+	//Advance to the next frame
+	/*
+		Only that frame's previous submission is waited on,
+		so recording continues while this frame executes.
+		Afterwards its frame data may be written by update calls.
+	*/
+	r->current_frame = (current_frame + 1) % r->frame_count;
+	vkWaitForFences(r->device, 1, r->fences + r->current_frame, VK_FALSE, UINT64_MAX);
+	read_stats(r, r->current_frame);
+}
+
+//Size of a buffer of count elements (at least one, as Vulkan has no empty buffers)
+static VkDeviceSize array_size(const unsigned count, const VkDeviceSize element_size) {
+	return (count ? count : 1) * element_size;
 }
 
 void renderer_load_scene(struct Renderer* const r, struct Scene scene) {
-	unsigned vertex_count = 0, index_count = 0;
+	//Nodes drawn in place of the scene's
+	const struct Scene source = scene;
+	if (r->static_batching) scene_batch_static(source, &scene, &r->scene_nodes);
+	else {
+		r->scene_nodes = malloc(scene.node_count * sizeof(unsigned));
+		for (unsigned i = 0; i < scene.node_count; ++i)
+			r->scene_nodes[i] = i;
+	}
+
+	unsigned vertex_count = 0, index_count = 0, primitive_count = 0, lod_count = 0, lod_index_count = 0;
 	//Create local meshes
 	struct LocalMesh* const local_meshes = malloc(scene.mesh_count * sizeof(struct LocalMesh));
-	VkDrawIndexedIndirectCommand* const mesh_draw_commands =
-		malloc(scene.mesh_count * sizeof(VkDrawIndexedIndirectCommand));
+	unsigned* const mesh_primitives = malloc((scene.mesh_count + 1) * sizeof(unsigned)); //First of each mesh
 	for (unsigned i = 0; i < scene.mesh_count; ++i) {
 		const struct Mesh mesh = scene.meshes[i];
 		struct LocalMesh local_mesh = {vertex_count, 0, index_count, 0};
@@ -1545,62 +2401,266 @@ void renderer_load_scene(struct Renderer* const r, struct Scene scene) {
 			const struct Primitive primitive = mesh.primitives[i];
 			local_mesh.vertex_count += primitive.vertex_count;
 			local_mesh.index_count += primitive.index_count;
+			lod_count += 1 + primitive.lod_count;
 		}
 		vertex_count += local_mesh.vertex_count;
 		index_count += local_mesh.index_count;
-		//Mesh draw command
-		mesh_draw_commands[i] = (VkDrawIndexedIndirectCommand) {
-			local_mesh.index_count,
-			1,
-			local_mesh.index_offset,
-			local_mesh.vertex_offset,
-			0
-		};
+		mesh_primitives[i] = primitive_count;
+		primitive_count += mesh.primitive_count;
 		local_meshes[i] = local_mesh;
 	}
-	//Fill vertex & index buffers
-	struct Vertex* const vertices = malloc(vertex_count * sizeof(struct Vertex));
-	unsigned* const indices = malloc(index_count * sizeof(unsigned));
-	vertex_count = 0;
-	index_count = 0;
+	mesh_primitives[scene.mesh_count] = primitive_count;
+	/*
+		Primitive draw commands (relative to the primitive's vertices) & detail levels:
+		the primitive's indices at full resolution, then its simplified levels,
+		whose indices follow every primitive's.
+	*/
+	r->primitive_count = primitive_count;
+	r->primitive_draws = malloc(primitive_count * sizeof(VkDrawIndexedIndirectCommand));
+	VkDrawIndexedIndirectCommand* const primitive_draws = r->primitive_draws;
+	struct Box* const primitive_boxes = malloc(primitive_count * sizeof(struct Box));
+	unsigned* const primitive_materials = malloc(primitive_count * sizeof(unsigned));
+	r->primitive_lods = malloc((primitive_count + 1) * sizeof(unsigned));
+	r->lods = malloc(lod_count * sizeof(struct Lod));
+	unsigned* const primitive_lod_index_counts = malloc(primitive_count * sizeof(unsigned));
+	lod_count = 0;
+	for (unsigned i = 0, k = 0; i < scene.mesh_count; ++i) {
+		const struct Mesh mesh = scene.meshes[i];
+		unsigned vertex_offset = local_meshes[i].vertex_offset, index_offset = local_meshes[i].index_offset;
+		for (unsigned j = 0; j < mesh.primitive_count; ++j, ++k) {
+			const struct Primitive primitive = mesh.primitives[j];
+			primitive_draws[k] = (VkDrawIndexedIndirectCommand) {
+				primitive.index_count,
+				1,
+				index_offset,
+				vertex_offset,
+				0
+			};
+			glm_vec3_copy((float*) primitive.box_start, primitive_boxes[k].start);
+			glm_vec3_copy((float*) primitive.box_end, primitive_boxes[k].end);
+			primitive_materials[k] = primitive.material;
+			r->primitive_lods[k] = lod_count;
+			r->lods[lod_count++] = (struct Lod) {index_offset, primitive.index_count, 0};
+			for (unsigned l = 0; l < primitive.lod_count; ++l) {
+				const struct Lod lod = primitive.lods[l];
+				r->lods[lod_count++] = (struct Lod) {index_count + lod_index_count + lod.first_index, lod.index_count, lod.error};
+			}
+			primitive_lod_index_counts[k] = primitive.lod_count
+				? primitive.lods[primitive.lod_count - 1].first_index + primitive.lods[primitive.lod_count - 1].index_count
+				: 0;
+			lod_index_count += primitive_lod_index_counts[k];
+			vertex_offset += primitive.vertex_count;
+			index_offset += primitive.index_count;
+		}
+	}
+	r->primitive_lods[primitive_count] = lod_count;
+	r->lod_count = lod_count;
+	//Compact vertex layout (indices are 16-bit if every primitive's vertices allow)
+	r->index_type = VK_INDEX_TYPE_UINT32;
+	if (r->compact_vertices) {
+		r->index_type = VK_INDEX_TYPE_UINT16;
+		for (unsigned i = 0; i < scene.mesh_count; ++i)
+			for (unsigned j = 0; j < scene.meshes[i].primitive_count; ++j)
+				if (scene.meshes[i].primitives[j].vertex_count > UINT16_MAX + 1) r->index_type = VK_INDEX_TYPE_UINT32;
+	}
+	const VkDeviceSize vertex_size = r->compact_vertices ? sizeof(struct CompactVertex) : sizeof(struct Vertex);
+	const VkDeviceSize index_size = r->index_type == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(unsigned);
+	//Mesh bounds
+	r->mesh_boxes = malloc(scene.mesh_count * sizeof(struct Box));
 	for (unsigned i = 0; i < scene.mesh_count; ++i) {
+		glm_vec3_copy(scene.meshes[i].box_start, r->mesh_boxes[i].start);
+		glm_vec3_copy(scene.meshes[i].box_end, r->mesh_boxes[i].end);
+	}
+	//Meshlets (each primitive's are consecutive)
+	unsigned meshlet_count = 0;
+	for (unsigned i = 0; i < scene.mesh_count; ++i)
+		for (unsigned j = 0; j < scene.meshes[i].primitive_count; ++j)
+			meshlet_count += scene.meshes[i].primitives[j].meshlet_count;
+	struct LocalMeshlet* const local_meshlets = malloc(meshlet_count * sizeof(struct LocalMeshlet));
+	unsigned* const primitive_meshlets = malloc((primitive_count + 1) * sizeof(unsigned)); //First of each primitive
+	meshlet_count = 0;
+	for (unsigned i = 0, k = 0; i < scene.mesh_count; ++i) {
 		const struct Mesh mesh = scene.meshes[i];
-		for (unsigned i = 0; i < mesh.primitive_count; ++i) {
-			const struct Primitive primitive = mesh.primitives[i];
-			memcpy(
-				vertices + vertex_count,
-				primitive.vertices,
-				primitive.vertex_count * sizeof(struct Vertex)
-			);
-			memcpy(
-				indices + index_count,
-				primitive.indices,
-				primitive.index_count * sizeof(unsigned)
-			);
-			vertex_count += primitive.vertex_count;
-			index_count += primitive.index_count;
+		for (unsigned j = 0; j < mesh.primitive_count; ++j, ++k) {
+			const struct Primitive primitive = mesh.primitives[j];
+			primitive_meshlets[k] = meshlet_count;
+			for (unsigned l = 0; l < primitive.meshlet_count; ++l) {
+				const struct Meshlet meshlet = primitive.meshlets[l];
+				local_meshlets[meshlet_count++] = (struct LocalMeshlet) {
+					{meshlet.center[0], meshlet.center[1], meshlet.center[2], meshlet.radius},
+					{meshlet.cone_axis[0], meshlet.cone_axis[1], meshlet.cone_axis[2], meshlet.cone_cutoff},
+					primitive_draws[k].firstIndex + meshlet.first_index,
+					meshlet.index_count,
+					primitive_draws[k].vertexOffset,
+					0
+				};
+			}
 		}
 	}
-	//Create local nodes & draw commands
+	primitive_meshlets[primitive_count] = meshlet_count;
+	r->meshlet_count = meshlet_count;
+	//Occluders (positions & indices of meshes with few enough triangles)
+	r->mesh_count = scene.mesh_count;
+	r->occluders = calloc(scene.mesh_count, sizeof(struct Occluder));
+	for (unsigned i = 0; i < scene.mesh_count; ++i) {
+		const struct Mesh mesh = scene.meshes[i];
+		struct Occluder* const occluder = r->occluders + i;
+		unsigned mesh_vertex_count = 0, mesh_index_count = 0;
+		for (unsigned j = 0; j < mesh.primitive_count; ++j) {
+			mesh_vertex_count += mesh.primitives[j].vertex_count;
+			mesh_index_count += mesh.primitives[j].index_count;
+		}
+		if (!mesh_index_count || mesh_index_count / 3 > OCCLUDER_MAX_TRIANGLES) continue;
+		*occluder = (struct Occluder) {
+			0,
+			malloc(mesh_vertex_count * sizeof(vec3)),
+			0,
+			malloc(mesh_index_count * sizeof(unsigned))
+		};
+		for (unsigned j = 0; j < mesh.primitive_count; ++j) {
+			const struct Primitive primitive = mesh.primitives[j];
+			for (unsigned k = 0; k < primitive.index_count; ++k)
+				occluder->indices[occluder->index_count++] = occluder->vertex_count + primitive.indices[k];
+			for (unsigned k = 0; k < primitive.vertex_count; ++k)
+				glm_vec3_copy(primitive.vertices[k].pos, occluder->positions[occluder->vertex_count++]);
+		}
+	}
+	//Create local nodes, node bounds & draw commands (only nodes with meshes are drawn, one draw per primitive)
 	struct LocalNode* const local_nodes = malloc(scene.node_count * sizeof(struct LocalNode));
-	VkDrawIndexedIndirectCommand* const draw_commands =
-		malloc(scene.node_count * sizeof(VkDrawIndexedIndirectCommand));
+	r->node_boxes = calloc(scene.node_count, sizeof(struct Box));
+	r->node_first_draws = malloc((scene.node_count + 1) * sizeof(unsigned));
+	r->visible_nodes = malloc(scene.node_count * sizeof(unsigned));
+	r->node_meshes = calloc(scene.node_count, sizeof(unsigned));
+	r->node_transformations = malloc(scene.node_count * sizeof(mat4));
+	struct LocalQuantization* const node_quantizations = calloc(scene.node_count, sizeof(struct LocalQuantization));
+	//Count the draws of each primitive (instance counts), which are consecutive from its first instance
+	for (unsigned i = 0; i < primitive_count; ++i)
+		primitive_draws[i].instanceCount = 0;
+	r->meshlet_draw_count = 0;
+	for (unsigned i = 0; i < scene.node_count; ++i) {
+		if (!scene.nodes[i].has_mesh) continue;
+		const unsigned mesh = scene.nodes[i].mesh;
+		for (unsigned j = mesh_primitives[mesh]; j < mesh_primitives[mesh + 1]; ++j)
+			++primitive_draws[j].instanceCount;
+		r->meshlet_draw_count += primitive_meshlets[mesh_primitives[mesh + 1]] - primitive_meshlets[mesh_primitives[mesh]];
+	}
+	unsigned draw_count = 0;
+	r->instanced_draw_count = 0;
+	for (unsigned i = 0; i < primitive_count; ++i) {
+		primitive_draws[i].firstInstance = draw_count;
+		draw_count += primitive_draws[i].instanceCount;
+		if (primitive_draws[i].instanceCount) ++r->instanced_draw_count;
+		primitive_draws[i].instanceCount = 0; //Counted again as draws are assigned
+	}
+	r->draws = malloc(draw_count * sizeof(VkDrawIndexedIndirectCommand));
+	r->node_draws = malloc(draw_count * sizeof(unsigned));
+	r->draw_primitives = malloc(draw_count * sizeof(unsigned));
+	struct LocalBounds* const draw_bounds = malloc(draw_count * sizeof(struct LocalBounds));
+	struct LocalDraw* const local_draws = malloc(draw_count * sizeof(struct LocalDraw));
+	struct LocalMeshletDraw* const meshlet_draws = malloc(r->meshlet_draw_count * sizeof(struct LocalMeshletDraw));
+	unsigned mesh_node_count = 0, meshlet_draw_count = 0;
+	r->draw_count = 0;
+	r->triangle_count = 0;
 	for (unsigned i = 0; i < scene.node_count; ++i) {
 		struct Node node = scene.nodes[i];
 		struct LocalNode local_node;
 		glm_mat4_copy(node.transformation, local_node.transformation);
 		local_nodes[i] = local_node;
-		draw_commands[i] = mesh_draw_commands[node.mesh];
+		r->node_first_draws[i] = r->draw_count;
+		if (!node.has_mesh) continue;
+		transform_box(r->mesh_boxes[node.mesh], node.transformation, r->node_boxes + i);
+		r->node_meshes[i] = node.mesh;
+		glm_mat4_copy(node.transformation, r->node_transformations[i]);
+		memcpy(node_quantizations[i].offset, scene.meshes[node.mesh].quantization_offset, sizeof(vec3));
+		memcpy(node_quantizations[i].scale, scene.meshes[node.mesh].quantization_scale, sizeof(vec3));
+		r->visible_nodes[mesh_node_count++] = i;
+		for (unsigned j = mesh_primitives[node.mesh]; j < mesh_primitives[node.mesh + 1]; ++j) {
+			const unsigned draw = primitive_draws[j].firstInstance + primitive_draws[j].instanceCount++;
+			r->node_draws[r->draw_count++] = draw;
+			r->draws[draw] = primitive_draws[j];
+			r->draws[draw].instanceCount = 1;
+			r->draws[draw].firstInstance = draw;
+			r->draw_primitives[draw] = j;
+			local_draws[draw] = (struct LocalDraw) {i, primitive_materials[j]};
+			const struct Box box = primitive_boxes[j];
+			struct LocalBounds* const bounds = draw_bounds + draw;
+			for (unsigned k = 0; k < 3; ++k) {
+				bounds->center[k] = (box.start[k] + box.end[k]) / 2;
+				bounds->extent[k] = (box.end[k] - box.start[k]) / 2;
+			}
+			bounds->center[3] = bounds->extent[3] = 0;
+			bounds->first_lod = r->primitive_lods[j];
+			bounds->lod_count = r->primitive_lods[j + 1] - r->primitive_lods[j];
+			bounds->node = i;
+			bounds->padding = 0;
+			r->triangle_count += r->draws[draw].indexCount / 3;
+			for (unsigned k = primitive_meshlets[j]; k < primitive_meshlets[j + 1]; ++k)
+				meshlet_draws[meshlet_draw_count++] = (struct LocalMeshletDraw) {draw, k};
+		}
+	}
+	r->node_first_draws[scene.node_count] = r->draw_count;
+	//Instanced commands of primitives with draws
+	VkDrawIndexedIndirectCommand* const instanced_draws
+		= malloc(r->instanced_draw_count * sizeof(VkDrawIndexedIndirectCommand));
+	for (unsigned i = 0, j = 0; i < primitive_count; ++i)
+		if (primitive_draws[i].instanceCount) instanced_draws[j++] = primitive_draws[i];
+	r->instance_draws = malloc(r->draw_count * sizeof(unsigned));
+	r->instance_lods = malloc(r->draw_count * sizeof(unsigned));
+	r->lod_instances = malloc(lod_count * sizeof(unsigned));
+	/*
+		Instance groups of GPU culling: instanced commands of each detail level, then of each meshlet.
+		Each has room for its primitive's draws in the instances after the identity
+		(detail levels' in each list's range of lod_instance_count, meshlets' in one).
+	*/
+	VkDrawIndexedIndirectCommand* const groups
+		= malloc((lod_count + meshlet_count) * sizeof(VkDrawIndexedIndirectCommand));
+	r->lod_instance_count = 0;
+	for (unsigned i = 0, meshlet_instance_count = 0; i < primitive_count; ++i) {
+		const unsigned primitive_draw_count = primitive_draws[i].instanceCount;
+		for (unsigned j = r->primitive_lods[i]; j < r->primitive_lods[i + 1]; ++j) {
+			groups[j] = (VkDrawIndexedIndirectCommand) {
+				r->lods[j].index_count,
+				0,
+				r->lods[j].first_index,
+				primitive_draws[i].vertexOffset,
+				r->draw_count + r->lod_instance_count
+			};
+			r->lod_instance_count += primitive_draw_count;
+		}
+		for (unsigned j = primitive_meshlets[i]; j < primitive_meshlets[i + 1]; ++j) {
+			groups[lod_count + j] = (VkDrawIndexedIndirectCommand) {
+				local_meshlets[j].index_count,
+				0,
+				local_meshlets[j].first_index,
+				local_meshlets[j].vertex_offset,
+				r->draw_count + meshlet_instance_count
+			};
+			meshlet_instance_count += primitive_draw_count;
+		}
 	}
-	free(mesh_draw_commands);
-	r->draw_count = scene.node_count;
+	free(mesh_primitives);
+	free(primitive_boxes);
+	free(primitive_materials);
+	free(primitive_meshlets);
+	create_bvh(mesh_node_count, r->visible_nodes, r->node_boxes, &r->bvh);
+	create_occlusion_buffer(OCCLUSION_BUFFER_WIDTH, OCCLUSION_BUFFER_HEIGHT, &r->occlusion_buffer);
+	r->screen_boxes = malloc(mesh_node_count * sizeof(struct Box));
+	r->occluder_candidates = malloc(mesh_node_count * sizeof(struct OccluderCandidate));
+	r->cull_roots = malloc(r->bvh.node_count * sizeof(unsigned));
+	r->cull_root_count = split_bvh(&r->bvh, CULL_GRAIN, r->cull_roots);
+	const unsigned node_job_count = (mesh_node_count + CULL_GRAIN - 1) / CULL_GRAIN;
+	r->node_jobs = malloc(
+		(r->cull_root_count > node_job_count ? r->cull_root_count : node_job_count) * sizeof(struct NodeJob)
+	);
+	r->stale_bvh = false;
+	r->reset_visibility = true;
 
 	//Create static buffers
 	const VkBufferCreateInfo buffer_infos[] = {
 		//Vertices
 		{
 			VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, NULL, 0,
-			vertex_count * sizeof(struct Vertex),
+			array_size(vertex_count, vertex_size),
 			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 			VK_SHARING_MODE_EXCLUSIVE,
 			0, NULL
@@ -1608,7 +2668,7 @@ void renderer_load_scene(struct Renderer* const r, struct Scene scene) {
 		//Indices
 		{
 			VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, NULL, 0,
-			index_count * sizeof(unsigned),
+			array_size(index_count + lod_index_count, index_size),
 			VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 			VK_SHARING_MODE_EXCLUSIVE,
 			0, NULL
@@ -1616,7 +2676,7 @@ void renderer_load_scene(struct Renderer* const r, struct Scene scene) {
 		//Meshes
 		{
 			VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, NULL, 0,
-			scene.mesh_count * sizeof(struct LocalMesh),
+			array_size(scene.mesh_count, sizeof(struct LocalMesh)),
 			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 			VK_SHARING_MODE_EXCLUSIVE,
 			0, NULL
@@ -1624,59 +2684,229 @@ void renderer_load_scene(struct Renderer* const r, struct Scene scene) {
 		//Draw commands
 		{
 			VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, NULL, 0,
-			scene.node_count * sizeof(VkDrawIndexedIndirectCommand),
-			VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			array_size(r->draw_count + r->instanced_draw_count, sizeof(VkDrawIndexedIndirectCommand)),
+			VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT
+			| VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+			| VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 			VK_SHARING_MODE_EXCLUSIVE,
 			0, NULL
 		},
 		//Materials
 		{
 			VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, NULL, 0,
-			scene.material_count * sizeof(struct Material),
+			array_size(scene.material_count, sizeof(struct Material)),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_SHARING_MODE_EXCLUSIVE,
+			0, NULL
+		},
+		//Draw bounds
+		{
+			VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, NULL, 0,
+			array_size(r->draw_count, sizeof(struct LocalBounds)),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_SHARING_MODE_EXCLUSIVE,
+			0, NULL
+		},
+		//Meshlets
+		{
+			VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, NULL, 0,
+			array_size(meshlet_count, sizeof(struct LocalMeshlet)),
 			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 			VK_SHARING_MODE_EXCLUSIVE,
 			0, NULL
 		},
+		//Meshlet draws
+		{
+			VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, NULL, 0,
+			array_size(r->meshlet_draw_count, sizeof(struct LocalMeshletDraw)),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_SHARING_MODE_EXCLUSIVE,
+			0, NULL
+		},
+		//Detail levels
+		{
+			VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, NULL, 0,
+			array_size(lod_count, sizeof(struct Lod)),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_SHARING_MODE_EXCLUSIVE,
+			0, NULL
+		},
+		//Node quantization
+		{
+			VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, NULL, 0,
+			array_size(scene.node_count, sizeof(struct LocalQuantization)),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_SHARING_MODE_EXCLUSIVE,
+			0, NULL
+		},
+		//Draw data
+		{
+			VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, NULL, 0,
+			array_size(r->draw_count, sizeof(struct LocalDraw)),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_SHARING_MODE_EXCLUSIVE,
+			0, NULL
+		},
+		//Instance groups
+		{
+			VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, NULL, 0,
+			array_size(lod_count + meshlet_count, sizeof(VkDrawIndexedIndirectCommand)),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_SHARING_MODE_EXCLUSIVE,
+			0, NULL
+		}
 	};
 	if (create_buffers(
-		r->physical_device,
-		r->device,
-		5, buffer_infos,
+		&r->allocator,
+		12, buffer_infos,
 		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 		r->static_buffers,
 		&r->static_alloc
 	)) fprintf(stderr, "Error creating static scene buffers!\n");
-	//Write to static buffers
-	const void* data[] = {vertices, indices, local_meshes, draw_commands, scene.materials};
-	const size_t sizes[] = {
-		buffer_infos[0].size, 
-		buffer_infos[1].size, 
-		buffer_infos[2].size, 
-		buffer_infos[3].size,
-		buffer_infos[4].size
-	};
-	staged_buffer_write(
-		r->physical_device,
-		r->device,
-		r->transfer_command_buffer,
-		r->graphics_queue,
-		5, r->static_buffers, data, sizes
+	//Culling output, written by the compute pass
+	const VkBufferCreateInfo cull_buffer_infos[] = {
+		//Culled draws (early & late, or meshlets)
+		{
+			VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, NULL, 0,
+			array_size(
+				2 * r->draw_count > r->meshlet_draw_count ? 2 * r->draw_count : r->meshlet_draw_count,
+				sizeof(VkDrawIndexedIndirectCommand)
+			),
+			VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_SHARING_MODE_EXCLUSIVE,
+			0, NULL
+		},
+		//Culled draw counts
+		{
+			VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, NULL, 0,
+			2 * sizeof(uint32_t),
+			VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT
+			| VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+			| VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_SHARING_MODE_EXCLUSIVE,
+			0, NULL
+		},
+		//Visibility
+		{
+			VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, NULL, 0,
+			array_size(r->draw_count, sizeof(uint32_t)),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_SHARING_MODE_EXCLUSIVE,
+			0, NULL
+		},
+		//Group instance counts (early & late)
+		{
+			VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, NULL, 0,
+			array_size(2 * (lod_count > meshlet_count ? lod_count : meshlet_count), sizeof(uint32_t)),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_SHARING_MODE_EXCLUSIVE,
+			0, NULL
+		}
+	};
+	if (create_buffers(
+		&r->allocator,
+		4, cull_buffer_infos,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		r->cull_buffers,
+		&r->cull_alloc
+	)) fprintf(stderr, "Error creating culling buffers!\n");
+	/*
+		Write to static buffers.
+		Primitive geometry is gathered straight from the scene into staging,
+		vertices, indices & simplified levels' indices each forming one part per primitive.
+		The compact layout gathers converted copies instead.
+	*/
+	struct CompactVertex* const compact_vertices =
+		r->compact_vertices ? malloc(vertex_count * sizeof(struct CompactVertex)) : NULL;
+	uint16_t* const short_indices =
+		index_size == sizeof(uint16_t) ? malloc((index_count + lod_index_count) * sizeof(uint16_t)) : NULL;
+	const unsigned part_count = 3 * primitive_count + 11;
+	const void** const data = malloc(part_count * sizeof(void*));
+	VkDeviceSize* const sizes = malloc(part_count * sizeof(VkDeviceSize));
+	unsigned part = 0, vertex_offset = 0, index_offset = 0, lod_index_offset = index_count;
+	for (unsigned i = 0; i < scene.mesh_count; ++i) {
+		const struct Mesh mesh = scene.meshes[i];
+		for (unsigned j = 0; j < mesh.primitive_count; ++j, ++part) {
+			const struct Primitive primitive = mesh.primitives[j];
+			data[part] = primitive.vertices;
+			if (compact_vertices) {
+				quantize_vertices(
+					primitive.vertex_count, primitive.vertices, primitive.grid_positions,
+					mesh.quantization_offset, mesh.quantization_scale,
+					compact_vertices + vertex_offset
+				);
+				data[part] = compact_vertices + vertex_offset;
+			}
+			sizes[part] = primitive.vertex_count * vertex_size;
+			data[primitive_count + part] = primitive.indices;
+			if (short_indices) {
+				for (unsigned k = 0; k < primitive.index_count; ++k)
+					short_indices[index_offset + k] = primitive.indices[k];
+				data[primitive_count + part] = short_indices + index_offset;
+			}
+			sizes[primitive_count + part] = primitive.index_count * index_size;
+			const unsigned primitive_lod_index_count = primitive_lod_index_counts[part];
+			data[2 * primitive_count + part] = primitive.lod_indices;
+			if (short_indices) {
+				for (unsigned k = 0; k < primitive_lod_index_count; ++k)
+					short_indices[lod_index_offset + k] = primitive.lod_indices[k];
+				data[2 * primitive_count + part] = short_indices + lod_index_offset;
+			}
+			sizes[2 * primitive_count + part] = primitive_lod_index_count * index_size;
+			vertex_offset += primitive.vertex_count;
+			index_offset += primitive.index_count;
+			lod_index_offset += primitive_lod_index_count;
+		}
+	}
+	part = 3 * primitive_count;
+	data[part] = local_meshes;
+	sizes[part++] = scene.mesh_count * sizeof(struct LocalMesh);
+	data[part] = r->draws;
+	sizes[part++] = r->draw_count * sizeof(VkDrawIndexedIndirectCommand);
+	data[part] = instanced_draws;
+	sizes[part++] = r->instanced_draw_count * sizeof(VkDrawIndexedIndirectCommand);
+	data[part] = scene.materials;
+	sizes[part++] = scene.material_count * sizeof(struct Material);
+	data[part] = draw_bounds;
+	sizes[part++] = r->draw_count * sizeof(struct LocalBounds);
+	data[part] = local_meshlets;
+	sizes[part++] = meshlet_count * sizeof(struct LocalMeshlet);
+	data[part] = meshlet_draws;
+	sizes[part++] = r->meshlet_draw_count * sizeof(struct LocalMeshletDraw);
+	data[part] = r->lods;
+	sizes[part++] = lod_count * sizeof(struct Lod);
+	data[part] = node_quantizations;
+	sizes[part++] = scene.node_count * sizeof(struct LocalQuantization);
+	data[part] = local_draws;
+	sizes[part++] = r->draw_count * sizeof(struct LocalDraw);
+	data[part] = groups;
+	sizes[part++] = (lod_count + meshlet_count) * sizeof(VkDrawIndexedIndirectCommand);
+	const unsigned part_counts[] = {primitive_count, 2 * primitive_count, 1, 2, 1, 1, 1, 1, 1, 1, 1, 1};
+	upload_buffer_parts(
+		&r->uploader,
+		12, r->static_buffers, part_counts, data, sizes
 	);
+	free(data);
+	free(sizes);
 	free(local_meshes);
-	free(vertices);
-	free(indices);
-	free(draw_commands);
-	free(local_nodes);
+	free(draw_bounds);
+	free(local_meshlets);
+	free(meshlet_draws);
+	free(primitive_lod_index_counts);
+	free(node_quantizations);
+	free(local_draws);
+	free(instanced_draws);
+	free(groups);
+	free(compact_vertices);
+	free(short_indices);
 
 	//Textures
 	r->texture_count = scene.texture_count;
 	r->textures = malloc(scene.texture_count * sizeof(VkImage));
 	r->texture_views = malloc(scene.texture_count * sizeof(VkImageView));
-	write_textures_to_images(
-		r->physical_device,
-		r->device,
-		r->transfer_command_buffer,
-		r->graphics_queue,
+	r->upload_value = write_textures_to_images(
+		&r->allocator,
+		&r->uploader,
 		scene.texture_count,
 		scene.textures,
 		r->textures,
@@ -1684,12 +2914,39 @@ void renderer_load_scene(struct Renderer* const r, struct Scene scene) {
 		&r->texture_alloc
 	);
 
-	//Create dynamic buffers
-	VkDeviceSize uniform_size = sizeof(struct LocalCamera),
-		storage_size = scene.node_count * sizeof(struct LocalNode),
-		staging_size = uniform_size + storage_size;
-	r->host_data = malloc(staging_size);
-	create_frame_data(r, staging_size, uniform_size, storage_size);
+	//Create frame data (instances of CPU culling, or of the culling pass's groups, follow the identity)
+	unsigned instance_count = 2 * r->draw_count;
+	if (r->instancing) instance_count = r->draw_count + (
+		2 * r->lod_instance_count > r->meshlet_draw_count ? 2 * r->lod_instance_count : r->meshlet_draw_count
+	);
+	create_frame_data(
+		r,
+		sizeof(struct LocalCamera),
+		array_size(scene.node_count, sizeof(struct LocalNode)),
+		array_size(r->draw_count, sizeof(VkDrawIndexedIndirectCommand)),
+		array_size(instance_count, sizeof(uint32_t))
+	);
+	//Write every node & the identity instances to every frame region (neither is written again)
+	for (unsigned i = 0; i < r->frame_count; ++i) {
+		memcpy(frame_ring_data(&r->frame_data, i) + r->storage_offset, local_nodes, scene.node_count * sizeof(struct LocalNode));
+		uint32_t* const instances = frame_ring_data(&r->frame_data, i) + r->instance_offset;
+		for (unsigned j = 0; j < r->draw_count; ++j)
+			instances[j] = j;
+	}
+	r->stale_frame_count = r->frame_count;
+	free(local_nodes);
+	//Dynamic nodes
+	r->dynamic_node_count = 0;
+	r->dynamic_nodes = malloc(scene.node_count * sizeof(unsigned));
+	for (unsigned i = 0; i < source.node_count; ++i)
+		source.nodes[i].dirty = false;
+	for (unsigned i = 0; i < scene.node_count; ++i)
+		if (scene.nodes[i].dynamic) r->dynamic_nodes[r->dynamic_node_count++] = i;
+	r->pending_node_count = 0;
+	r->pending_nodes = malloc(scene.node_count * sizeof(unsigned));
+	r->pending_frames = calloc(scene.node_count, sizeof(unsigned char));
+	r->copy_region_count = 0;
+	r->copy_regions = malloc((scene.node_count + 3) * sizeof(VkBufferCopy)); //Nodes, draw commands, instances & camera
 
 	//Texture descriptor information
 	VkDescriptorImageInfo* const texture_descriptor_infos
@@ -1707,18 +2964,28 @@ void renderer_load_scene(struct Renderer* const r, struct Scene scene) {
 			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
 		};
 	}
-	//Update descriptors
-	const unsigned descriptor_count = 4 * r->frame_count;
+	//Update descriptors (writes point to their buffer infos until the update)
+	const unsigned descriptor_count = 22 * r->frame_count;
 	VkWriteDescriptorSet* const descriptor_writes
 		= malloc(descriptor_count * sizeof(VkWriteDescriptorSet));
+	VkDescriptorBufferInfo* const buffer_descriptor_infos
+		= malloc(18 * r->frame_count * sizeof(VkDescriptorBufferInfo));
+	const VkDescriptorImageInfo pyramid_descriptor_info = {
+		VK_NULL_HANDLE, //Immutable
+		r->pyramid_view,
+		VK_IMAGE_LAYOUT_GENERAL
+	};
 	for (unsigned i = 0; i < r->frame_count; ++i) {
+		const VkDeviceSize frame_offset = i * r->frame_data.frame_size;
+		VkDescriptorBufferInfo* const infos = buffer_descriptor_infos + 18 * i;
+		VkWriteDescriptorSet* const writes = descriptor_writes + 22 * i;
 		//Uniform buffer
-		const VkDescriptorBufferInfo uniform_buffer_info = {
-			r->frame_buffers[2 * i],
-			0,
-			VK_WHOLE_SIZE
+		infos[0] = (VkDescriptorBufferInfo) {
+			r->frame_data.buffer,
+			frame_offset + r->uniform_offset,
+			r->uniform_size
 		};
-		descriptor_writes[4 * i] = (VkWriteDescriptorSet) {
+		writes[0] = (VkWriteDescriptorSet) {
 			VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL,
 			r->descriptor_sets[i],
 			0, //Binding
@@ -1726,16 +2993,16 @@ void renderer_load_scene(struct Renderer* const r, struct Scene scene) {
 			1,
 			VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
 			NULL,
-			&uniform_buffer_info,
+			infos,
 			NULL
 		};
 		//Node buffer
-		const VkDescriptorBufferInfo node_buffer_info = {
-			r->frame_buffers[2 * i + 1],
-			0,
-			VK_WHOLE_SIZE
+		infos[1] = (VkDescriptorBufferInfo) {
+			r->frame_data.buffer,
+			frame_offset + r->storage_offset,
+			r->storage_size
 		};
-		descriptor_writes[4 * i + 1] = (VkWriteDescriptorSet) {
+		writes[1] = (VkWriteDescriptorSet) {
 			VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL,
 			r->descriptor_sets[i],
 			1, //Binding
@@ -1743,16 +3010,16 @@ void renderer_load_scene(struct Renderer* const r, struct Scene scene) {
 			1,
 			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
 			NULL,
-			&node_buffer_info,
+			infos + 1,
 			NULL
 		};
 		//Material buffer
-		const VkDescriptorBufferInfo material_buffer_info = {
+		infos[2] = (VkDescriptorBufferInfo) {
 			r->static_buffers[4],
 			0,
 			VK_WHOLE_SIZE
 		};
-		descriptor_writes[4 * i + 2] = (VkWriteDescriptorSet) {
+		writes[2] = (VkWriteDescriptorSet) {
 			VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL,
 			r->descriptor_sets[i],
 			2, //Binding
@@ -1760,11 +3027,11 @@ void renderer_load_scene(struct Renderer* const r, struct Scene scene) {
 			1,
 			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
 			NULL,
-			&material_buffer_info,
+			infos + 2,
 			NULL
 		};
 		//Textures
-		descriptor_writes[4 * i + 3] = (VkWriteDescriptorSet) {
+		writes[3] = (VkWriteDescriptorSet) {
 			VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL,
 			r->descriptor_sets[i],
 			4, //Binding
@@ -1775,20 +3042,169 @@ void renderer_load_scene(struct Renderer* const r, struct Scene scene) {
 			NULL,
 			NULL
 		};
+		//Culling (draws, draw bounds, nodes, culled draws & their count)
+		infos[3] = (VkDescriptorBufferInfo) {r->static_buffers[3], 0, VK_WHOLE_SIZE};
+		infos[4] = (VkDescriptorBufferInfo) {r->static_buffers[5], 0, VK_WHOLE_SIZE};
+		infos[5] = infos[1];
+		infos[6] = (VkDescriptorBufferInfo) {r->cull_buffers[0], 0, VK_WHOLE_SIZE};
+		infos[7] = (VkDescriptorBufferInfo) {r->cull_buffers[1], 0, VK_WHOLE_SIZE};
+		for (unsigned j = 0; j < 5; ++j)
+			writes[4 + j] = (VkWriteDescriptorSet) {
+				VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL,
+				r->cull_descriptor_sets[i],
+				j, //Binding
+				0,
+				1,
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				NULL,
+				infos + 3 + j,
+				NULL
+			};
+		//Occlusion culling (camera, depth pyramid, visibility & statistics)
+		writes[9] = writes[0];
+		writes[9].dstSet = r->cull_descriptor_sets[i];
+		writes[9].dstBinding = 5;
+		writes[10] = (VkWriteDescriptorSet) {
+			VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL,
+			r->cull_descriptor_sets[i],
+			6, //Binding
+			0,
+			1,
+			VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+			&pyramid_descriptor_info,
+			NULL,
+			NULL
+		};
+		infos[8] = (VkDescriptorBufferInfo) {r->cull_buffers[2], 0, VK_WHOLE_SIZE};
+		infos[9] = (VkDescriptorBufferInfo) {r->stats_buffer, i * r->stats_stride, sizeof(struct LocalStats)};
+		for (unsigned j = 0; j < 2; ++j)
+			writes[11 + j] = (VkWriteDescriptorSet) {
+				VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL,
+				r->cull_descriptor_sets[i],
+				7 + j, //Binding
+				0,
+				1,
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				NULL,
+				infos + 8 + j,
+				NULL
+			};
+		//Meshlet culling (meshlets & meshlet draws) & detail levels
+		infos[10] = (VkDescriptorBufferInfo) {r->static_buffers[6], 0, VK_WHOLE_SIZE};
+		infos[11] = (VkDescriptorBufferInfo) {r->static_buffers[7], 0, VK_WHOLE_SIZE};
+		infos[12] = (VkDescriptorBufferInfo) {r->static_buffers[8], 0, VK_WHOLE_SIZE};
+		for (unsigned j = 0; j < 3; ++j)
+			writes[13 + j] = (VkWriteDescriptorSet) {
+				VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL,
+				r->cull_descriptor_sets[i],
+				9 + j, //Binding
+				0,
+				1,
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				NULL,
+				infos + 10 + j,
+				NULL
+			};
+		//Node quantization & draw data
+		infos[13] = (VkDescriptorBufferInfo) {r->static_buffers[9], 0, VK_WHOLE_SIZE};
+		infos[14] = (VkDescriptorBufferInfo) {r->static_buffers[10], 0, VK_WHOLE_SIZE};
+		for (unsigned j = 0; j < 2; ++j)
+			writes[16 + j] = (VkWriteDescriptorSet) {
+				VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL,
+				r->descriptor_sets[i],
+				5 + j, //Binding
+				0,
+				1,
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				NULL,
+				infos + 13 + j,
+				NULL
+			};
+		//Instances
+		infos[15] = (VkDescriptorBufferInfo) {
+			r->frame_data.buffer,
+			frame_offset + r->instance_offset,
+			r->instance_size
+		};
+		writes[18] = (VkWriteDescriptorSet) {
+			VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL,
+			r->descriptor_sets[i],
+			7, //Binding
+			0,
+			1,
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			NULL,
+			infos + 15,
+			NULL
+		};
+		//Instance groups, their instance counts & instances (culling)
+		infos[16] = (VkDescriptorBufferInfo) {r->static_buffers[11], 0, VK_WHOLE_SIZE};
+		infos[17] = (VkDescriptorBufferInfo) {r->cull_buffers[3], 0, VK_WHOLE_SIZE};
+		for (unsigned j = 0; j < 3; ++j)
+			writes[19 + j] = (VkWriteDescriptorSet) {
+				VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL,
+				r->cull_descriptor_sets[i],
+				12 + j, //Binding
+				0,
+				1,
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				NULL,
+				j < 2 ? infos + 16 + j : infos + 15,
+				NULL
+			};
 	}
 	vkUpdateDescriptorSets(r->device, descriptor_count, descriptor_writes, 0, NULL);
 	free(descriptor_writes);
+	free(buffer_descriptor_infos);
 	free(texture_descriptor_infos);
+	if (r->static_batching) scene_destroy_batches(scene, source.mesh_count);
 }
 
 void renderer_destroy_scene(struct Renderer* const r) {
 	vkQueueWaitIdle(r->graphics_queue);
+	uploader_wait(&r->uploader, r->upload_value);
+	uploader_collect(&r->uploader);
 	destroy_frame_data(r);
-	free(r->host_data);
+	free(r->scene_nodes);
+	free(r->dynamic_nodes);
+	free(r->pending_nodes);
+	free(r->pending_frames);
+	free(r->copy_regions);
+	//Culling
+	free(r->mesh_boxes);
+	free(r->node_boxes);
+	free(r->draws);
+	free(r->node_draws);
+	free(r->node_first_draws);
+	free(r->draw_primitives);
+	free(r->visible_nodes);
+	for (unsigned i = 0; i < r->mesh_count; ++i) {
+		free(r->occluders[i].positions);
+		free(r->occluders[i].indices);
+	}
+	free(r->occluders);
+	free(r->node_meshes);
+	free(r->node_transformations);
+	destroy_occlusion_buffer(&r->occlusion_buffer);
+	free(r->screen_boxes);
+	free(r->occluder_candidates);
+	free(r->lods);
+	free(r->primitive_lods);
+	destroy_bvh(&r->bvh);
+	free(r->cull_roots);
+	free(r->node_jobs);
+	//Instancing
+	free(r->primitive_draws);
+	free(r->instance_draws);
+	free(r->instance_lods);
+	free(r->lod_instances);
 	//Static buffers
-	for (unsigned i = 0; i < 5; ++i)
+	for (unsigned i = 0; i < 12; ++i)
 		vkDestroyBuffer(r->device, r->static_buffers[i], NULL);
-	free_allocation(r->device, r->static_alloc);
+	free_allocation(&r->allocator, r->static_alloc);
+	for (unsigned i = 0; i < 4; ++i)
+		vkDestroyBuffer(r->device, r->cull_buffers[i], NULL);
+	free_allocation(&r->allocator, r->cull_alloc);
 	//Textures
 	for (unsigned i = 0; i < r->texture_count; ++i) {
 		vkDestroyImageView(r->device, r->texture_views[i], NULL);
@@ -1796,27 +3212,72 @@ void renderer_destroy_scene(struct Renderer* const r) {
 	}
 	free(r->textures);
 	free(r->texture_views);
-	free_allocation(r->device, r->texture_alloc);
+	free_allocation(&r->allocator, r->texture_alloc);
 }
 
 void renderer_update_camera(struct Renderer* const r, const struct Camera camera) {
-	struct LocalCamera local_camera;
-	camera_view(camera, local_camera.view);
-	camera_projection(camera, local_camera.projection);
-	memcpy(r->host_data, &local_camera, sizeof(struct LocalCamera));
+	struct LocalCamera* const local_camera
+		= frame_ring_data(&r->frame_data, r->current_frame) + r->uniform_offset;
+	//The frame's region is only written
+	mat4 view, projection;
+	camera_view(camera, view);
+	camera_projection(camera, projection);
+	glm_mat4_copy(view, local_camera->view);
+	glm_mat4_copy(projection, local_camera->projection);
+	camera_frustum(camera, r->frustum);
+	glm_mat4_mul(projection, view, r->view_projection);
+	glm_vec3_copy(camera.position, r->camera_position);
+	r->lod_scale = fabsf(projection[1][1]) * 0.5f * r->resolution.height;
+	r->perspective = camera.projection == PERSPECTIVE;
 }
 
-void renderer_update_nodes(struct Renderer* const r, const struct Scene scene) {
-	//Create local nodes
-	const size_t local_nodes_size = scene.node_count * sizeof(struct LocalNode);
-	struct LocalNode* const local_nodes = malloc(local_nodes_size);
-	for (unsigned i = 0; i < scene.node_count; ++i) {
-		struct Node node = scene.nodes[i];
-		struct LocalNode local_node;
-		glm_mat4_copy(node.transformation, local_node.transformation);
-		local_nodes[i] = local_node;
+static int compare_nodes(const void* a, const void* b) {
+	const unsigned x = *(const unsigned*) a, y = *(const unsigned*) b;
+	return (x > y) - (x < y);
+}
+
+void renderer_update_nodes(struct Renderer* const r, struct Scene* const scene) {
+	//Collect changed dynamic nodes
+	const unsigned old_pending_count = r->pending_node_count;
+	for (unsigned i = 0; i < r->dynamic_node_count; ++i) {
+		const unsigned node = r->dynamic_nodes[i];
+		struct Node* const scene_node = scene->nodes + r->scene_nodes[node];
+		if (!scene_node->dirty) continue;
+		scene_node->dirty = false;
+		if (scene_node->has_mesh) {
+			transform_box(
+				r->mesh_boxes[scene_node->mesh],
+				scene_node->transformation,
+				r->node_boxes + node
+			);
+			glm_mat4_copy(scene_node->transformation, r->node_transformations[node]);
+			r->stale_bvh = true;
+		}
+		if (!r->pending_frames[node]) r->pending_nodes[r->pending_node_count++] = node;
+		r->pending_frames[node] = r->frame_count;
 	}
-	//Write to buffer
-	memcpy(r->host_data + sizeof(struct LocalCamera), local_nodes, local_nodes_size);
-	free(local_nodes);
+	if (r->pending_node_count > old_pending_count)
+		qsort(r->pending_nodes, r->pending_node_count, sizeof(unsigned), compare_nodes);
+	//Write pending nodes into the current frame's region
+	struct LocalNode* const local_nodes
+		= frame_ring_data(&r->frame_data, r->current_frame) + r->storage_offset;
+	const VkDeviceSize nodes_offset = r->current_frame * r->frame_data.frame_size + r->storage_offset;
+	unsigned pending_count = 0;
+	r->copy_region_count = 0;
+	for (unsigned i = 0; i < r->pending_node_count; ++i) {
+		const unsigned node = r->pending_nodes[i];
+		glm_mat4_copy(scene->nodes[r->scene_nodes[node]].transformation, local_nodes[node].transformation);
+		//Extend the previous copy region if adjacent
+		const VkDeviceSize offset = nodes_offset + node * sizeof(struct LocalNode);
+		VkBufferCopy* const region = r->copy_regions + r->copy_region_count;
+		if (r->copy_region_count && region[-1].srcOffset + region[-1].size == offset)
+			region[-1].size += sizeof(struct LocalNode);
+		else {
+			*region = (VkBufferCopy) {offset, offset, sizeof(struct LocalNode)};
+			++r->copy_region_count;
+		}
+		//Keep pending until every frame region is current
+		if (--r->pending_frames[node]) r->pending_nodes[pending_count++] = node;
+	}
+	r->pending_node_count = pending_count;
 }
@@ -1,21 +1,338 @@
 #define CGLTF_IMPLEMENTATION
 #include "scene.h"
 #include "cgltf.h"
+#include <cglm/affine.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 
-bool load_scene(const char* const filename, struct Scene* output) {
+#define UPDATE_GRAIN 4096 //Nodes composed per job by scene_update_transformations
+
+static void set_dynamic(struct Node* const nodes, const unsigned node) {
+	nodes[node].dynamic = true;
+	for (unsigned i = 0; i < nodes[node].child_count; ++i)
+		set_dynamic(nodes, nodes[node].children[i]);
+}
+
+struct TextureJobs {
+	const cgltf_data* data;
+	const SDL_PixelFormat* format;
+	SDL_Surface** textures; //Output, in glTF order
+};
+
+//Decode texture i & convert it to the scene's format
+static void decode_texture(void* const data, const unsigned i) {
+	const struct TextureJobs* const jobs = data;
+	const cgltf_texture texture = jobs->data->textures[i];
+	const cgltf_image image = *texture.image;
+	SDL_Surface* surface;
+	if (image.uri) surface = IMG_Load(image.uri);
+	else {
+		const cgltf_buffer_view buffer_view = *image.buffer_view;
+		SDL_RWops* buffer = SDL_RWFromConstMem(buffer_view.buffer->data + buffer_view.offset, buffer_view.size);
+		surface = IMG_Load_RW(buffer, true);
+	}
+	jobs->textures[i] = SDL_ConvertSurface(surface, jobs->format, 0);
+	SDL_FreeSurface(surface);
+}
+
+//Read an index accessor into 32-bit indices
+static void read_indices(const cgltf_accessor* const accessor, unsigned* const indices) {
+	const uint8_t* const data = accessor->buffer_view && !accessor->is_sparse
+		? cgltf_buffer_view_data(accessor->buffer_view)
+		: NULL;
+	if (!data) {
+		for (unsigned i = 0; i < accessor->count; ++i)
+			indices[i] = cgltf_accessor_read_index(accessor, i);
+		return;
+	}
+	const uint8_t* const start = data + accessor->offset;
+	const cgltf_size stride = accessor->stride;
+	switch (accessor->component_type) {
+		case cgltf_component_type_r_32u:
+			if (stride == sizeof(uint32_t)) memcpy(indices, start, accessor->count * sizeof(uint32_t));
+			else for (unsigned i = 0; i < accessor->count; ++i)
+				memcpy(indices + i, start + i * stride, sizeof(uint32_t));
+			break;
+		case cgltf_component_type_r_16u:
+			if (stride == sizeof(uint16_t)) {
+				//Vectorizable widening
+				const uint16_t* const source = (const uint16_t*) start;
+				for (unsigned i = 0; i < accessor->count; ++i)
+					indices[i] = source[i];
+			} else for (unsigned i = 0; i < accessor->count; ++i) {
+				uint16_t index;
+				memcpy(&index, start + i * stride, sizeof(uint16_t));
+				indices[i] = index;
+			}
+			break;
+		case cgltf_component_type_r_8u:
+			for (unsigned i = 0; i < accessor->count; ++i)
+				indices[i] = start[i * stride];
+			break;
+		default:
+			for (unsigned i = 0; i < accessor->count; ++i)
+				indices[i] = cgltf_accessor_read_index(accessor, i);
+	}
+}
+
+/*
+	Read up to component_count floats of each element of an accessor
+	into the vertex array, stride bytes apart (missing components are left untouched)
+*/
+static void read_floats(
+	const cgltf_accessor* const accessor,
+	unsigned component_count,
+	void* const output,
+	const size_t stride) {
+	const unsigned element_size = cgltf_num_components(accessor->type);
+	if (element_size < component_count) component_count = element_size;
+	const uint8_t* const data = accessor->buffer_view && !accessor->is_sparse
+		? cgltf_buffer_view_data(accessor->buffer_view)
+		: NULL;
+	if (data && accessor->component_type == cgltf_component_type_r_32f) {
+		//Copy straight from the buffer
+		const uint8_t* const start = data + accessor->offset;
+		const size_t size = component_count * sizeof(float);
+		for (unsigned i = 0; i < accessor->count; ++i)
+			memcpy(output + i * stride, start + i * accessor->stride, size);
+	} else {
+		//Convert normalized integers & sparse accessors element by element
+		float element[16];
+		for (unsigned i = 0; i < accessor->count; ++i) {
+			cgltf_accessor_read_float(accessor, i, element, element_size);
+			memcpy(output + i * stride, element, component_count * sizeof(float));
+		}
+	}
+}
+
+//Bounding box of a primitive's vertices
+static void primitive_bounds(struct Primitive* const primitive) {
+	glm_vec3_zero(primitive->box_start);
+	glm_vec3_zero(primitive->box_end);
+	if (!primitive->vertex_count) return;
+	glm_vec3_copy(primitive->vertices->pos, primitive->box_start);
+	glm_vec3_copy(primitive->vertices->pos, primitive->box_end);
+	for (unsigned i = 1; i < primitive->vertex_count; ++i) {
+		glm_vec3_minv(primitive->box_start, primitive->vertices[i].pos, primitive->box_start);
+		glm_vec3_maxv(primitive->box_end, primitive->vertices[i].pos, primitive->box_end);
+	}
+}
+
+//Bounding box of a mesh's primitives
+static void mesh_bounds(struct Mesh* const mesh) {
+	glm_vec3_zero(mesh->box_start);
+	glm_vec3_zero(mesh->box_end);
+	for (unsigned i = 0; i < mesh->primitive_count; ++i) {
+		struct Primitive* const primitive = mesh->primitives + i;
+		if (!i) {
+			glm_vec3_copy(primitive->box_start, mesh->box_start);
+			glm_vec3_copy(primitive->box_end, mesh->box_end);
+		}
+		glm_vec3_minv(mesh->box_start, primitive->box_start, mesh->box_start);
+		glm_vec3_maxv(mesh->box_end, primitive->box_end, mesh->box_end);
+	}
+}
+
+/*
+	Grid of quantized positions (KHR_mesh_quantization), as read by read_floats.
+	Returns false for float positions.
+*/
+static bool position_grid(const cgltf_accessor* const accessor, vec3 offset, vec3 scale) {
+	float grid_offset, grid_scale;
+	switch (accessor->component_type) {
+		case cgltf_component_type_r_8u:
+			grid_offset = 0;
+			grid_scale = accessor->normalized ? 1.f / UINT8_MAX : 1;
+			break;
+		case cgltf_component_type_r_8:
+			grid_offset = accessor->normalized ? -1 : INT8_MIN;
+			grid_scale = accessor->normalized ? 1.f / INT8_MAX : 1;
+			break;
+		case cgltf_component_type_r_16u:
+			grid_offset = 0;
+			grid_scale = accessor->normalized ? 1.f / UINT16_MAX : 1;
+			break;
+		case cgltf_component_type_r_16:
+			grid_offset = accessor->normalized ? -1 : INT16_MIN;
+			grid_scale = accessor->normalized ? 1.f / INT16_MAX : 1;
+			break;
+		default:
+			return false;
+	}
+	glm_vec3_broadcast(grid_offset, offset);
+	glm_vec3_broadcast(grid_scale, scale);
+	return true;
+}
+
+/*
+	Copy quantized positions (KHR_mesh_quantization) onto their position_grid as 16-bit coordinates,
+	3 per element, without converting them to floats.
+	Signed components are offset to start at 0 (normalized ones at -1, so the minimum duplicates -1).
+	Returns false if they need converting (floats or sparse accessors).
+*/
+static bool read_grid_positions(const cgltf_accessor* const accessor, uint16_t* const output) {
+	const uint8_t* const data = accessor->buffer_view && !accessor->is_sparse
+		? cgltf_buffer_view_data(accessor->buffer_view)
+		: NULL;
+	if (!data || cgltf_num_components(accessor->type) != 3) return false;
+	const uint8_t* const start = data + accessor->offset;
+	for (unsigned i = 0; i < accessor->count; ++i) {
+		const uint8_t* const element = start + i * accessor->stride;
+		for (unsigned j = 0; j < 3; ++j) {
+			int value;
+			switch (accessor->component_type) {
+				case cgltf_component_type_r_8u:
+					value = element[j];
+					break;
+				case cgltf_component_type_r_8:
+					value = (int8_t) element[j] + (accessor->normalized ? INT8_MAX : -INT8_MIN);
+					break;
+				case cgltf_component_type_r_16u: {
+					uint16_t component;
+					memcpy(&component, element + j * sizeof(uint16_t), sizeof(uint16_t));
+					value = component;
+					break;
+				}
+				case cgltf_component_type_r_16: {
+					int16_t component;
+					memcpy(&component, element + j * sizeof(int16_t), sizeof(int16_t));
+					value = component + (accessor->normalized ? INT16_MAX : -INT16_MIN);
+					break;
+				}
+				default:
+					return false;
+			}
+			output[3 * i + j] = value < 0 ? 0 : value;
+		}
+	}
+	return true;
+}
+
+//Grid spanning a mesh's bounding box
+static void mesh_grid(struct Mesh* const mesh) {
+	glm_vec3_copy(mesh->box_start, mesh->quantization_offset);
+	glm_vec3_sub(mesh->box_end, mesh->box_start, mesh->quantization_scale);
+	glm_vec3_divs(mesh->quantization_scale, UINT16_MAX, mesh->quantization_scale);
+}
+
+//Instances of a node's mesh (EXT_mesh_gpu_instancing), 0 without the extension
+static unsigned instance_count(const cgltf_node* const node) {
+	if (!node->mesh || !node->has_mesh_gpu_instancing || !node->mesh_gpu_instancing.attributes_count) return 0;
+	return node->mesh_gpu_instancing.attributes[0].data->count;
+}
+
+/*
+	Load the instances of a node's mesh (EXT_mesh_gpu_instancing) into nodes from first,
+	each drawing the mesh at the instance's transformation, local to the instancing node
+*/
+static void load_instances(
+	const cgltf_node* const gltf_node,
+	const unsigned mesh,
+	const unsigned first,
+	struct Scene* const scene) {
+	const unsigned count = instance_count(gltf_node);
+	vec3* const translations = calloc(count, sizeof(vec3));
+	versor* const rotations = malloc(count * sizeof(versor));
+	vec3* const scalings = malloc(count * sizeof(vec3));
+	for (unsigned i = 0; i < count; ++i) {
+		glm_quat_identity(rotations[i]);
+		glm_vec3_one(scalings[i]);
+	}
+	const cgltf_mesh_gpu_instancing instancing = gltf_node->mesh_gpu_instancing;
+	for (unsigned i = 0; i < instancing.attributes_count; ++i) {
+		const cgltf_attribute attribute = instancing.attributes[i];
+		if (attribute.data->count != count) continue;
+		if (!strcmp(attribute.name, "TRANSLATION"))
+			read_floats(attribute.data, 3, translations, sizeof(vec3));
+		else if (!strcmp(attribute.name, "ROTATION"))
+			read_floats(attribute.data, 4, rotations, sizeof(versor));
+		else if (!strcmp(attribute.name, "SCALE"))
+			read_floats(attribute.data, 3, scalings, sizeof(vec3));
+	}
+	for (unsigned i = 0; i < count; ++i) {
+		scene->nodes[first + i] = (struct Node) {0, NULL, true, mesh, false, true, false};
+		transforms_set(&scene->transforms, first + i, translations[i], rotations[i], scalings[i]);
+	}
+	free(translations);
+	free(rotations);
+	free(scalings);
+}
+
+//Move grid positions to their vertices' new indices (~0u for removed vertices)
+static void remap_grid_positions(struct Primitive* const primitive, const unsigned vertex_count, const unsigned* const remap) {
+	if (!primitive->grid_positions) return;
+	uint16_t* const grid_positions = malloc(3 * primitive->vertex_count * sizeof(uint16_t));
+	for (unsigned i = 0; i < vertex_count; ++i)
+		if (remap[i] != ~0u) memcpy(grid_positions + 3 * remap[i], primitive->grid_positions + 3 * i, 3 * sizeof(uint16_t));
+	free(primitive->grid_positions);
+	primitive->grid_positions = grid_positions;
+}
+
+/*
+	Merge duplicate vertices, order triangles for the vertex cache & then overdraw,
+	& order vertices by first use, adding the cache statistics before & after to stats.
+	Grid positions follow their vertices.
+*/
+static void optimize_primitive(struct Primitive* const primitive, struct OptimizationStats* const stats) {
+	//Before, as transformed vertices per unique vertex like after (duplicates would inflate the improvement)
+	struct CacheStats before = {};
+	analyze_vertex_cache(primitive->index_count, primitive->indices, primitive->vertex_count, &before);
+	unsigned* const remap = malloc(primitive->vertex_count * sizeof(unsigned));
+	unsigned vertex_count = primitive->vertex_count;
+	primitive->vertex_count = deduplicate_vertices(
+		primitive->vertex_count, primitive->vertices,
+		primitive->index_count, primitive->indices,
+		remap
+	);
+	remap_grid_positions(primitive, vertex_count, remap);
+	stats->before.triangle_count += before.triangle_count;
+	stats->before.vertex_count += primitive->vertex_count;
+	stats->before.miss_count += before.miss_count;
+	optimize_vertex_cache(primitive->index_count, primitive->indices, primitive->vertex_count);
+	optimize_overdraw(
+		primitive->index_count, primitive->indices,
+		primitive->vertices, primitive->vertex_count,
+		OVERDRAW_THRESHOLD
+	);
+	vertex_count = primitive->vertex_count;
+	primitive->vertex_count = optimize_vertex_fetch(
+		primitive->vertex_count, primitive->vertices,
+		primitive->index_count, primitive->indices,
+		remap
+	);
+	remap_grid_positions(primitive, vertex_count, remap);
+	free(remap);
+	if (primitive->vertex_count)
+		primitive->vertices = realloc(primitive->vertices, primitive->vertex_count * sizeof(struct Vertex));
+	analyze_vertex_cache(primitive->index_count, primitive->indices, primitive->vertex_count, &stats->after);
+}
+
+/*
+	Textures are decoded in parallel if jobs isn't NULL.
+	Primitives are optimized if optimization isn't NULL, which receives their cache statistics.
+	Instances of EXT_mesh_gpu_instancing become child nodes of their node, after the glTF's nodes.
+*/
+bool load_scene(
+	const char* const filename,
+	struct JobSystem* const jobs,
+	struct OptimizationStats* const optimization,
+	struct Scene* output) {
 	cgltf_options options = {};
 	cgltf_data* data;
 	cgltf_result result = cgltf_parse_file(&options, filename, &data);
 	if (result == cgltf_result_success) {
 		result = cgltf_load_buffers(&options, data, filename); //TODO: Error handling
-		const struct Scene scene = {
+		unsigned node_count = data->nodes_count;
+		for (unsigned i = 0; i < data->nodes_count; ++i)
+			node_count += instance_count(data->nodes + i);
+		struct Scene scene = {
 			data->meshes_count,
 			malloc(data->meshes_count * sizeof(struct Mesh)),
-			data->nodes_count,
-			malloc(data->nodes_count * sizeof(struct Node)),
+			node_count,
+			malloc(node_count * sizeof(struct Node)),
 			data->materials_count,
 			malloc(data->materials_count * sizeof(struct Material)),
 			data->textures_count + 1,
@@ -28,19 +345,8 @@ bool load_scene(const char* const filename, struct Scene* output) {
 		SDL_FillRect(surface, NULL, color);
 		scene.textures[0] = surface;
 		//Load textures
-		for (unsigned i = 0; i < data->textures_count; ++i) {
-			const cgltf_texture texture = data->textures[i];
-			const cgltf_image image = *texture.image;
-			SDL_Surface* surface;
-			if (image.uri) surface = IMG_Load(image.uri);
-			else {
-				const cgltf_buffer_view buffer_view = *image.buffer_view;
-				SDL_RWops* buffer = SDL_RWFromConstMem(buffer_view.buffer->data + buffer_view.offset, buffer_view.size);
-				surface = IMG_Load_RW(buffer, true);
-			}
-			scene.textures[i+1] = SDL_ConvertSurface(surface, format, 0);
-			SDL_FreeSurface(surface);
-		}
+		struct TextureJobs texture_jobs = {data, format, scene.textures + 1};
+		jobs_parallel_for(jobs, data->textures_count, decode_texture, &texture_jobs);
 		SDL_FreeFormat(format);
 		//Load materials
 		for (unsigned i = 0; i < data->materials_count; ++i) {
@@ -60,20 +366,22 @@ bool load_scene(const char* const filename, struct Scene* output) {
 		//Load meshes
 		for (unsigned i = 0; i < data->meshes_count; ++i) {
 			const cgltf_mesh gltf_mesh = data->meshes[i];
-			const struct Mesh mesh = {
+			struct Mesh mesh = {
 				gltf_mesh.primitives_count,
 				malloc(gltf_mesh.primitives_count * sizeof(struct Primitive))
 			};
+			bool shared_grid = gltf_mesh.primitives_count; //Positions of every primitive are on one quantization grid
 			//Load primitives
 			for (unsigned i = 0; i < gltf_mesh.primitives_count; ++i) {
 				const cgltf_primitive gltf_primitive = gltf_mesh.primitives[i];
 				struct Primitive primitive = {0, NULL, 0, NULL};
+				bool quantized = false;
+				vec3 grid_offset, grid_scale;
 				//Load indices
 				const cgltf_accessor indices = *gltf_primitive.indices;
 				primitive.index_count = indices.count;
 				primitive.indices = malloc(indices.count * sizeof(unsigned));
-				for (unsigned i = 0; i < indices.count; ++i)
-					primitive.indices[i] = cgltf_accessor_read_index(&indices, i);
+				read_indices(&indices, primitive.indices);
 				//Load vertices
 				const unsigned vertex_count = gltf_primitive.attributes[0].data->count;
 				primitive.vertex_count = vertex_count;
@@ -81,55 +389,63 @@ bool load_scene(const char* const filename, struct Scene* output) {
 				//Load vertex attributes
 				for (unsigned i = 0; i < gltf_primitive.attributes_count; ++i) {
 					const cgltf_attribute attribute = gltf_primitive.attributes[i];
-					const unsigned float_count = cgltf_accessor_unpack_floats(attribute.data, NULL, 0);
-					float* const buffer = malloc(float_count * sizeof(float));
-					cgltf_accessor_unpack_floats(attribute.data, buffer, float_count);
-					const unsigned element_size = cgltf_num_components(attribute.data->type);
 					switch (attribute.type) {
 						case cgltf_attribute_type_position:
-							{
-								const unsigned components = element_size < 3 ? element_size : 3;
-								for (unsigned i = 0; i < vertex_count; ++i) {
-									const unsigned offset = i * element_size;
-									for (unsigned j = 0; j < components; ++j)
-										primitive.vertices[i].pos[j] = buffer[offset + j];
+							read_floats(attribute.data, 3, primitive.vertices->pos, sizeof(struct Vertex));
+							quantized = position_grid(attribute.data, grid_offset, grid_scale);
+							if (quantized) {
+								primitive.grid_positions = malloc(3 * vertex_count * sizeof(uint16_t));
+								if (!read_grid_positions(attribute.data, primitive.grid_positions)) {
+									free(primitive.grid_positions);
+									primitive.grid_positions = NULL;
 								}
 							}
 							break;
 						case cgltf_attribute_type_normal:
-							{
-								const unsigned components = element_size < 3 ? element_size : 3;
-								for (unsigned i = 0; i < vertex_count; ++i) {
-									const unsigned offset = i * element_size;
-									for (unsigned j = 0; j < components; ++j)
-										primitive.vertices[i].normal[j] = buffer[offset + j];
-								}
-							}
+							read_floats(attribute.data, 3, primitive.vertices->normal, sizeof(struct Vertex));
 							break;
 						case cgltf_attribute_type_texcoord:
-							{
-								const unsigned components = 2;
-								for (unsigned i = 0; i < vertex_count; ++i) {
-									const unsigned offset = i * element_size;
-									for (unsigned j = 0; j < components; ++j)
-										primitive.vertices[i].tex[j] = buffer[offset + j];
-								}
-							}
+							read_floats(attribute.data, 2, primitive.vertices->tex, sizeof(struct Vertex));
 							break;
 						default:
 							break;
 					}
-					free(buffer);
 				}
-				//Set vertex material
-				const unsigned material = gltf_primitive.material - data->materials;
-				for (unsigned i = 0; i < vertex_count; ++i)
-					primitive.vertices[i].material = material;
+				primitive.material = gltf_primitive.material - data->materials;
+				if (optimization) optimize_primitive(&primitive, optimization);
+				primitive_bounds(&primitive);
+				if (!quantized || (i && (!glm_vec3_eqv(grid_offset, mesh.quantization_offset) || !glm_vec3_eqv(grid_scale, mesh.quantization_scale))))
+					shared_grid = false;
+				if (quantized) {
+					glm_vec3_copy(grid_offset, mesh.quantization_offset);
+					glm_vec3_copy(grid_scale, mesh.quantization_scale);
+				}
+				primitive.meshlet_count = build_meshlets(
+					primitive.vertex_count, primitive.vertices,
+					primitive.index_count, primitive.indices,
+					&primitive.meshlets
+				);
+				primitive.lod_count = build_lods(
+					primitive.vertex_count, primitive.vertices,
+					primitive.index_count, primitive.indices,
+					&primitive.lods, &primitive.lod_indices
+				);
 				mesh.primitives[i] = primitive;
 			}
+			mesh_bounds(&mesh);
+			//Quantized positions keep their grid & are copied into compact vertices, others span the box
+			if (!shared_grid) {
+				mesh_grid(&mesh);
+				for (unsigned i = 0; i < mesh.primitive_count; ++i) {
+					free(mesh.primitives[i].grid_positions);
+					mesh.primitives[i].grid_positions = NULL;
+				}
+			}
 			scene.meshes[i] = mesh;
 		}
 		//Load nodes
+		create_transforms(node_count, &scene.transforms);
+		unsigned first_instance = data->nodes_count;
 		for (unsigned i = 0; i < data->nodes_count; ++i) {
 			const cgltf_node gltf_node = data->nodes[i];
 			struct Node node = {
@@ -137,18 +453,46 @@ bool load_scene(const char* const filename, struct Scene* output) {
 				malloc(gltf_node.children_count * sizeof(unsigned)),
 				gltf_node.mesh,
 				gltf_node.mesh ? gltf_node.mesh - data->meshes : 0,
-				{gltf_node.translation[0], gltf_node.translation[1], gltf_node.translation[2]},
-				{gltf_node.rotation[0], gltf_node.rotation[1], gltf_node.rotation[2], gltf_node.rotation[3]},
-				{gltf_node.scale[0], gltf_node.scale[1], gltf_node.scale[2]},
-				true
+				false,
+				true,
+				false
 			};
 			//Child nodes
 			for (unsigned i = 0; i < node.child_count; ++i)
 				node.children[i] = gltf_node.children[i] - data->nodes;
-			//World transformation
-			cgltf_node_transform_world(data->nodes + i, (cgltf_float*) node.transformation);
+			//Instances draw the mesh instead of the node
+			const unsigned node_instance_count = instance_count(&gltf_node);
+			if (node_instance_count) {
+				load_instances(&gltf_node, node.mesh, first_instance, &scene);
+				node.has_mesh = false;
+				node.children = realloc(node.children, (node.child_count + node_instance_count) * sizeof(unsigned));
+				for (unsigned i = 0; i < node_instance_count; ++i)
+					node.children[node.child_count++] = first_instance++;
+			}
+			//Local transformation (matrices are decomposable by specification)
+			if (gltf_node.has_matrix) {
+				mat4 matrix, rotation;
+				vec4 translation;
+				vec3 scaling;
+				versor quaternion;
+				memcpy(matrix, gltf_node.matrix, sizeof(mat4));
+				glm_decompose(matrix, translation, rotation, scaling);
+				glm_mat4_quat(rotation, quaternion);
+				transforms_set(&scene.transforms, i, translation, quaternion, scaling);
+			} else transforms_set(
+				&scene.transforms, i,
+				gltf_node.translation, gltf_node.rotation, gltf_node.scale
+			);
 			scene.nodes[i] = node;
 		}
+		//Animated nodes & their descendants are dynamic
+		for (unsigned i = 0; i < data->animations_count; ++i) {
+			const cgltf_animation animation = data->animations[i];
+			for (unsigned j = 0; j < animation.channels_count; ++j)
+				if (animation.channels[j].target_node)
+					set_dynamic(scene.nodes, animation.channels[j].target_node - data->nodes);
+		}
+		scene_flatten(&scene);
 		//Finish
 		cgltf_free(data);
 		*output = scene;
@@ -156,58 +500,160 @@ bool load_scene(const char* const filename, struct Scene* output) {
 	} else return true;
 }
 
-void scene_update_transformations(struct Scene* scene) {
-	//Find root nodes
-	bool* const root_mask = malloc(scene->node_count * sizeof(bool));
-	memset(root_mask, true, scene->node_count);
-	for (unsigned i = 0; i < scene->node_count; ++i) {
-		const struct Node node = scene->nodes[i];
-		for (unsigned i = 0; i < node.child_count; ++i)
-			root_mask[node.children[i]] = false;
-	}
-	unsigned root_count = 0;
-	for (unsigned i = 0; i < scene->node_count; ++i)
-		root_count += root_mask[i];
-	unsigned* const roots = malloc(root_count * sizeof(unsigned));
-	root_count = 0;
-	for (unsigned i = 0; i < scene->node_count; ++i)
-		if (root_mask[i]) roots[root_count++] = i;
-	//Initialize root nodes
-	for (unsigned i = 0; i < root_count; ++i) {
-		struct Node* const node = scene->nodes + roots[i];
-		if (!node->valid_transform)
-			glm_mat4_identity(node->transformation);
-	}
-	//Traverse scene hierarchy
-	unsigned* const queue = malloc(scene->node_count * sizeof(unsigned));
-	unsigned queue_start = 0, queue_count = root_count;
-	memcpy(queue, roots, root_count * sizeof(unsigned));
-	free(roots);
-	while (queue_count--) {
-		struct Node* const node = scene->nodes + queue[queue_start++];
-		if (!node->valid_transform) {
-			//Compute transformation
-			mat4 transformation = GLM_MAT4_IDENTITY_INIT;
-			glm_translate(transformation, node->translation);
-			glm_quat_rotate(transformation, node->rotation, transformation);
-			glm_scale(transformation, node->scaling);
-			glm_mat4_mul(node->transformation, transformation, node->transformation);
+//Reorder nodes & their local transformations into preorder, then compose world transformations
+void scene_flatten(struct Scene* const scene) {
+	const unsigned count = scene->node_count;
+	//Parents by original index
+	unsigned* const parents = malloc(count * sizeof(unsigned));
+	for (unsigned i = 0; i < count; ++i)
+		parents[i] = NO_PARENT;
+	for (unsigned i = 0; i < count; ++i)
+		for (unsigned j = 0; j < scene->nodes[i].child_count; ++j)
+			parents[scene->nodes[i].children[j]] = i;
+	//Preorder traversal from each root
+	unsigned* const order = malloc(count * sizeof(unsigned)); //Original index of each node
+	unsigned* const stack = malloc(count * sizeof(unsigned));
+	unsigned order_count = 0;
+	for (unsigned root = 0; root < count; ++root) {
+		if (parents[root] != NO_PARENT) continue;
+		unsigned stack_size = 0;
+		stack[stack_size++] = root;
+		while (stack_size) {
+			const struct Node* const node = scene->nodes + stack[--stack_size];
+			order[order_count++] = node - scene->nodes;
+			//Push children in reverse so they're visited in order
+			for (unsigned i = node->child_count; i--;)
+				stack[stack_size++] = node->children[i];
 		}
-		//Enqueue children
-		for (unsigned i = 0; i < node->child_count; ++i) {
-			struct Node* const child = scene->nodes + node->children[i];
-			if (!child->valid_transform)
-				glm_mat4_copy(node->transformation, child->transformation);
-			queue[queue_start++] = node->children[i];
+	}
+	unsigned* const positions = stack; //New index of each original node
+	for (unsigned i = 0; i < count; ++i)
+		positions[order[i]] = i;
+	//Reorder nodes
+	struct Node* const nodes = malloc(count * sizeof(struct Node));
+	scene->parents = malloc(count * sizeof(unsigned));
+	scene->subtree_ends = malloc(count * sizeof(unsigned));
+	struct Transforms transforms;
+	create_transforms(count, &transforms);
+	for (unsigned i = 0; i < count; ++i) {
+		nodes[i] = scene->nodes[order[i]];
+		for (unsigned j = 0; j < nodes[i].child_count; ++j)
+			nodes[i].children[j] = positions[nodes[i].children[j]];
+		const unsigned parent = parents[order[i]];
+		scene->parents[i] = parent == NO_PARENT ? NO_PARENT : positions[parent];
+		scene->subtree_ends[i] = i + 1;
+		vec3 translation, scaling;
+		versor rotation;
+		transforms_get(&scene->transforms, order[i], translation, rotation, scaling);
+		transforms_set(&transforms, i, translation, rotation, scaling);
+	}
+	free(scene->nodes);
+	scene->nodes = nodes;
+	destroy_transforms(&scene->transforms);
+	scene->transforms = transforms;
+	free(stack);
+	free(order);
+	free(parents);
+	//Subtree ranges, children before parents
+	for (unsigned i = count; i--;) {
+		const unsigned parent = scene->parents[i];
+		if (parent != NO_PARENT && scene->subtree_ends[i] > scene->subtree_ends[parent])
+			scene->subtree_ends[parent] = scene->subtree_ends[i];
+	}
+	//World transformations
+	compose_transforms(&scene->transforms, scene->parents, 0, count, nodes->transformation, sizeof(struct Node));
+	scene->invalid_count = 0;
+	scene->invalid_nodes = malloc(count * sizeof(unsigned));
+	scene->task_count = 0;
+	scene->tasks = malloc(count * sizeof(unsigned));
+}
+
+/*
+	Let a node & its descendants move after the scene is loaded into a renderer.
+	Call before loading it: renderers only read the transformations of nodes that were dynamic then.
+*/
+void scene_set_node_dynamic(struct Scene* const scene, const unsigned node) {
+	for (unsigned i = node; i < scene->subtree_ends[node]; ++i)
+		scene->nodes[i].dynamic = true;
+}
+
+//Call after changing a dynamic node's local transformations (returns true if the node is static)
+bool scene_invalidate_node(struct Scene* const scene, const unsigned node) {
+	if (!scene->nodes[node].dynamic) {
+		fprintf(stderr, "Error: node %u is static (see scene_set_node_dynamic)!\n", node);
+		return true;
+	}
+	if (!scene->nodes[node].valid_transform) return false;
+	scene->nodes[node].valid_transform = false;
+	scene->invalid_nodes[scene->invalid_count++] = node;
+	return false;
+}
+
+static int compare_nodes(const void* a, const void* b) {
+	const unsigned x = *(const unsigned*) a, y = *(const unsigned*) b;
+	return (x > y) - (x < y);
+}
+
+//Compose nodes [start, end) & flag them for the renderer
+static void update_range(struct Scene* const scene, const unsigned start, const unsigned end) {
+	compose_transforms(
+		&scene->transforms,
+		scene->parents,
+		start, end - start,
+		scene->nodes->transformation,
+		sizeof(struct Node)
+	);
+	for (unsigned i = start; i < end; ++i)
+		scene->nodes[i].dirty = true;
+}
+
+static void update_subtree(void* const data, const unsigned i) {
+	struct Scene* const scene = data;
+	const unsigned root = scene->tasks[i];
+	update_range(scene, root, scene->subtree_ends[root]);
+}
+
+/*
+	Recompute the subtrees of invalidated nodes (no allocations).
+	Subtrees larger than UPDATE_GRAIN nodes are split: their roots are composed first,
+	then their smaller subtrees are composed in parallel if jobs isn't NULL.
+	The split doesn't depend on the thread count, so neither do the results.
+*/
+void scene_update_transformations(struct Scene* const scene, struct JobSystem* const jobs) {
+	if (!scene->invalid_count) return;
+	for (unsigned i = 0; i < scene->invalid_count; ++i)
+		scene->nodes[scene->invalid_nodes[i]].valid_transform = true;
+	//Each subtree once (a sorted subtree start covers nested ones)
+	qsort(scene->invalid_nodes, scene->invalid_count, sizeof(unsigned), compare_nodes);
+	scene->task_count = 0;
+	unsigned covered_end = 0;
+	for (unsigned i = 0; i < scene->invalid_count; ++i) {
+		const unsigned start = scene->invalid_nodes[i];
+		if (start < covered_end) continue;
+		covered_end = scene->subtree_ends[start];
+		//Walk the subtree in preorder, skipping over the subtrees of tasks
+		unsigned node = start;
+		while (node < covered_end) {
+			if (scene->subtree_ends[node] - node <= UPDATE_GRAIN) {
+				scene->tasks[scene->task_count++] = node;
+				node = scene->subtree_ends[node];
+			} else {
+				update_range(scene, node, node + 1);
+				++node;
+			}
 		}
-		queue_count += node->child_count;
 	}
-	free(queue);
+	jobs_parallel_for(jobs, scene->task_count, update_subtree, scene);
+	scene->invalid_count = 0;
 }
 
 static void destroy_primitive(struct Primitive* primitive) {
 	free(primitive->vertices);
 	free(primitive->indices);
+	free(primitive->meshlets);
+	free(primitive->lods);
+	free(primitive->lod_indices);
+	free(primitive->grid_positions);
 }
 
 static void destroy_mesh(struct Mesh* mesh) {
@@ -221,6 +667,23 @@ static void destroy_node(struct Node* node) {
 }
 
 void destroy_scene(struct Scene scene) {
+	free(scene.parents);
+	free(scene.subtree_ends);
+	destroy_transforms(&scene.transforms);
+	free(scene.invalid_nodes);
+	free(scene.tasks);
+	if (scene.package) {
+		//Only the tables were allocated
+		for (unsigned i = 0; i < scene.mesh_count; ++i)
+			free(scene.meshes[i].primitives);
+		free(scene.meshes);
+		free(scene.nodes);
+		for (unsigned i = 0; i < scene.texture_count; ++i)
+			SDL_FreeSurface(scene.textures[i]);
+		free(scene.textures);
+		munmap(scene.package, scene.package_size);
+		return;
+	}
 	for (unsigned i = 0; i < scene.mesh_count; ++i)
 		destroy_mesh(scene.meshes+ i);
 	free(scene.meshes);
@@ -232,3 +695,203 @@ void destroy_scene(struct Scene scene) {
 		SDL_FreeSurface(scene.textures[i]);
 	free(scene.textures);
 }
+
+//Primitive of a static node, to be merged into a batch
+struct BatchItem {
+	unsigned node;
+	unsigned material;
+	const struct Primitive* primitive;
+	vec3 center; //World space
+	float key; //Sort key along the split axis
+};
+
+static int compare_item_materials(const void* a, const void* b) {
+	const unsigned x = ((const struct BatchItem*) a)->material, y = ((const struct BatchItem*) b)->material;
+	return (x > y) - (x < y);
+}
+
+static int compare_item_keys(const void* a, const void* b) {
+	const float x = ((const struct BatchItem*) a)->key, y = ((const struct BatchItem*) b)->key;
+	return (x > y) - (x < y);
+}
+
+/*
+	Split items at the median of their centers along the longest axis
+	until each range's vertices fit in a batch, appending the ranges' ends
+*/
+static void split_batch(
+	struct BatchItem* const items,
+	const unsigned first,
+	const unsigned count,
+	unsigned* const batch_ends,
+	unsigned* const batch_count) {
+	unsigned vertex_count = 0;
+	vec3 start, end;
+	for (unsigned i = first; i < first + count; ++i) {
+		vertex_count += items[i].primitive->vertex_count;
+		if (i == first) {
+			glm_vec3_copy(items[i].center, start);
+			glm_vec3_copy(items[i].center, end);
+		}
+		glm_vec3_minv(start, items[i].center, start);
+		glm_vec3_maxv(end, items[i].center, end);
+	}
+	if (vertex_count <= BATCH_MAX_VERTICES || count == 1) {
+		batch_ends[(*batch_count)++] = first + count;
+		return;
+	}
+	unsigned axis = 0;
+	for (unsigned i = 1; i < 3; ++i)
+		if (end[i] - start[i] > end[axis] - start[axis]) axis = i;
+	for (unsigned i = first; i < first + count; ++i)
+		items[i].key = items[i].center[axis];
+	qsort(items + first, count, sizeof(struct BatchItem), compare_item_keys);
+	split_batch(items, first, count / 2, batch_ends, batch_count);
+	split_batch(items, first + count / 2, count - count / 2, batch_ends, batch_count);
+}
+
+//Columns of the cofactor matrix of a transformation's linear part, which transforms normals (up to length)
+static void normal_matrix(mat4 m, vec3 result[3]) {
+	glm_vec3_cross(m[1], m[2], result[0]);
+	glm_vec3_cross(m[2], m[0], result[1]);
+	glm_vec3_cross(m[0], m[1], result[2]);
+	if (glm_vec3_dot(m[0], result[0]) < 0) {
+		//Mirrored
+		for (unsigned i = 0; i < 3; ++i)
+			glm_vec3_scale(result[i], -1, result[i]);
+	}
+}
+
+//Primitive merging a batch of items, in world space
+static struct Primitive batch_primitive(
+	const struct Scene scene,
+	const unsigned count,
+	const struct BatchItem* const items) {
+	struct Primitive primitive = {0, NULL, 0, NULL};
+	for (unsigned i = 0; i < count; ++i) {
+		primitive.vertex_count += items[i].primitive->vertex_count;
+		primitive.index_count += items[i].primitive->index_count;
+	}
+	primitive.vertices = malloc(primitive.vertex_count * sizeof(struct Vertex));
+	primitive.indices = malloc(primitive.index_count * sizeof(unsigned));
+	primitive.material = items[0].material;
+	unsigned vertex_offset = 0, index_offset = 0;
+	for (unsigned i = 0; i < count; ++i) {
+		const struct Primitive* const source = items[i].primitive;
+		mat4 transformation;
+		glm_mat4_copy(scene.nodes[items[i].node].transformation, transformation);
+		vec3 normals[3];
+		normal_matrix(transformation, normals);
+		for (unsigned j = 0; j < source->vertex_count; ++j) {
+			const struct Vertex vertex = source->vertices[j];
+			struct Vertex* const result = primitive.vertices + vertex_offset + j;
+			glm_mat4_mulv3(transformation, (float*) vertex.pos, 1, result->pos);
+			for (unsigned k = 0; k < 3; ++k)
+				result->normal[k] = normals[0][k] * vertex.normal[0] + normals[1][k] * vertex.normal[1] + normals[2][k] * vertex.normal[2];
+			glm_vec3_normalize(result->normal);
+			result->tex[0] = vertex.tex[0];
+			result->tex[1] = vertex.tex[1];
+		}
+		for (unsigned j = 0; j < source->index_count; ++j)
+			primitive.indices[index_offset + j] = vertex_offset + source->indices[j];
+		vertex_offset += source->vertex_count;
+		index_offset += source->index_count;
+	}
+	primitive_bounds(&primitive);
+	primitive.meshlet_count = build_meshlets(
+		primitive.vertex_count, primitive.vertices,
+		primitive.index_count, primitive.indices,
+		&primitive.meshlets
+	);
+	primitive.lod_count = build_lods(
+		primitive.vertex_count, primitive.vertices,
+		primitive.index_count, primitive.indices,
+		&primitive.lods, &primitive.lod_indices
+	);
+	return primitive;
+}
+
+/*
+	Scene to draw in place of a scene, with the primitives of its static nodes
+	merged into batches of world-space geometry, drawn by nodes at the identity.
+	Batches hold one material & up to BATCH_MAX_VERTICES vertices (unless a primitive has more),
+	split along the longest axis of their primitives' centers so they stay compact for culling.
+	Nodes with meshes that are dynamic or unbatched are kept, after which the batches' nodes follow.
+	Batched nodes can't move (scene_invalidate_node rejects static nodes):
+	mark nodes that will with scene_set_node_dynamic before batching.
+	scene_nodes receives the scene node of each node (~0u for batches).
+	Meshes, materials & textures are shared with the scene, followed by the batches' meshes.
+*/
+void scene_batch_static(const struct Scene scene, struct Scene* const output, unsigned** const scene_nodes) {
+	//Primitives of static nodes, grouped by material
+	unsigned item_count = 0, kept_count = 0;
+	for (unsigned i = 0; i < scene.node_count; ++i) {
+		if (!scene.nodes[i].has_mesh) continue;
+		if (scene.nodes[i].dynamic || scene.nodes[i].unbatched) ++kept_count;
+		else item_count += scene.meshes[scene.nodes[i].mesh].primitive_count;
+	}
+	struct BatchItem* const items = malloc(item_count * sizeof(struct BatchItem));
+	item_count = 0;
+	for (unsigned i = 0; i < scene.node_count; ++i) {
+		const struct Node node = scene.nodes[i];
+		if (!node.has_mesh || node.dynamic || node.unbatched) continue;
+		const struct Mesh mesh = scene.meshes[node.mesh];
+		for (unsigned j = 0; j < mesh.primitive_count; ++j) {
+			struct BatchItem* const item = items + item_count++;
+			*item = (struct BatchItem) {i, mesh.primitives[j].material, mesh.primitives + j};
+			vec3 center;
+			glm_vec3_center(mesh.primitives[j].box_start, mesh.primitives[j].box_end, center);
+			glm_mat4_mulv3(node.transformation, center, 1, item->center);
+		}
+	}
+	qsort(items, item_count, sizeof(struct BatchItem), compare_item_materials);
+	//Batches
+	unsigned* const batch_ends = malloc(item_count * sizeof(unsigned));
+	unsigned batch_count = 0;
+	for (unsigned start = 0, end = 0; start < item_count; start = end) {
+		while (end < item_count && items[end].material == items[start].material) ++end;
+		split_batch(items, start, end - start, batch_ends, &batch_count);
+	}
+	struct Mesh* const meshes = malloc((scene.mesh_count + batch_count) * sizeof(struct Mesh));
+	memcpy(meshes, scene.meshes, scene.mesh_count * sizeof(struct Mesh));
+	for (unsigned i = 0; i < batch_count; ++i) {
+		const unsigned start = i ? batch_ends[i - 1] : 0;
+		struct Mesh mesh = {1, malloc(sizeof(struct Primitive))};
+		mesh.primitives[0] = batch_primitive(scene, batch_ends[i] - start, items + start);
+		mesh_bounds(&mesh);
+		mesh_grid(&mesh);
+		meshes[scene.mesh_count + i] = mesh;
+	}
+	free(items);
+	free(batch_ends);
+	//Nodes
+	struct Node* const nodes = malloc((kept_count + batch_count) * sizeof(struct Node));
+	*scene_nodes = malloc((kept_count + batch_count) * sizeof(unsigned));
+	unsigned node_count = 0;
+	for (unsigned i = 0; i < scene.node_count; ++i) {
+		if (!scene.nodes[i].has_mesh || !(scene.nodes[i].dynamic || scene.nodes[i].unbatched)) continue;
+		nodes[node_count] = scene.nodes[i];
+		nodes[node_count].child_count = 0;
+		nodes[node_count].children = NULL;
+		(*scene_nodes)[node_count++] = i;
+	}
+	for (unsigned i = 0; i < batch_count; ++i) {
+		nodes[node_count] = (struct Node) {0, NULL, true, scene.mesh_count + i, false, true, false};
+		glm_mat4_identity(nodes[node_count].transformation);
+		(*scene_nodes)[node_count++] = ~0u;
+	}
+	*output = (struct Scene) {
+		scene.mesh_count + batch_count, meshes,
+		node_count, nodes,
+		scene.material_count, scene.materials,
+		scene.texture_count, scene.textures
+	};
+}
+
+//Free what scene_batch_static allocated (the first mesh_count meshes belong to the original scene)
+void scene_destroy_batches(struct Scene batched, const unsigned mesh_count) {
+	for (unsigned i = mesh_count; i < batched.mesh_count; ++i)
+		destroy_mesh(batched.meshes + i);
+	free(batched.meshes);
+	free(batched.nodes);
+}
@@ -0,0 +1,174 @@
+#include "transform.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+//One float per node of a batch (compiled to SSE/AVX/NEON registers)
+typedef float Lanes __attribute__((vector_size(TRANSFORM_WIDTH * sizeof(float))));
+
+static const mat4 IDENTITY = GLM_MAT4_IDENTITY_INIT;
+
+void create_transforms(const unsigned count, struct Transforms* const transforms) {
+	float* const data = malloc(10 * count * sizeof(float));
+	*transforms = (struct Transforms) {
+		count,
+		{data, data + count, data + 2 * count},
+		{data + 3 * count, data + 4 * count, data + 5 * count, data + 6 * count},
+		{data + 7 * count, data + 8 * count, data + 9 * count}
+	};
+}
+
+void destroy_transforms(struct Transforms* const transforms) {
+	free(transforms->translation[0]);
+}
+
+void transforms_set(
+	struct Transforms* const transforms,
+	const unsigned i,
+	const vec3 translation,
+	const versor rotation,
+	const vec3 scaling) {
+	for (unsigned j = 0; j < 3; ++j) {
+		transforms->translation[j][i] = translation[j];
+		transforms->scaling[j][i] = scaling[j];
+	}
+	for (unsigned j = 0; j < 4; ++j)
+		transforms->rotation[j][i] = rotation[j];
+}
+
+void transforms_get(
+	const struct Transforms* const transforms,
+	const unsigned i,
+	vec3 translation,
+	versor rotation,
+	vec3 scaling) {
+	for (unsigned j = 0; j < 3; ++j) {
+		translation[j] = transforms->translation[j][i];
+		scaling[j] = transforms->scaling[j][i];
+	}
+	for (unsigned j = 0; j < 4; ++j)
+		rotation[j] = transforms->rotation[j][i];
+}
+
+//World transformation of node i
+static inline float* world(void* const worlds, const size_t stride, const unsigned i) {
+	return worlds + i * stride;
+}
+
+//Compose one node's transformation (rotation must be normalized)
+static void compose_one(
+	const struct Transforms* const transforms,
+	const unsigned* const parents,
+	const unsigned i,
+	void* const worlds,
+	const size_t stride) {
+	const float x = transforms->rotation[0][i], y = transforms->rotation[1][i];
+	const float z = transforms->rotation[2][i], w = transforms->rotation[3][i];
+	const float sx = transforms->scaling[0][i], sy = transforms->scaling[1][i], sz = transforms->scaling[2][i];
+	const float xx = 2 * x * x, yy = 2 * y * y, zz = 2 * z * z;
+	const float xy = 2 * x * y, xz = 2 * x * z, yz = 2 * y * z;
+	const float wx = 2 * w * x, wy = 2 * w * y, wz = 2 * w * z;
+	//Translation * rotation * scaling
+	mat4 local = {
+		{(1 - yy - zz) * sx, (xy + wz) * sx, (xz - wy) * sx, 0},
+		{(xy - wz) * sy, (1 - xx - zz) * sy, (yz + wx) * sy, 0},
+		{(xz + wy) * sz, (yz - wx) * sz, (1 - xx - yy) * sz, 0},
+		{transforms->translation[0][i], transforms->translation[1][i], transforms->translation[2][i], 1}
+	};
+	vec4* const result = (vec4*) world(worlds, stride, i);
+	if (parents[i] == NO_PARENT) glm_mat4_copy(local, result);
+	else glm_mat4_mul((vec4*) world(worlds, stride, parents[i]), local, result);
+}
+
+//Load a lane per node from an array
+static inline Lanes load_lanes(const float* const data) {
+	Lanes lanes;
+	memcpy(&lanes, data, sizeof(Lanes));
+	return lanes;
+}
+
+//Compose TRANSFORM_WIDTH nodes whose parents precede the batch
+static void compose_batch(
+	const struct Transforms* const transforms,
+	const unsigned* const parents,
+	const unsigned start,
+	void* const worlds,
+	const size_t stride) {
+	const Lanes x = load_lanes(transforms->rotation[0] + start), y = load_lanes(transforms->rotation[1] + start);
+	const Lanes z = load_lanes(transforms->rotation[2] + start), w = load_lanes(transforms->rotation[3] + start);
+	const Lanes sx = load_lanes(transforms->scaling[0] + start);
+	const Lanes sy = load_lanes(transforms->scaling[1] + start);
+	const Lanes sz = load_lanes(transforms->scaling[2] + start);
+	const Lanes xx = 2.0f * x * x, yy = 2.0f * y * y, zz = 2.0f * z * z;
+	const Lanes xy = 2.0f * x * y, xz = 2.0f * x * z, yz = 2.0f * y * z;
+	const Lanes wx = 2.0f * w * x, wy = 2.0f * w * y, wz = 2.0f * w * z;
+	//Local transformations (rows 0-2 of each column; row 3 is 0, 0, 0, 1)
+	const Lanes local[4][3] = {
+		{(1.0f - yy - zz) * sx, (xy + wz) * sx, (xz - wy) * sx},
+		{(xy - wz) * sy, (1.0f - xx - zz) * sy, (yz + wx) * sy},
+		{(xz + wy) * sz, (yz - wx) * sz, (1.0f - xx - yy) * sz},
+		{
+			load_lanes(transforms->translation[0] + start),
+			load_lanes(transforms->translation[1] + start),
+			load_lanes(transforms->translation[2] + start)
+		}
+	};
+	//Gather parent transformations
+	Lanes parent[4][4];
+	for (unsigned k = 0; k < TRANSFORM_WIDTH; ++k) {
+		const float* const matrix = parents[start + k] == NO_PARENT
+			? (const float*) IDENTITY
+			: world(worlds, stride, parents[start + k]);
+		for (unsigned c = 0; c < 4; ++c)
+			for (unsigned r = 0; r < 4; ++r)
+				parent[c][r][k] = matrix[4 * c + r];
+	}
+	//Parent * local, scattered to each node
+	for (unsigned c = 0; c < 4; ++c) {
+		for (unsigned r = 0; r < 4; ++r) {
+			Lanes result = parent[0][r] * local[c][0] + parent[1][r] * local[c][1] + parent[2][r] * local[c][2];
+			if (c == 3) result += parent[3][r];
+			for (unsigned k = 0; k < TRANSFORM_WIDTH; ++k)
+				world(worlds, stride, start + k)[4 * c + r] = result[k];
+		}
+	}
+}
+
+/*
+	Compose world transformations of nodes [start, start + count)
+	from their local transformations & their parents' world transformations.
+	Parents must precede their children.
+	World transformations are mat4s stride bytes apart from worlds.
+	Batches of TRANSFORM_WIDTH nodes are composed at once when none is another's parent.
+*/
+void compose_transforms(
+	const struct Transforms* const transforms,
+	const unsigned* const parents,
+	const unsigned start,
+	const unsigned count,
+	void* const worlds,
+	const size_t stride) {
+	const unsigned end = start + count;
+	unsigned i = start;
+	while (i < end) {
+		bool independent = end - i >= TRANSFORM_WIDTH;
+		for (unsigned k = 0; independent && k < TRANSFORM_WIDTH; ++k)
+			independent = parents[i + k] == NO_PARENT || parents[i + k] < i;
+		if (independent) {
+			compose_batch(transforms, parents, i, worlds, stride);
+			i += TRANSFORM_WIDTH;
+		} else compose_one(transforms, parents, i++, worlds, stride);
+	}
+}
+
+//Reference implementation, one node at a time
+void compose_transforms_scalar(
+	const struct Transforms* const transforms,
+	const unsigned* const parents,
+	const unsigned start,
+	const unsigned count,
+	void* const worlds,
+	const size_t stride) {
+	for (unsigned i = start; i < start + count; ++i)
+		compose_one(transforms, parents, i, worlds, stride);
+}
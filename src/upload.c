@@ -0,0 +1,462 @@
+#include "upload.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define STAGING_ALIGNMENT 16 //Valid copy offset for any texel size
+#define MIN_CHUNK_SIZE (64 << 10) //Smallest buffer chunk worth a copy command
+
+VkResult create_uploader(
+	struct Allocator* const allocator,
+	const uint32_t queue_family,
+	const uint32_t dst_queue_family,
+	const VkDeviceSize staging_size,
+	struct Uploader* const uploader) {
+	const VkDevice device = allocator->device;
+	*uploader = (struct Uploader) {
+		.device = device,
+		.queue_family = queue_family,
+		.dst_queue_family = dst_queue_family,
+		.staging_size = align_size(staging_size, STAGING_ALIGNMENT)
+	};
+	if (uploader->staging_size < MIN_CHUNK_SIZE) {
+		fprintf(stderr, "Error: the staging ring is smaller than a buffer chunk!\n");
+		return VK_ERROR_INITIALIZATION_FAILED;
+	}
+	vkGetDeviceQueue(device, queue_family, 0, &uploader->queue);
+	//Image copy granularity
+	unsigned queue_family_count;
+	vkGetPhysicalDeviceQueueFamilyProperties(allocator->physical_device, &queue_family_count, NULL);
+	VkQueueFamilyProperties* const queue_families
+		= malloc(queue_family_count * sizeof(VkQueueFamilyProperties));
+	vkGetPhysicalDeviceQueueFamilyProperties(allocator->physical_device, &queue_family_count, queue_families);
+	uploader->image_granularity = queue_families[queue_family].minImageTransferGranularity;
+	free(queue_families);
+	//Command pool
+	const VkCommandPoolCreateInfo pool_info = {
+		VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO, NULL,
+		VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+		queue_family
+	};
+	VkResult result = vkCreateCommandPool(device, &pool_info, NULL, &uploader->command_pool);
+	if (result) return result;
+	//Timeline semaphore
+	const VkSemaphoreTypeCreateInfo semaphore_type_info = {
+		VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO, NULL,
+		VK_SEMAPHORE_TYPE_TIMELINE,
+		0
+	};
+	const VkSemaphoreCreateInfo semaphore_info = {
+		VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+		&semaphore_type_info,
+		0
+	};
+	result = vkCreateSemaphore(device, &semaphore_info, NULL, &uploader->semaphore);
+	if (result) return result;
+	//Staging ring
+	const VkBufferCreateInfo staging_buffer_info = {
+		VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, NULL, 0,
+		uploader->staging_size,
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_SHARING_MODE_EXCLUSIVE,
+		0, NULL
+	};
+	result = create_buffers(
+		allocator,
+		1, &staging_buffer_info,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+		| VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		&uploader->staging_buffer,
+		&uploader->staging_alloc
+	);
+	if (result) return result;
+	uploader->staging = uploader->staging_alloc.mapped + uploader->staging_alloc.offsets[0];
+	return VK_SUCCESS;
+}
+
+static uint64_t submit_upload(struct Uploader* const);
+
+void destroy_uploader(struct Allocator* const allocator, struct Uploader* const uploader) {
+	submit_upload(uploader);
+	uploader_wait(uploader, uploader->value);
+	uploader_collect(uploader);
+	free(uploader->uploads);
+	free(uploader->buffer_barriers);
+	free(uploader->image_barriers);
+	vkDestroyBuffer(uploader->device, uploader->staging_buffer, NULL);
+	free_allocation(allocator, uploader->staging_alloc);
+	vkDestroySemaphore(uploader->device, uploader->semaphore, NULL);
+	vkDestroyCommandPool(uploader->device, uploader->command_pool, NULL);
+}
+
+//Command buffer collecting copies until the next submission
+static VkCommandBuffer upload_command_buffer(struct Uploader* const uploader) {
+	if (uploader->command_buffer) return uploader->command_buffer;
+	const VkCommandBufferAllocateInfo command_buffer_alloc_info = {
+		VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO, NULL,
+		uploader->command_pool,
+		VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		1
+	};
+	vkAllocateCommandBuffers(uploader->device, &command_buffer_alloc_info, &uploader->command_buffer);
+	const VkCommandBufferBeginInfo begin_info = {
+		VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, NULL,
+		VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+	};
+	vkBeginCommandBuffer(uploader->command_buffer, &begin_info);
+	return uploader->command_buffer;
+}
+
+//Submit recorded copies without waiting, signaling the next timeline value
+static uint64_t submit_upload(struct Uploader* const uploader) {
+	if (!uploader->command_buffer) return uploader->value;
+	const struct Upload upload = {
+		++uploader->value,
+		uploader->command_buffer,
+		uploader->staging_head
+	};
+	uploader->command_buffer = VK_NULL_HANDLE;
+	vkEndCommandBuffer(upload.command_buffer);
+	const VkCommandBufferSubmitInfo command_buffer_submit = {
+		VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO, NULL,
+		upload.command_buffer,
+		0
+	};
+	const VkSemaphoreSubmitInfo signal_semaphore = {
+		VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO, NULL,
+		uploader->semaphore,
+		upload.value,
+		VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+		0
+	};
+	const VkSubmitInfo2 submit_info = {
+		VK_STRUCTURE_TYPE_SUBMIT_INFO_2, NULL, 0,
+		0, NULL,
+		1, &command_buffer_submit,
+		1, &signal_semaphore
+	};
+	vkQueueSubmit2(uploader->queue, 1, &submit_info, VK_NULL_HANDLE);
+	//Keep staging space until the upload completes
+	uploader->uploads = realloc(uploader->uploads, (uploader->upload_count + 1) * sizeof(struct Upload));
+	uploader->uploads[uploader->upload_count++] = upload;
+	return upload.value;
+}
+
+/*
+	Reserve a whole number of units of the staging ring, at most size bytes.
+	If not even one unit is free, pending copies are submitted
+	& the oldest submissions waited on until it is.
+	Returns the reserved size (0 if a unit is larger than the ring).
+*/
+static VkDeviceSize reserve_staging(
+	struct Uploader* const uploader,
+	const VkDeviceSize size,
+	const VkDeviceSize unit,
+	VkDeviceSize* const offset) {
+	const VkDeviceSize ring_size = uploader->staging_size;
+	if (unit > ring_size) return 0;
+	while (true) {
+		VkDeviceSize position = align_size(uploader->staging_head, STAGING_ALIGNMENT);
+		//Reservations don't wrap around the end of the ring
+		if (ring_size - position % ring_size < unit)
+			position = align_size(position, ring_size);
+		const VkDeviceSize used = position - uploader->staging_tail;
+		VkDeviceSize available = used < ring_size ? ring_size - used : 0;
+		if (available > ring_size - position % ring_size)
+			available = ring_size - position % ring_size;
+		if (available >= unit) {
+			VkDeviceSize reserved = available - available % unit;
+			if (reserved > size) reserved = size;
+			*offset = position % ring_size;
+			uploader->staging_head = position + reserved;
+			return reserved;
+		}
+		//Reclaim space
+		submit_upload(uploader);
+		if (!uploader->upload_count) {
+			//Nothing in flight: the ring is empty
+			uploader->staging_head = uploader->staging_tail = 0;
+			continue;
+		}
+		uploader_wait(uploader, uploader->uploads[0].value);
+		uploader_collect(uploader);
+	}
+}
+
+/*
+	Upload parts gathered into consecutive ranges of buffers.
+	Buffer i receives the next part_counts[i] parts of data & sizes, back to back.
+	Parts are copied straight into the staging ring,
+	so no contiguous copy of a buffer's contents is ever needed.
+*/
+uint64_t upload_buffer_parts(
+	struct Uploader* const uploader,
+	const unsigned count,
+	const VkBuffer* const buffers,
+	const unsigned* const part_counts,
+	const void* const* const data,
+	const VkDeviceSize* const sizes) {
+	unsigned first_part = 0;
+	for (unsigned i = 0; i < count; ++i) {
+		const unsigned end = first_part + part_counts[i];
+		VkDeviceSize size = 0;
+		for (unsigned j = first_part; j < end; ++j)
+			size += sizes[j];
+		//Copy in chunks as ring space allows
+		unsigned part = first_part;
+		VkDeviceSize copied = 0, part_copied = 0;
+		while (copied < size) {
+			const VkDeviceSize remaining = size - copied;
+			VkDeviceSize offset;
+			const VkDeviceSize chunk = reserve_staging(
+				uploader,
+				remaining,
+				remaining < MIN_CHUNK_SIZE ? remaining : MIN_CHUNK_SIZE,
+				&offset
+			);
+			if (!chunk) {
+				fprintf(stderr, "Error: buffer chunks exceed the staging ring!\n");
+				break;
+			}
+			//Gather parts into the chunk
+			VkDeviceSize filled = 0;
+			while (filled < chunk) {
+				if (part_copied == sizes[part]) {
+					++part;
+					part_copied = 0;
+					continue;
+				}
+				VkDeviceSize part_chunk = sizes[part] - part_copied;
+				if (part_chunk > chunk - filled) part_chunk = chunk - filled;
+				memcpy(uploader->staging + offset + filled, data[part] + part_copied, part_chunk);
+				filled += part_chunk;
+				part_copied += part_chunk;
+			}
+			const VkBufferCopy region = {offset, copied, chunk};
+			vkCmdCopyBuffer(
+				upload_command_buffer(uploader),
+				uploader->staging_buffer,
+				buffers[i],
+				1, &region
+			);
+			copied += chunk;
+		}
+		first_part = end;
+	}
+	//Ownership transfer
+	if (uploader->queue_family != uploader->dst_queue_family) {
+		VkBufferMemoryBarrier2* const release_barriers = malloc(count * sizeof(VkBufferMemoryBarrier2));
+		uploader->buffer_barriers = realloc(
+			uploader->buffer_barriers,
+			(uploader->buffer_barrier_count + count) * sizeof(VkBufferMemoryBarrier2)
+		);
+		for (unsigned i = 0; i < count; ++i) {
+			release_barriers[i] = (VkBufferMemoryBarrier2) {
+				VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2, NULL,
+				VK_PIPELINE_STAGE_2_COPY_BIT,
+				VK_ACCESS_2_TRANSFER_WRITE_BIT,
+				VK_PIPELINE_STAGE_2_NONE,
+				VK_ACCESS_2_NONE,
+				uploader->queue_family,
+				uploader->dst_queue_family,
+				buffers[i],
+				0, VK_WHOLE_SIZE
+			};
+			uploader->buffer_barriers[uploader->buffer_barrier_count++] = (VkBufferMemoryBarrier2) {
+				VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2, NULL,
+				UPLOAD_DST_STAGES,
+				VK_ACCESS_2_NONE,
+				UPLOAD_DST_STAGES,
+				VK_ACCESS_2_MEMORY_READ_BIT,
+				uploader->queue_family,
+				uploader->dst_queue_family,
+				buffers[i],
+				0, VK_WHOLE_SIZE
+			};
+		}
+		const VkDependencyInfo release_dependency = {
+			VK_STRUCTURE_TYPE_DEPENDENCY_INFO, NULL, 0,
+			0, NULL,
+			count, release_barriers,
+			0, NULL
+		};
+		vkCmdPipelineBarrier2(upload_command_buffer(uploader), &release_dependency);
+		free(release_barriers);
+	}
+	return submit_upload(uploader);
+}
+
+uint64_t upload_buffers(
+	struct Uploader* const uploader,
+	const unsigned count,
+	const VkBuffer* const buffers,
+	const void* const* const data,
+	const VkDeviceSize* const sizes) {
+	unsigned* const part_counts = malloc(count * sizeof(unsigned));
+	for (unsigned i = 0; i < count; ++i)
+		part_counts[i] = 1;
+	const uint64_t value = upload_buffer_parts(uploader, count, buffers, part_counts, data, sizes);
+	free(part_counts);
+	return value;
+}
+
+//Images must be 2D with tightly packed rows
+uint64_t upload_images(
+	struct Uploader* const uploader,
+	const unsigned count,
+	const VkImage* const images,
+	const VkExtent3D* const extents,
+	const void* const* const data,
+	const VkDeviceSize* const sizes,
+	const VkImageLayout layout) {
+	//Image layout transition
+	const VkImageSubresourceRange color_subresource_range = {
+		VK_IMAGE_ASPECT_COLOR_BIT,
+		0, VK_REMAINING_MIP_LEVELS,
+		0, VK_REMAINING_ARRAY_LAYERS
+	};
+	VkImageMemoryBarrier2* const barriers = malloc(count * sizeof(VkImageMemoryBarrier2));
+	for (unsigned i = 0; i < count; ++i)
+		barriers[i] = (VkImageMemoryBarrier2) {
+			VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2, NULL,
+			VK_PIPELINE_STAGE_2_NONE,
+			VK_ACCESS_2_NONE,
+			VK_PIPELINE_STAGE_2_COPY_BIT,
+			VK_ACCESS_2_TRANSFER_WRITE_BIT,
+			VK_IMAGE_LAYOUT_UNDEFINED,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			VK_QUEUE_FAMILY_IGNORED,
+			VK_QUEUE_FAMILY_IGNORED,
+			images[i],
+			color_subresource_range
+		};
+	const VkDependencyInfo before_copy_dependency = {
+		VK_STRUCTURE_TYPE_DEPENDENCY_INFO, NULL, 0,
+		0, NULL,
+		0, NULL,
+		count, barriers
+	};
+	vkCmdPipelineBarrier2(upload_command_buffer(uploader), &before_copy_dependency);
+	//Final layout transition (& release to the destination queue family)
+	const bool transfer = uploader->queue_family != uploader->dst_queue_family;
+	for (unsigned i = 0; i < count; ++i)
+		barriers[i] = (VkImageMemoryBarrier2) {
+			VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2, NULL,
+			VK_PIPELINE_STAGE_2_COPY_BIT,
+			VK_ACCESS_2_TRANSFER_WRITE_BIT,
+			VK_PIPELINE_STAGE_2_NONE,
+			VK_ACCESS_2_NONE,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			layout,
+			transfer ? uploader->queue_family : VK_QUEUE_FAMILY_IGNORED,
+			transfer ? uploader->dst_queue_family : VK_QUEUE_FAMILY_IGNORED,
+			images[i],
+			color_subresource_range
+		};
+	//Image copy commands, in chunks of rows
+	for (unsigned i = 0; i < count; ++i) {
+		const VkExtent3D extent = extents[i];
+		const VkDeviceSize row_size = sizes[i] / extent.height;
+		//Partial copies must start at multiples of the transfer granularity (0: whole image)
+		const unsigned row_unit = uploader->image_granularity.height
+			? uploader->image_granularity.height
+			: extent.height;
+		unsigned row = 0;
+		while (row < extent.height) {
+			VkDeviceSize offset;
+			const VkDeviceSize chunk = reserve_staging(
+				uploader,
+				(extent.height - row) * row_size,
+				row_unit < extent.height - row ? row_unit * row_size : (extent.height - row) * row_size,
+				&offset
+			);
+			if (!chunk) {
+				fprintf(stderr, "Error: image rows exceed the staging ring!\n");
+				break;
+			}
+			const unsigned rows = chunk / row_size;
+			memcpy(uploader->staging + offset, data[i] + row * row_size, chunk);
+			const VkBufferImageCopy region = {
+				offset,
+				0,
+				0,
+				{VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+				{0, row, 0},
+				{extent.width, rows, 1}
+			};
+			vkCmdCopyBufferToImage(
+				upload_command_buffer(uploader),
+				uploader->staging_buffer,
+				images[i],
+				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				1, &region
+			);
+			row += rows;
+		}
+		const VkDependencyInfo after_copy_dependency = {
+			VK_STRUCTURE_TYPE_DEPENDENCY_INFO, NULL, 0,
+			0, NULL,
+			0, NULL,
+			1, barriers + i
+		};
+		vkCmdPipelineBarrier2(upload_command_buffer(uploader), &after_copy_dependency);
+	}
+	if (transfer) {
+		//Matching acquire operations
+		uploader->image_barriers = realloc(
+			uploader->image_barriers,
+			(uploader->image_barrier_count + count) * sizeof(VkImageMemoryBarrier2)
+		);
+		for (unsigned i = 0; i < count; ++i) {
+			VkImageMemoryBarrier2 acquire_barrier = barriers[i];
+			acquire_barrier.srcStageMask = UPLOAD_DST_STAGES;
+			acquire_barrier.srcAccessMask = VK_ACCESS_2_NONE;
+			acquire_barrier.dstStageMask = UPLOAD_DST_STAGES;
+			acquire_barrier.dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT;
+			uploader->image_barriers[uploader->image_barrier_count++] = acquire_barrier;
+		}
+	}
+	free(barriers);
+	return submit_upload(uploader);
+}
+
+/*
+	Record acquire operations for resources released by submitted uploads.
+	The command buffer's submission must wait on the timeline for those uploads.
+*/
+void uploader_acquire(struct Uploader* const uploader, const VkCommandBuffer command_buffer) {
+	if (!uploader->buffer_barrier_count && !uploader->image_barrier_count) return;
+	const VkDependencyInfo acquire_dependency = {
+		VK_STRUCTURE_TYPE_DEPENDENCY_INFO, NULL, 0,
+		0, NULL,
+		uploader->buffer_barrier_count, uploader->buffer_barriers,
+		uploader->image_barrier_count, uploader->image_barriers
+	};
+	vkCmdPipelineBarrier2(command_buffer, &acquire_dependency);
+	uploader->buffer_barrier_count = 0;
+	uploader->image_barrier_count = 0;
+}
+
+//Reclaim staging space & command buffers of completed uploads
+void uploader_collect(struct Uploader* const uploader) {
+	if (!uploader->upload_count) return;
+	uint64_t completed;
+	vkGetSemaphoreCounterValue(uploader->device, uploader->semaphore, &completed);
+	//Uploads complete in submission order
+	unsigned done = 0;
+	while (done < uploader->upload_count && uploader->uploads[done].value <= completed) {
+		const struct Upload upload = uploader->uploads[done++];
+		vkFreeCommandBuffers(uploader->device, uploader->command_pool, 1, &upload.command_buffer);
+		uploader->staging_tail = upload.staging_end;
+	}
+	uploader->upload_count -= done;
+	memmove(uploader->uploads, uploader->uploads + done, uploader->upload_count * sizeof(struct Upload));
+}
+
+VkResult uploader_wait(struct Uploader* const uploader, const uint64_t value) {
+	const VkSemaphoreWaitInfo wait_info = {
+		VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO, NULL, 0,
+		1, &uploader->semaphore, &value
+	};
+	return vkWaitSemaphores(uploader->device, &wait_info, UINT64_MAX);
+}